@@ -23,5 +23,10 @@ typedef struct {
 #define	EC_VGND	3
 #define EC_VIN  4
 #define EC_VOUT 5
+#define	battery_level_AIN	2
+/**
+ * \brief the highest mV adc.read() can return (10 bit resolution, 1.2V bandgap reference, 1/3 prescaling).
+ */
+#define ADC_FULL_SCALE_MV	3600
 
 #endif /* INCLUDE_LADYBUG_ADC_H_ */
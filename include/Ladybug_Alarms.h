@@ -0,0 +1,42 @@
+/**
+ * \file		Ladybug_Alarms.h
+ * \brief	High/low pH and EC alarms with hysteresis and a minimum dwell time.
+ * \details	A reading must stay beyond a threshold for dwell_s before the alarm is raised, and must come back inside the threshold by
+ * 		the hysteresis before the alarm is cleared.  This keeps a reading sitting on a threshold from flapping the alarm.
+ * \sa		Ladybug_Alarms.c
+ */
+
+#ifndef INCLUDE_LADYBUG_ALARMS_H_
+#define INCLUDE_LADYBUG_ALARMS_H_
+#include <stdint.h>
+#include "Ladybug_Plants.h"
+/**
+ * \brief The alarm thresholds.  A threshold of 0 uses the plant's target (if the plant in plantInfo is known), otherwise the alarm is off.
+ */
+typedef struct {
+  uint16_t	pH_low_x100;
+  uint16_t	pH_high_x100;
+  uint16_t	EC_low_uS;
+  uint16_t	EC_high_uS;
+  uint16_t	pH_hysteresis_x100;
+  uint16_t	EC_hysteresis_uS;
+  uint16_t	dwell_s;	///<how long a reading must stay beyond a threshold before the alarm is raised.
+  uint16_t	unused;		///<so the structure is word (4 bytes) aligned
+}alarmConfig_t;
+
+#define DEFAULT_PH_HYSTERESIS_X100	10
+#define DEFAULT_EC_HYSTERESIS_US	50
+#define DEFAULT_ALARM_DWELL_S		900
+/**
+ * \brief the alarm bits.  They are the same bits as a measurement's out_of_range.
+ */
+#define ALARM_PH_LOW		PLANT_PH_LOW
+#define ALARM_PH_HIGH		PLANT_PH_HIGH
+#define ALARM_EC_LOW		PLANT_EC_LOW
+#define ALARM_EC_HIGH		PLANT_EC_HIGH
+
+void ladybug_alarms_reset(void);
+void ladybug_alarms_thresholds(alarmConfig_t const *p_config, plantTarget_t const *p_target, plantTarget_t *p_thresholds);
+uint8_t ladybug_alarms_evaluate(alarmConfig_t const *p_config, plantTarget_t const *p_target, uint16_t pH_x100, uint16_t EC_uS, uint32_t now_s);
+
+#endif /* INCLUDE_LADYBUG_ALARMS_H_ */
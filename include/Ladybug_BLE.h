@@ -13,6 +13,7 @@
 #include <stdbool.h>
 #include "ble.h"
 #include "ble_srv_common.h"
+#include "ble_advdata.h"
 
 /*!
  * \brief created a UUID using uuidgen when in a terminal (mac).  left the last 32 bits 0 - similar to Nordic's nAN-36_v1.1.pdf (app note on writing a BLE app) - p. 21.
@@ -29,6 +30,19 @@
 #define LBL_UUID_PLANTINFO_CHAR 0x8E04
 #define LBL_UUID_MEASUREMENT_CHAR 0x8E05
 #define LBL_UUID_CALIBRATION_CHAR 0x8E06
+#define LBL_UUID_STATISTICS_CHAR 0x8E07
+#define LBL_UUID_EC_CALIBRATION_TABLE_CHAR 0x8E08
+#define LBL_UUID_CALIBRATION_HISTORY_CHAR 0x8E09
+#define LBL_UUID_SETTLING_CHAR 0x8E0A
+#define LBL_UUID_FORECAST_CHAR 0x8E0B
+#define LBL_UUID_SENSORS_CHAR 0x8E0C
+#define LBL_UUID_SENSOR_CALIBRATIONS_CHAR 0x8E0D
+#define LBL_UUID_PH_FIT_CHAR 0x8E0E
+/*!
+ * \brief The company identifier of the manufacturer specific data in the advertising payload.  0xFFFF is the Bluetooth SIG's identifier
+ * for testing.  The data is one byte - the alarms (ALARM_PH_LOW, ALARM_PH_HIGH, ALARM_EC_LOW, ALARM_EC_HIGH).
+ */
+#define LBL_ADV_COMPANY_IDENTIFIER 0xFFFF
 
 /**@brief LBL Service structure. This contains various status information for the service. */
 typedef struct ble_lbl_s
@@ -40,6 +54,14 @@ typedef struct ble_lbl_s
     ble_gatts_char_handles_t	control_char_handles;
     ble_gatts_char_handles_t	measurement_char_handles;
     ble_gatts_char_handles_t	calibration_char_handles;
+    ble_gatts_char_handles_t	statistics_char_handles;
+    ble_gatts_char_handles_t	EC_calibration_table_char_handles;
+    ble_gatts_char_handles_t	calibration_history_char_handles;
+    ble_gatts_char_handles_t	settling_char_handles;
+    ble_gatts_char_handles_t	forecast_char_handles;
+    ble_gatts_char_handles_t	sensors_char_handles;
+    ble_gatts_char_handles_t	sensor_calibrations_char_handles;
+    ble_gatts_char_handles_t	pH_fit_char_handles;
     uint8_t                     uuid_type;
     uint16_t                    conn_handle;
 } ble_lbl_t;
@@ -64,6 +86,35 @@ uint32_t ladybug_BLE_init(ble_lbl_t * p_lbl);
  */
 void ladybug_BLE_on_ble_evt(ble_lbl_t * p_lbl, ble_evt_t * p_ble_evt);
 
+/**@brief Function for taking a measurement and updating the measurement characteristic.
+ *
+ * @param[in]   p_lbl                LBL Service structure.
+ * @param[in]   requested_by_client  true if the client asked for the measurement.  Otherwise the client is only
+ *                                   notified when the readings moved by more than the configured delta.
+ */
+void ladybug_BLE_update_measurement(ble_lbl_t * p_lbl, bool requested_by_client);
+
+/**@brief Function for taking the next step of a calibration the client asked for.
+ *
+ * @details Called from the main loop when ladybug_there_is_a_calibration_step() is true.  The settling characteristic is notified
+ *          while the calibration waits for the reading to settle, and the calibration (or EC calibration table) characteristic once it
+ *          is made.
+ *
+ * @param[in]   p_lbl                LBL Service structure.
+ */
+void ladybug_BLE_calibration_step(ble_lbl_t * p_lbl);
+
+/**@brief Function for building the advertising and scan response data.
+ *
+ * @details The advertising packet has the name and the alarms so a scanner that doesn't connect (or even send a scan request)
+ *          sees the alarms.  The LBL service's 128 bit UUID doesn't fit with them so it is in the scan response.
+ *
+ * @param[in]   p_lbl        LBL Service structure.
+ * @param[out]  p_advdata    advertising data.
+ * @param[out]  p_scanrsp    scan response data.
+ */
+void ladybug_BLE_advertising_data(ble_lbl_t * p_lbl, ble_advdata_t * p_advdata, ble_advdata_t * p_scanrsp);
+
 
 #endif // BLE_LBL_H__
 
@@ -0,0 +1,30 @@
+/**
+ * \file		Ladybug_CRC.h
+ * \brief	CRC-32 (the zlib/Ethernet polynomial, reflected) of the records in flash.
+ * \details	There are three kernels.  LADYBUG_CRC32_KERNEL picks the one that is built:
+ * 		- CRC32_KERNEL_BITWISE: no table.  Eight shifts per byte.
+ * 		- CRC32_KERNEL_NIBBLE: a 16 entry (64 byte) table.  Two lookups per byte.  The default - it is close to the byte table's speed on
+ * 		  the M0 for 1/16th of the flash.
+ * 		- CRC32_KERNEL_BYTE: a 256 entry (1KB) table.  One lookup per byte.  The tables are const, so they are in flash.
+ * 		Building with LADYBUG_BENCHMARK builds all three and adds ladybug_crc_benchmark(), which prints the cycles per byte of each.
+ * \sa		Ladybug_CRC.c
+ */
+
+#ifndef INCLUDE_LADYBUG_CRC_H_
+#define INCLUDE_LADYBUG_CRC_H_
+#include <stdint.h>
+
+#define CRC32_KERNEL_BITWISE	0
+#define CRC32_KERNEL_NIBBLE	1
+#define CRC32_KERNEL_BYTE	2
+#ifndef LADYBUG_CRC32_KERNEL
+#define LADYBUG_CRC32_KERNEL	CRC32_KERNEL_NIBBLE
+#endif
+#define CRC32_INITIAL		0	///<the crc to start with.  A crc can be carried on with more bytes, e.g.: crc = ladybug_crc32(crc,...)
+
+uint32_t ladybug_crc32(uint32_t crc, uint8_t const *p_bytes, uint32_t num_bytes);
+#ifdef LADYBUG_BENCHMARK
+void ladybug_crc_benchmark(void);
+#endif
+
+#endif /* INCLUDE_LADYBUG_CRC_H_ */
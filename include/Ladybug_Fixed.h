@@ -0,0 +1,57 @@
+/**
+ * \file		Ladybug_Fixed.h
+ * \brief	Fixed point math for the nRF51822's Cortex-M0, which has no divide instruction and no FPU.
+ * \details	A Q15 value is an int16_t holding value * 2^15.  A Q16 value is an int32_t holding value * 2^16.  The multiplies and the
+ * 		saturating ops are inline since each is a few instructions.  A divide on the M0 is a library call of about 100 cycles, so
+ * 		- a divide by a small count (a mean over a window) is a multiply by a reciprocal from a table.
+ * 		- a divide by a value that rarely changes (a calibration span) is a multiply by a Q16 reciprocal worked out when it changes.
+ * 		Building with LADYBUG_BENCHMARK adds ladybug_fixed_benchmark(), which times each op with TIMER2 and prints the cycles per op.
+ * \sa		Ladybug_Fixed.c
+ */
+
+#ifndef INCLUDE_LADYBUG_FIXED_H_
+#define INCLUDE_LADYBUG_FIXED_H_
+#include <stdint.h>
+
+#define FIXED_SMALL_DIVISOR_MAX	16	///<the largest count ladybug_fixed_div_small() divides by
+
+static inline int16_t ladybug_fixed_sat_s16(int32_t value) {
+  return value < INT16_MIN ? INT16_MIN : (value > INT16_MAX ? INT16_MAX : value);
+}
+static inline uint16_t ladybug_fixed_sat_u16(int32_t value) {
+  return value < 0 ? 0 : (value > UINT16_MAX ? UINT16_MAX : value);
+}
+static inline uint8_t ladybug_fixed_sat_u8(int32_t value) {
+  return value < 0 ? 0 : (value > UINT8_MAX ? UINT8_MAX : value);
+}
+static inline int16_t ladybug_fixed_sat_add_s16(int16_t a, int16_t b) {
+  return ladybug_fixed_sat_s16((int32_t)a + b);
+}
+static inline int16_t ladybug_fixed_sat_sub_s16(int16_t a, int16_t b) {
+  return ladybug_fixed_sat_s16((int32_t)a - b);
+}
+/**
+ * \brief a * b in Q15.  -1 * -1 saturates to just under 1.
+ */
+static inline int16_t ladybug_fixed_q15_mul(int16_t a, int16_t b) {
+  return ladybug_fixed_sat_s16(((int32_t)a * b) >> 15);
+}
+/**
+ * \brief a * b where b is Q16.  a can be an integer (the result is then an integer) or a Q16 value (the result is Q16).
+ */
+static inline int32_t ladybug_fixed_q16_mul(int32_t a, int32_t b_q16) {
+  return (int32_t)(((int64_t)a * b_q16) >> 16);
+}
+
+int32_t ladybug_fixed_div_small(int32_t value, uint8_t divisor);
+int32_t ladybug_fixed_reciprocal_q16(int32_t numerator, int32_t divisor);
+uint32_t ladybug_fixed_isqrt64(uint64_t value);
+int32_t ladybug_fixed_log2_q8(uint32_t value);
+#ifdef LADYBUG_BENCHMARK
+void ladybug_fixed_benchmark_start(void);
+uint32_t ladybug_fixed_benchmark_now(void);
+void ladybug_fixed_benchmark_stop(void);
+void ladybug_fixed_benchmark(void);
+#endif
+
+#endif /* INCLUDE_LADYBUG_FIXED_H_ */
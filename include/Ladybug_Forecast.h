@@ -0,0 +1,38 @@
+/**
+ * \file		Ladybug_Forecast.h
+ * \brief	Forecasts when a reading will cross a threshold from the least squares slope of the most recent scheduled readings.
+ * \details	The readings are taken a sampling period apart, so the slope is worked out against the reading's place in the window.
+ * 		Adding a reading updates the sums in O(1) - the window doesn't have to be walked.
+ * \sa		Ladybug_Forecast.c
+ */
+
+#ifndef INCLUDE_LADYBUG_FORECAST_H_
+#define INCLUDE_LADYBUG_FORECAST_H_
+#include <stdint.h>
+
+#define FORECAST_WINDOW		16
+#define FORECAST_MIN_READINGS	4	///<no forecast is made from fewer readings
+#define FORECAST_UNKNOWN	UINT16_MAX
+
+typedef enum {
+  headingNowhere,	///<the reading is steady, there aren't enough readings, or it is heading for a threshold that is off.
+  headingLow,
+  headingHigh
+}forecast_heading_t;
+/**
+ * \brief the sliding window.  sum_y is the sum of the readings and sum_iy the sum of each reading times its place (0 = oldest).
+ */
+typedef struct {
+  uint16_t	readings[FORECAST_WINDOW];
+  uint8_t	count;
+  uint8_t	oldest;
+  int32_t	sum_y;
+  int32_t	sum_iy;
+}forecast_t;
+
+void ladybug_forecast_reset(forecast_t *p_forecast);
+void ladybug_forecast_add(forecast_t *p_forecast, uint16_t reading);
+int32_t ladybug_forecast_slope_q8(forecast_t const *p_forecast);
+forecast_heading_t ladybug_forecast_readings_to_threshold(forecast_t const *p_forecast, uint16_t low, uint16_t high, uint16_t *p_readings);
+
+#endif /* INCLUDE_LADYBUG_FORECAST_H_ */
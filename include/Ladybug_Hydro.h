@@ -9,6 +9,11 @@
 #define LADYBUG_HYDRO_H
 #include "pstorage.h"
 #include "ble_advdata.h"
+#include "Ladybug_Stats.h"
+#include "Ladybug_Alarms.h"
+#include "Ladybug_Settling.h"
+#include "Ladybug_Forecast.h"
+#include "Ladybug_Sensors.h"
 
 
 //The enum of control operations corresponds to an equivalent enum on the client
@@ -26,7 +31,23 @@ typedef enum {
   undoEC1,
   undoEC2,
   updateBatteryLevel,
-  updateDeviceName
+  updateDeviceName,
+  updateSamplingConfig,
+  updateStatistics,
+  addECcalibrationPoint,
+  removeECcalibrationPoint,
+  listECcalibrationPoints,
+  redoPH4,
+  redoPH7,
+  redoEC1,
+  redoEC2,
+  setTime,
+  updateAlarmConfig,
+  checkPHsettling,
+  checkECsettling,
+  calibrateSensor,
+  resetSensorCalibration,
+  calibratePH10
 }control_enum_t;
 
 // Subtract 2 (ADV_DATA_OFFSET in ble_advdata.c) .
@@ -35,6 +56,19 @@ typedef enum {
 
 #define 		DEVNAME_MAX_LEN 		BLE_GAP_DEVNAME_MAX_LEN - 2 - 3 - sizeof(uint16_le_t)
 
+/**
+ * \brief The bits of a measurement's quality.  Each bit is a reason not to trust the pH or the EC reading.  A channel with a RAILED, VGND,
+ * or OPEN bit is unusable.  A NOISY channel is usable but the reading moved around while it was taken.
+ */
+#define QUALITY_PH_RAILED	0x01	///<the pH AIN is at (or near) ground or the supply.  An open (unplugged) probe often reads this way.
+#define QUALITY_PH_VGND		0x02	///<the pH virtual ground is at a rail or isn't steady.
+#define QUALITY_PH_NOISY	0x04	///<the pH AIN samples were spread by more than PH_SPREAD_MAX_MV.
+#define QUALITY_EC_RAILED	0x08	///<the EC VIN or VOUT AIN is at a rail.
+#define QUALITY_EC_VGND		0x10
+#define QUALITY_EC_OPEN		0x20	///<there is a VIN but no VOUT - the probe is out of the water or unplugged.
+#define QUALITY_EC_NOISY	0x40
+#define QUALITY_PH_UNUSABLE	(QUALITY_PH_RAILED | QUALITY_PH_VGND)
+#define QUALITY_EC_UNUSABLE	(QUALITY_EC_RAILED | QUALITY_EC_VGND | QUALITY_EC_OPEN)
 /**
  * \brief This structure is set up to hold the mV values read from the AINs used in measuring either the pH or EC.  EC measurements use
  * both an EC_Vin, and EC_Vout.  This is why there are 2 int16's holding EC mV values.  There is an int16 unused so an instance of
@@ -43,8 +77,57 @@ typedef enum {
 typedef struct {
   int16_t	EC_mV[2];   ///< EC_mV[0] is the AIN reading of EC_VIN.  EC_mV[1] is the EC_VOUT reading.
   int16_t	pH_mV;
-  int16_t	unused;  ///< so the stucture is word (4 bytes) aligned
+  uint8_t	out_of_range;	///< PLANT_PH_LOW, PLANT_PH_HIGH, PLANT_EC_LOW, PLANT_EC_HIGH bits for the plant in plantInfo.  0 if the plant isn't known.
+  uint8_t	quality;	///< QUALITY_... bits of what is wrong with the readings.  0 if nothing is.
+  uint16_t	EC_uS;   ///< EC in µS/cm interpolated from the EC calibration table.  0 if the table is empty.
+  uint16_t	pH_x100; ///< pH * 100 from the pH4 and pH7 calibration.  0 if the calibration can't give a pH.
 }measurements_t;
+/**
+ * \brief A reading of one of the sensors in the registry.  The first pH and EC sensors' values are pH_x100 and EC_uS of measurements_t.
+ * The other sensors' values come from their sensor calibration.
+ */
+typedef struct {
+  uint8_t	type;		///<sensor_type_t
+  uint8_t	quality;	///<SENSOR_QUALITY_... bits
+  int16_t	mV[SENSOR_MAX_AINS];
+  int32_t	value;		///<in the sensor's units.  0 if the sensor hasn't been calibrated.
+}sensorMeasurement_t;
+/**
+ * \brief What the sensors characteristic holds - a reading of each sensor in the registry, in registry order.
+ */
+typedef struct {
+  uint8_t		num_sensors;
+  uint8_t		unused[3];
+  sensorMeasurement_t	sensors[NUM_SENSORS];
+}sensorMeasurements_t;
+/**
+ * \brief The min, max, mean and standard deviation of each reading since the last report.  count is the number of measurements
+ * in the window.  This is the value of the statistics characteristic.
+ */
+typedef struct {
+  uint16_t		count;
+  channelStatistics_t	pH;
+  channelStatistics_t	EC_Vin;
+  channelStatistics_t	EC_Vout;
+}statistics_t;
+/**
+ * \brief How healthy a probe looks from its calibrations.
+ */
+typedef enum {
+  probeGood,
+  probeAging,	///<still usable but drifting.  Plan to replace.
+  probeReplace,	///<readings can no longer be trusted.
+  probeUnknown	///<the probe has not been calibrated.
+}probe_health_t;
+/**
+ * \brief Probe health worked out each time the calibration changes.
+ */
+typedef struct {
+  uint8_t	pH_slope_pct;	///<the fitted pH line's slope as a percent of the ideal 59.2mV per pH.  An aging pH probe's slope drops.
+  int8_t	pH_offset_mV;	///<where the fitted pH line crosses pH7 (pH7_mV with two points), which is ideally 0.
+  uint8_t	EC_gain_pct;	///<EC1solution per unit of EC_VOUT/EC_VIN as a percent of the first EC calibration in the trend.
+  uint8_t	health;		///<low nibble is the pH probe's probe_health_t, high nibble is the EC probe's
+}probeHealth_t;
 /**
  * \brief This struct sets up the mV readings measured for calibrating pH, EC1, or EC2.  There is also room to store the values the
  * user entered for the amount of µS/cm the calibration solution was made at (as stated on the label).
@@ -57,11 +140,152 @@ typedef struct {
   uint16_t 	EC2solution; ///<same as EC1solution but for the second calibration point
   uint16_t 	EC1_mV[2];  ///<first byte = EC_VIN_mV for EC1 and second byte = EC_VOUT_mV
   uint16_t 	EC2_mV[2];  ///<two bytes for the same reason there are two bytes with EC1
+  probeHealth_t	probeHealth; ///<worked out from the values above and the trend, so the client gets it with the calibration values.
 }calibrationValues_t;
+/**
+ * \brief The optional third pH calibration point and the line fitted (least squares) through the pH4, pH7, and pH10 points.  Kept apart from
+ * calibrationValues_t so the calibration characteristic still fits in a notify.
+ */
+typedef struct {
+  int16_t	pH10_mV;		///<pH10 should be ~ -178mV.  Only used when num_points is 3.
+  int16_t	slope_x10_mV_per_pH;	///<how many mV (* 10) the fitted line drops per pH unit.  Ideally 592.
+  uint16_t	residual_x10_mV;	///<the RMS (* 10) of how far the points are from the fitted line.  0 with two points.
+  uint8_t	num_points;		///<2 (pH4 and pH7), or 3 once pH10 has been calibrated.
+  uint8_t	unused;			///<so the structure is word (4 bytes) aligned
+}pHFit_t;
 typedef struct {
  uint32_t 			write_check;
  calibrationValues_t		calValues;
+ pHFit_t			pHFit;	///<fills out the flash block.  Calibrations written before the pH10 point (version 0) can have erased flash here.
 }storeCalibrationValues_t;
+typedef struct {
+ uint32_t 			write_check;
+ alarmConfig_t			alarmConfig;
+}storeAlarmConfig_t;
+/**
+ * \brief The calibration of each sensor in the registry.  The first pH and EC sensors are calibrated with calibratePH4...calibrateEC2 and
+ * the EC calibration table, so their entries aren't used.
+ */
+typedef struct {
+ uint32_t 			write_check;
+ sensorCalibration_t		calibrations[NUM_SENSORS];
+}storeSensorCalibrations_t;
+/**
+ * \brief How a calibration waits for the probe's reading to settle.  The pH is tracked in mV.  The EC is tracked with the EC VOUT mV.
+ */
+#define SETTLING_PERIOD_S			2
+#define SETTLING_TIMEOUT_S			180
+#define PH_STABLE_SLOPE_MV_PER_MIN		3	///<about 0.05 pH per minute
+#define EC_STABLE_SLOPE_MV_PER_MIN		10
+/**
+ * \brief What the settling characteristic holds.  It is notified after each reading while a calibration is waiting.
+ */
+typedef struct {
+  uint8_t	state;			///<settling_state_t
+  uint8_t	command;		///<the calibration (or checkPHsettling / checkECsettling) that is waiting on the reading
+  uint16_t	elapsed_s;
+  uint16_t	time_to_stable_s;	///<0 when stable.  SETTLING_UNKNOWN_TIME if it can't be estimated yet.
+  int16_t	slope_per_min;		///<how much the reading (in mV) is moving per minute
+  int16_t	reading_mV;
+}settlingStatus_t;
+/**
+ * \brief What the forecast characteristic holds.  It is worked out from the scheduled measurements only, so it needs the sampling timer on.
+ */
+typedef struct {
+  int16_t	pH_slope_x100_per_hour;		///<how fast the pH is moving (in pH * 100 per hour)
+  uint16_t	pH_minutes_to_threshold;	///<0 if already beyond the threshold.  FORECAST_UNKNOWN if the pH isn't heading for a threshold.
+  int16_t	EC_slope_uS_per_hour;
+  uint16_t	EC_minutes_to_threshold;
+  uint8_t	heading;			///<the ALARM_PH_LOW, ALARM_PH_HIGH, ALARM_EC_LOW, or ALARM_EC_HIGH thresholds the readings are heading for
+  uint8_t	readings;			///<how many readings the forecast is worked out from (up to FORECAST_WINDOW)
+  uint16_t	unused;				///<so the structure is word (4 bytes) aligned
+}forecastReport_t;
+/**
+ * \brief How many calibrations are kept in the probe health trend.
+ */
+#define PROBE_HEALTH_TREND_DEPTH	6
+/**
+ * \brief The probe's condition when it was calibrated.
+ */
+typedef struct {
+  uint32_t	time;		///<ladybug_time_now() when the calibration was made.
+  uint16_t	EC_gain;	///<EC1solution * EC1_mV[0] / EC1_mV[1].  0 if EC1 had not been calibrated.
+  uint8_t	pH_slope_pct;
+  int8_t	pH_offset_mV;
+}probeHealthSample_t;
+typedef struct {
+  uint8_t		newest;
+  uint8_t		count;
+  uint8_t		unused[2];
+  probeHealthSample_t	samples[PROBE_HEALTH_TREND_DEPTH];
+}probeHealthTrend_t;
+typedef struct {
+ uint32_t 			write_check;
+ probeHealthTrend_t		probeHealthTrend;
+}storeProbeHealthTrend_t;
+/**
+ * \brief The calibration points that keep a history.
+ */
+typedef enum {
+  pH4Point,
+  pH7Point,
+  EC1Point,
+  EC2Point,
+  NUM_CALIBRATION_POINTS
+}calibration_point_t;
+/**
+ * \brief How many calibrations of each point are remembered.
+ */
+#define CALIBRATION_HISTORY_DEPTH	4
+/**
+ * \brief One calibration of a point.  pH points use mV[0].  EC points use mV[0] for EC_VIN, mV[1] for EC_VOUT, and solution.
+ */
+typedef struct {
+  uint32_t	time;     ///<ladybug_time_now() when the calibration was made.
+  int16_t	mV[2];
+  uint16_t	solution;
+  uint16_t	unused;   ///<so the structure is word (4 bytes) aligned
+}calibrationHistoryEntry_t;
+/**
+ * \brief A ring of the last CALIBRATION_HISTORY_DEPTH calibrations of a point.  Undo steps back through the ring, redo steps forward.  A new
+ * calibration made after an undo throws away what could have been redone (like an editor).
+ */
+typedef struct {
+  uint8_t			newest;   ///<index into entries[] of the newest calibration.
+  uint8_t			count;    ///<the number of entries in the ring.
+  uint8_t			undone;   ///<how many steps back from the newest the calibration in use is.  0 means nothing has been undone.
+  uint8_t			unused;
+  calibrationHistoryEntry_t	entries[CALIBRATION_HISTORY_DEPTH];
+}calibrationHistory_t;
+typedef struct {
+ uint32_t 			write_check;
+ calibrationHistory_t		history[NUM_CALIBRATION_POINTS];
+}storeCalibrationHistory_t;
+/**
+ * \brief The most points the EC calibration table can hold.  A two point line is off by 5-8% at the ends of the
+ * 500-3000 µS/cm range.  Piecewise-linear interpolation between up to 8 points fixes this.
+ */
+#define EC_TABLE_MAX_POINTS	8
+/**
+ * \brief A point in the EC calibration table.  The probe's response is EC_VOUT_mV / EC_VIN_mV - which goes up as the conductivity goes up - kept
+ * in Q12 (4096 = 1.0).
+ */
+typedef struct {
+  uint16_t	solution; ///<the calibration solution's value in µS/cm.  Typically printed on the bottle
+  uint16_t	ratio;    ///<the probe's EC_VOUT/EC_VIN reading in the calibration solution, Q12
+}ECcalibrationPoint_t;
+/**
+ * \brief The EC calibration table.  The points are kept sorted by ratio so the segment a reading falls in is found with a binary search.
+ */
+typedef struct {
+  uint8_t		num_points;
+  uint8_t		unused[3];  ///<so the points are word (4 bytes) aligned
+  ECcalibrationPoint_t	points[EC_TABLE_MAX_POINTS];
+}ECcalibrationTable_t;
+typedef struct {
+ uint32_t 			write_check;
+ ECcalibrationTable_t		ECcalibrationTable;
+}storeECcalibrationTable_t;
 /**
  * \brief The plant type might be tomato.  The growth type might be Seedling.  Since a flash block = 32 bytes, the plantInfo_t must be <= 28 bytes
  * so that there are 4 bytes for the write_check.  The most characters of a growth stage is 8 for Seedling.  This is why stage can be a max of 8 characters, which
@@ -80,9 +304,44 @@ typedef struct {
  plantInfo_u		 	plantChar;
 }storePlantInfo_t;
 /**
- * \brief Used to determine if the pH calibration values or plant info has been written to storage (or are corrupt)
+ * \brief How often the Ladybug takes a measurement on its own and how much pH or EC has to move before the client is notified.
+ * A period of 0 turns off scheduled sampling.  Stored in flash so the schedule survives a restart.
+ */
+typedef struct {
+  uint16_t	period_s;    ///<seconds between scheduled measurements.
+  uint16_t	pH_delta_mV; ///<notify when pH_mV has moved more than this since the last notification.
+  uint16_t	EC_delta_mV; ///<notify when either EC_mV has moved more than this since the last notification.
+  uint16_t	unused;      ///<so the structure is word (4 bytes) aligned
+}samplingConfig_t;
+typedef struct {
+ uint32_t 			write_check;
+ samplingConfig_t		samplingConfig;
+}storeSamplingConfig_t;
+/**
+ * \brief The sampling config used until the client sends one.  About 5mV is ~0.08 pH.
+ */
+#define DEFAULT_SAMPLING_PERIOD_S	300
+#define DEFAULT_PH_DELTA_MV		5
+#define DEFAULT_EC_DELTA_MV		10
+/**
+ * \brief Used to determine if a record in the block it was kept in before the flash log has been written.  A record in the log is
+ * checked by its CRC instead.
  */
 #define WRITE_CHECK		0x01020304
+/**
+ * \brief The version of each record's layout.  It is written with the record in the flash log along with the record's length.  When a
+ * record's layout changes, bump its version and add the step up from the old version to migrate_record() (Ladybug_Hydro.c), which runs
+ * when the record is loaded.  Versions go up to FLASH_MAX_RECORD_VERSION.  Records written before there were versions are version 0.
+ */
+#define CALIBRATION_VALUES_VERSION	1	///<1: pHFit holds 2 points rather than erased flash when pH10 hasn't been calibrated.
+#define PLANT_INFO_VERSION		0
+#define DEVICE_NAME_VERSION		0
+#define SAMPLING_CONFIG_VERSION		0
+#define EC_CALIBRATION_TABLE_VERSION	0
+#define CALIBRATION_HISTORY_VERSION	0
+#define PROBE_HEALTH_TREND_VERSION	0
+#define ALARM_CONFIG_VERSION		0
+#define SENSOR_CALIBRATIONS_VERSION	0
 
 /**
  * \brief The default device name is used when the code detects a device name has not been entered by the client.
@@ -92,18 +351,41 @@ typedef struct {
  */
 #define 	DEFAULT_DEVICE_NAME	"LBL"
 
-void ladybug_get_measurements(measurements_t **p_measurements);
+void ladybug_hydro_init(void);
+void ladybug_take_measurements(void);
+void ladybug_get_measurements(measurements_t *p_measurements);
+void ladybug_report_statistics(statistics_t *p_statistics);
 void ladybug_get_plantInfo(plantInfo_t **p_plantInfo);
+void ladybug_update_plantInfo(uint8_t const *p_bytes, uint16_t len);
 void ladybug_get_calibrationValues(calibrationValues_t **p_calibrationValues);
 void ladybug_get_calibration_values_memory_location(calibrationValues_t **p_calibrationValues);
+void ladybug_get_pH_fit_memory_location(pHFit_t **p_pHFit);
 void ladybug_get_device_name(char **p_deviceName);
 void ladybug_update_calibration_value(uint8_t which_to_calibrate,int calValue);
 void ladybug_undo_pH_calibration(control_enum_t command, int16_t pHCalValue);
 void ladybug_undo_EC_calibration(control_enum_t command, int16_t EC_Vin, int16_t EC_Vout);
 void ladybug_reset_calibration_values(control_enum_t command);
+bool ladybug_undo_calibration(control_enum_t command);
+bool ladybug_redo_calibration(control_enum_t command);
+void ladybug_get_calibration_history(storeCalibrationHistory_t **p_storeCalibrationHistory);
+void ladybug_update_alarm_config(alarmConfig_t const *p_alarmConfig);
+uint8_t ladybug_get_alarms(void);
+void ladybug_update_forecast(forecastReport_t *p_report);
+void ladybug_get_sensor_measurements(sensorMeasurements_t *p_sensorMeasurements);
+void ladybug_get_sensor_calibrations(storeSensorCalibrations_t **p_storeSensorCalibrations);
+void ladybug_request_sensor_calibration(uint8_t sensor, uint8_t point, int16_t reference, bool wait_until_stable);
+void ladybug_reset_sensor_calibration(uint8_t sensor);
+void ladybug_request_calibration(control_enum_t command, uint16_t solution, bool wait_until_stable);
+bool ladybug_there_is_a_calibration_step(void);
+bool ladybug_calibration_step(settlingStatus_t *p_status);
 void ladybug_write_device_name(char *p_device_name,uint16_t len);
-bool ladybug_there_are_calibration_values_to_write(storeCalibrationValues_t **p_storeCalibrationValues);
-bool ladybug_there_are_plantInfo_values_to_write(storePlantInfo_t **p_storePlantInfo);
-bool ladybug_the_device_name_has_been_updated(char **p_deviceName);
+void ladybug_update_sampling_config(uint16_t period_s, uint16_t pH_delta_mV, uint16_t EC_delta_mV);
+void ladybug_add_EC_calibration_point(uint16_t solution);
+void ladybug_remove_EC_calibration_point(uint16_t solution);
+void ladybug_get_EC_calibration_table(ECcalibrationTable_t *p_ECcalibrationTable);
+void ladybug_request_measurement(void);
+bool ladybug_there_is_a_measurement_to_take(bool *p_requested_by_client);
+bool ladybug_measurements_moved_beyond_delta(measurements_t *p_measurements);
+void ladybug_measurements_were_notified(measurements_t *p_measurements);
 
 #endif
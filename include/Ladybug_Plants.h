@@ -0,0 +1,34 @@
+/**
+ * \file		Ladybug_Plants.h
+ * \brief	pH and EC target ranges for the plant types and growth stages the Ladybug knows about.
+ * \details	The table is const so it lives in flash.  A plant is found with a perfect hash of its type and stage strings, so checking a
+ * 		measurement against the plant's targets doesn't scan strings.
+ * \sa		Ladybug_Plants.c
+ */
+
+#ifndef INCLUDE_LADYBUG_PLANTS_H_
+#define INCLUDE_LADYBUG_PLANTS_H_
+#include <stdint.h>
+#include <stddef.h>
+/**
+ * \brief The range of pH and EC a plant grows well in.
+ */
+typedef struct {
+  uint16_t	pH_min_x100;	///<pH * 100
+  uint16_t	pH_max_x100;
+  uint16_t	EC_min_uS;	///<µS/cm
+  uint16_t	EC_max_uS;
+}plantTarget_t;
+/**
+ * \brief bits set in a measurement's out_of_range when a reading is outside the plant's target range.
+ */
+#define PLANT_PH_LOW		0x01
+#define PLANT_PH_HIGH		0x02
+#define PLANT_EC_LOW		0x04
+#define PLANT_EC_HIGH		0x08
+
+void ladybug_plants_init(void);
+plantTarget_t const *ladybug_plants_find_target(char const *type, size_t type_len, char const *stage, size_t stage_len);
+uint8_t ladybug_plants_out_of_range(plantTarget_t const *p_target, uint16_t pH_x100, uint16_t EC_uS);
+
+#endif /* INCLUDE_LADYBUG_PLANTS_H_ */
@@ -0,0 +1,98 @@
+/**
+ * \file		Ladybug_Sensors.h
+ * \brief	The registry of the sensors on the board.  Each sensor type declares how many AINs a reading has, how a reading is
+ * 		taken, and how the sensor is calibrated.  The measurement and calibration records and the BLE characteristics are sized
+ * 		from the registry.
+ * \details	A board with other sensors defines LADYBUG_SENSORS (e.g.: in the build flags or a board header) before this file is
+ * 		included.  Each entry is SENSOR(type, VGND AIN, first AIN, second AIN).  e.g. a board with a second pH probe and an ORP probe:
+ * \code
+ * #define LADYBUG_SENSORS(SENSOR)			\
+ *   SENSOR(sensorPH,  pH_VGND, pH_AIN, 0)		\
+ *   SENSOR(sensorEC,  EC_VGND, EC_VIN, EC_VOUT)	\
+ *   SENSOR(sensorPH,  pH_VGND, 1,      0)		\
+ *   SENSOR(sensorORP, pH_VGND, 0,      0)
+ * \endcode
+ * 		The sensor calibrations record and the sensors and sensor calibrations characteristics are sized from the registry.  How many
+ * 		sensors there can be is set by the flash the calibrations are kept in (checked in ladybug_flash_init()) - 31 with the
+ * 		registry's sensorCalibration_t.
+ * \note	The registry only partly replaces the pH and EC channels.  The first pH and the first EC sensor are still the ones in
+ * 		measurements_t, calibrationValues_t and their characteristics, which keep their layout: the apps already read them, and each
+ * 		still fits in a notify.  The other sensors are only in the sensors and sensor calibrations characteristics.
+ * \note	There is one EC rectifier (and FET) per board, so an EC sensor must use EC_VIN and EC_VOUT.
+ * \sa		Ladybug_Sensors.c
+ */
+
+#ifndef INCLUDE_LADYBUG_SENSORS_H_
+#define INCLUDE_LADYBUG_SENSORS_H_
+#include <stdint.h>
+#include "Ladybug_ADC.h"
+
+typedef enum {
+  sensorPH,	///<pH * 100.  Calibrated at two points.
+  sensorEC,	///<µS/cm from EC_VOUT/EC_VIN.  Calibrated at two points.
+  sensorORP,	///<mV.  Calibrated at one point (the offset from a reference solution).
+  sensorDO,	///<% saturation * 10.  Calibrated at zero and at air saturation.
+  NUM_SENSOR_TYPES
+}sensor_type_t;
+
+#ifndef LADYBUG_SENSORS
+#define LADYBUG_SENSORS(SENSOR)			\
+  SENSOR(sensorPH, pH_VGND, pH_AIN, 0)		\
+  SENSOR(sensorEC, EC_VGND, EC_VIN, EC_VOUT)
+#endif
+/**
+ * \brief The stages each AIN reading goes through.  Each entry is STAGE(stage, argument).  The stages are:
+ * - acquire(n)	take n ADC samples (up to PIPELINE_MAX_SAMPLES).  The EC AINs are discharged before each sample.
+ * - median(w)	replace the samples with the median of each run of w samples (w odd).  n - w + 1 samples are left.  Knocks out spikes.
+ * - spread(0)	the highest sample less the lowest.  Tells how steady the reading is.
+ * - mean(0)	the reading is the mean of the samples.
+ * 		A board can define its own, e.g.: STAGE(acquire, 16) STAGE(median, 5) STAGE(spread, 0) STAGE(mean, 0)
+ */
+#ifndef LADYBUG_AIN_PIPELINE
+#define LADYBUG_AIN_PIPELINE(STAGE)	\
+  STAGE(acquire, 4)			\
+  STAGE(spread, 0)			\
+  STAGE(mean, 0)
+#endif
+#define PIPELINE_MAX_SAMPLES	16
+#define SENSOR_COUNT(type, VGND, AIN0, AIN1)	+ 1
+#define NUM_SENSORS		(0 LADYBUG_SENSORS(SENSOR_COUNT))
+#define SENSOR_MAX_AINS		2
+#define SENSOR_MAX_CALIBRATION_POINTS	2
+#define SENSOR_NOT_FOUND	0xFF
+/**
+ * \brief The bits of a sensor reading's quality.  A reading with a RAILED, VGND, or OPEN bit is unusable.
+ */
+#define SENSOR_QUALITY_RAILED	0x01	///<an AIN is at (or near) ground or the supply.
+#define SENSOR_QUALITY_VGND	0x02	///<the virtual ground is at a rail or isn't steady.
+#define SENSOR_QUALITY_NOISY	0x04	///<the AIN samples were spread out.
+#define SENSOR_QUALITY_OPEN	0x08	///<the probe is out of the water or unplugged.
+#define SENSOR_QUALITY_UNUSABLE	(SENSOR_QUALITY_RAILED | SENSOR_QUALITY_VGND | SENSOR_QUALITY_OPEN)
+
+typedef struct {
+  int16_t	mV[SENSOR_MAX_AINS];	///<each AIN less the VGND.  Unused AINs are 0.
+  uint8_t	quality;		///<SENSOR_QUALITY_... bits
+}sensorReading_t;
+/**
+ * \brief A sensor's calibration.  response is what the sensor read in the calibration solution - mV, or EC_VOUT/EC_VIN in Q12 for EC.
+ * reference is the solution's value in the sensor's units.
+ */
+typedef struct {
+  uint8_t	type;		///<sensor_type_t, so a calibration isn't used for a different sensor after the registry changes
+  uint8_t	num_points;	///<how many of the points have been calibrated.  The points are calibrated in order.
+  int16_t	reference[SENSOR_MAX_CALIBRATION_POINTS];
+  uint16_t	unused;		///<so the structure is word (4 bytes) aligned
+  int32_t	response[SENSOR_MAX_CALIBRATION_POINTS];
+}sensorCalibration_t;
+
+void ladybug_sensors_init(void);
+uint8_t ladybug_sensors_find(sensor_type_t type);
+sensor_type_t ladybug_sensor_type(uint8_t sensor);
+uint8_t ladybug_sensor_num_AINs(uint8_t sensor);
+uint8_t ladybug_sensor_num_calibration_points(uint8_t sensor);
+void ladybug_sensor_acquire(uint8_t sensor, sensorReading_t *p_reading);
+int32_t ladybug_sensor_response(uint8_t sensor, sensorReading_t const *p_reading);
+uint16_t ladybug_sensors_EC_ratio(int16_t const *p_EC);
+int32_t ladybug_sensor_value(sensorCalibration_t const *p_calibration, int32_t response);
+
+#endif /* INCLUDE_LADYBUG_SENSORS_H_ */
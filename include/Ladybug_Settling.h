@@ -0,0 +1,36 @@
+/**
+ * \file		Ladybug_Settling.h
+ * \brief	Tells when a probe's reading has settled after the probe goes into a solution.
+ * \details	A reading is stable when the least squares slope of the last SETTLING_WINDOW readings is small enough.  While it is settling,
+ * 		the time to stable is estimated from how fast the slope is shrinking.
+ * \sa		Ladybug_Settling.c
+ */
+
+#ifndef INCLUDE_LADYBUG_SETTLING_H_
+#define INCLUDE_LADYBUG_SETTLING_H_
+#include <stdint.h>
+
+#define SETTLING_WINDOW		8	///<must be even.  The slope of each half is used for the time to stable estimate.
+#define SETTLING_UNKNOWN_TIME	UINT16_MAX
+
+typedef enum {
+  settlingIdle,
+  settlingInProgress,
+  settlingStable,
+  settlingTimedOut	///<the reading didn't settle.  Nothing was calibrated.
+}settling_state_t;
+/**
+ * \brief the most recent readings.
+ */
+typedef struct {
+  int16_t	readings[SETTLING_WINDOW];
+  uint8_t	count;
+  uint8_t	newest;
+}settling_t;
+
+void ladybug_settling_reset(settling_t *p_settling);
+void ladybug_settling_add(settling_t *p_settling, int16_t reading);
+settling_state_t ladybug_settling_check(settling_t const *p_settling, uint16_t period_s, int16_t stable_slope_per_min,
+					int16_t *p_slope_per_min, uint16_t *p_time_to_stable_s);
+
+#endif /* INCLUDE_LADYBUG_SETTLING_H_ */
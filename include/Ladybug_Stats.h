@@ -0,0 +1,37 @@
+/**
+ * \file		Ladybug_Stats.h
+ * \brief	Streaming (Welford) statistics over the mV readings taken between two reports.
+ * \details	Each channel uses a fixed amount of memory no matter how many readings go into it.  All the math is integer math since
+ * 		the nRF51822's Cortex-M0 has no FPU.
+ * \sa		Ladybug_Stats.c
+ */
+
+#ifndef INCLUDE_LADYBUG_STATS_H_
+#define INCLUDE_LADYBUG_STATS_H_
+#include <stdint.h>
+/**
+ * \brief The running state of one channel.  The mean is kept in Q8 (mV * 256) and the sum of squared differences from the mean
+ * (M2) in Q16 (mV^2 * 65536) so rounding doesn't build up over a long window.
+ */
+typedef struct {
+  uint32_t	count;
+  int32_t	mean_q8;
+  uint64_t	m2_q16;
+  int16_t	min;
+  int16_t	max;
+}welford_t;
+/**
+ * \brief What is reported for a channel.  All values are in mV.
+ */
+typedef struct {
+  int16_t	min;
+  int16_t	max;
+  int16_t	mean;
+  uint16_t	std_dev;   ///<sample standard deviation.  0 if there are less than two readings.
+}channelStatistics_t;
+
+void ladybug_stats_reset(welford_t *p_welford);
+void ladybug_stats_add(welford_t *p_welford, int16_t reading_mV);
+void ladybug_stats_get(welford_t const *p_welford, channelStatistics_t *p_statistics);
+
+#endif /* INCLUDE_LADYBUG_STATS_H_ */
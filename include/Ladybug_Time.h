@@ -0,0 +1,17 @@
+/**
+ * \file		Ladybug_Time.h
+ * \brief	A seconds clock for time stamping things the Ladybug stores (like calibrations).
+ * \details	The Ladybug has no battery backed clock.  The clock counts seconds from when the Ladybug started until the client sets
+ * 		it (e.g.: to seconds since 1970).
+ * \sa		Ladybug_Time.c
+ */
+
+#ifndef INCLUDE_LADYBUG_TIME_H_
+#define INCLUDE_LADYBUG_TIME_H_
+#include <stdint.h>
+
+void ladybug_time_init(void);
+uint32_t ladybug_time_now(void);
+void ladybug_time_set(uint32_t seconds);
+
+#endif /* INCLUDE_LADYBUG_TIME_H_ */
@@ -12,4 +12,11 @@
 #define		LADYBUG_ERROR_NULL_POINTER			103 ///<A null pointer was passed into a function most likely to have it stuffed with a value.
 #define		LADYBUG_ERROR_INVALID_COMMAND			104 ///<A function was called passing in a command that was invalid for that function.
 #define		LADYBUG_ERROR_FLASH_ACTION_NOT_COMPLETED		105 ///<A call was made to a flash function in pstorage, but it did not finish before a timer went off.
+#define		LADYBUG_ERROR_PLANT_TABLE			106 ///<A plant in the plant target table is not in the slot its key hashes to.
+#define		LADYBUG_ERROR_SENSOR_REGISTRY			107 ///<The sensor registry (LADYBUG_SENSORS) has a sensor the board can't read, or too many sensors.
+#define		LADYBUG_ERROR_FLASH_QUEUE_FULL			108 ///<A flash read or write was asked for while FLASH_QUEUE_DEPTH requests were waiting.
+#define		LADYBUG_ERROR_FLASH_WAIT_IN_INTERRUPT		109 ///<ladybug_flash_wait() was called from an interrupt, where the flash request can't finish.
+#define		LADYBUG_ERROR_FLASH_NOT_CACHED			110 ///<A record was marked dirty before its RAM copy was registered with ladybug_flash_cache_record().
+#define		LADYBUG_ERROR_FLASH_LEGACY_RECORD		111 ///<A read record has no good version in the flash log.  Its bytes were read from the block it was kept in before the log, which has no CRC.
+#define		LADYBUG_ERROR_FLASH_LAYOUT			112 ///<The pages registered with pstorage don't start on a flash page, a flash page isn't FLASH_PAGE_SIZE (pstorage would erase them through its swap page), or they don't end on the page the records were kept in before the log.
 //#endif
@@ -8,12 +8,33 @@
 #ifndef INCLUDE_LADYBUG_FLASH_H_
 #define INCLUDE_LADYBUG_FLASH_H_
 #include <stdint.h>
+#include <stdbool.h>
 #include "pstorage.h"
 /**
  * \brief The amount of bytes assigned to a Flash block handle.  32 is used because it is the bigger of the size of bytes
- * 	  needed between plant_info_data_t,pH_data_t, and m_device_name
+ * 	  needed between plant_info_data_t,pH_data_t, and m_device_name.  Records bigger than a block (like the EC calibration table)
+ * 	  use consecutive blocks.
  */
 #define BLOCK_SIZE		32
+/**
+ * \brief The records are kept in a log over FLASH_LOG_SEGMENTS segments of the nRF51822's flash (see Ladybug_Flash.c).  A segment is
+ * FLASH_LOG_SEGMENT_PAGES pages so there is room to append after the newest version of every record is written to it.  The page after
+ * them is where the records were kept before the log.  It is only read.
+ * 		Every pstorage block is a whole page, so a clear is always of one whole page and pstorage erases it in place.  Clearing a
+ * 		32 byte block that shares its page with other blocks takes pstorage through its swap page instead: erase the swap page,
+ * 		copy the page to it, erase the page and write back the blocks before and after the one cleared.
+ * \note pstorage hands out pages from PSTORAGE_DATA_START_ADDR up to the page below its swap page.  The records were kept in that top
+ * 	 page, so include/pstorage_platform.h's PSTORAGE_NUM_OF_PAGES must be exactly 1 + FLASH_LOG_PAGES for the registration to fit and
+ * 	 to end on it.
+ */
+#define FLASH_PAGE_SIZE		1024
+#define FLASH_LOG_SEGMENTS	3
+#define FLASH_LOG_SEGMENT_PAGES	2
+#define FLASH_LOG_PAGES		(FLASH_LOG_SEGMENTS * FLASH_LOG_SEGMENT_PAGES)
+#if PSTORAGE_NUM_OF_PAGES != 1 + FLASH_LOG_PAGES
+#error "pstorage_platform.h's PSTORAGE_NUM_OF_PAGES must be 1 + FLASH_LOG_PAGES"
+#endif
+#define FLASH_MAX_RECORD_VERSION	15	///<a record's version shares a byte of the log entry with the record
 /**
  * \brief This enum lets the function know which data structure to read from or write to flash
  * */
@@ -21,11 +42,49 @@ typedef enum {
   hydroValues,
   plantInfo,
   deviceName,
-  calibrationValues
+  calibrationValues,
+  samplingConfig,
+  ECcalibrationTable,
+  calibrationHistory,
+  probeHealthTrend,
+  alarmConfig,
+  sensorCalibrations
 }flash_rw_t;
+/**
+ * \brief Reads and writes are queued and done one after the other.  Each request gets an id that comes back with its callback.
+ */
+typedef uint8_t flash_request_id_t;
+#define FLASH_NO_REQUEST	0	///<returned when a request couldn't be queued
+#define FLASH_QUEUE_DEPTH	12	///<at most this many requests wait at once.  Room for a write of each record and a few reads.
+typedef void (*flash_done_t)(flash_request_id_t request, uint32_t err_code);
+/**
+ * \brief The write-back cache waits for the changes to stop this long before writing the dirty records.  A calibration marks the calibration
+ * values, the history, and the probe health trend, so they go out together.
+ */
+#define FLASH_CACHE_DEBOUNCE_MS		2000
+#define FLASH_CACHE_MAX_DELAY_MS	10000	///<a steady stream of changes doesn't hold off the write longer than this.
+/**
+ * \brief Counts since start up of how the write-back cache and the log are doing.  Before the cache, every change was an erase.
+ */
+typedef struct {
+  uint16_t	marks;		///<changes to records
+  uint16_t	flushes;	///<times the dirty records were written
+  uint16_t	erases;		///<pages erased to compact the log
+  uint16_t	stores;		///<pstorage_store() calls (at most BLOCK_SIZE bytes each)
+  uint16_t	log_page_erases[FLASH_LOG_PAGES];	///<erases of each log page.  The wear is even if they are the same.
+  uint16_t	erases_saved;	///<marks - erases
+  uint16_t	unchanged;	///<records not written because they were the same as in flash
+  uint16_t	in_place;	///<records programmed over the version in flash because the change only cleared bits of one word
+}flashCacheStats_t;
 void ladybug_flash_init(void);
-void ladybug_flash_read(flash_rw_t data_to_read,uint8_t *p_bytes_to_read,void(*did_flash_action)(uint32_t err_code));
-void ladybug_flash_write(flash_rw_t what_data_to_write, uint8_t *p_bytes_to_write,pstorage_size_t num_bytes_to_write,void(*did_flash_write)(uint32_t err_code));
+flash_request_id_t ladybug_flash_read(flash_rw_t data_to_read,uint8_t *p_bytes_to_read,pstorage_size_t num_bytes_to_read,flash_done_t did_flash_action);
+flash_request_id_t ladybug_flash_write(flash_rw_t what_data_to_write, uint8_t *p_bytes_to_write,pstorage_size_t num_bytes_to_write,flash_done_t did_flash_write);
+uint32_t ladybug_flash_wait(flash_request_id_t request);
+uint32_t ladybug_flash_map(flash_rw_t record, uint8_t const **p_bytes, pstorage_size_t *p_num_bytes, uint8_t *p_version);
+void ladybug_flash_cache_record(flash_rw_t record, uint8_t *p_bytes, pstorage_size_t num_bytes);
+void ladybug_flash_mark_dirty(flash_rw_t record);
+void ladybug_flash_cache_flush(void);
+void ladybug_flash_cache_stats(flashCacheStats_t *p_stats);
 void ladybug_flash_handler(pstorage_handle_t  * handle,
 				uint8_t              op_code,
 				uint32_t             result,
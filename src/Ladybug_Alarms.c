@@ -0,0 +1,112 @@
+/**
+ * \file		Ladybug_Alarms.c
+ * \brief	Evaluates the pH and EC alarms each time a measurement is taken.
+ * \sa		Ladybug_Alarms.h
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include "Ladybug_Alarms.h"
+#include "SEGGER_RTT.h"
+
+typedef enum {
+  pHLow,
+  pHHigh,
+  ECLow,
+  ECHigh,
+  NUM_ALARMS
+}alarm_t;
+
+static uint8_t		m_alarms;			///<the alarms that are raised
+static uint8_t		m_beyond;			///<the alarms whose reading is beyond the threshold but hasn't been for dwell_s yet
+static uint32_t		m_beyond_since_s[NUM_ALARMS];	///<when the reading went beyond the threshold
+
+/**
+ * \callgraph
+ * \brief clear the alarms.  Called when the thresholds or the plant change.
+ */
+void ladybug_alarms_reset(void) {
+  m_alarms = 0;
+  m_beyond = 0;
+}
+/**
+ * \brief move one alarm along.
+ * @param alarm		which alarm
+ * @param beyond	the reading is beyond the threshold
+ * @param back_inside	the reading is inside the threshold by at least the hysteresis
+ */
+static void evaluate_alarm(alarm_t alarm, bool beyond, bool back_inside, uint16_t dwell_s, uint32_t now_s) {
+  uint8_t bit = 1 << alarm;
+  if (m_alarms & bit) {
+      if (back_inside) {
+	  m_alarms &= ~bit;
+	  SEGGER_RTT_printf(0,"...alarm %d cleared\n",alarm);
+      }
+      return;
+  }
+  if (!beyond) {
+      m_beyond &= ~bit;
+      return;
+  }
+  if (!(m_beyond & bit)) {
+      m_beyond |= bit;
+      m_beyond_since_s[alarm] = now_s;
+  }
+  if (now_s - m_beyond_since_s[alarm] >= dwell_s) {
+      m_beyond &= ~bit;
+      m_alarms |= bit;
+      SEGGER_RTT_printf(0,"...alarm %d raised\n",alarm);
+  }
+}
+/**
+ * \brief a threshold of 0 in the configuration uses the plant's target.
+ */
+static uint16_t threshold(uint16_t configured, uint16_t target, plantTarget_t const *p_target) {
+  return (configured != 0 || p_target == NULL) ? configured : target;
+}
+/**
+ * \callgraph
+ * \brief the thresholds in use - the configured ones, with the plant's targets filling in those configured as 0.
+ * @param p_config	the alarm configuration
+ * @param p_target	the targets of the plant in plantInfo.  NULL if the plant isn't known.
+ * @param p_thresholds	the thresholds.  A threshold of 0 is off.
+ */
+void ladybug_alarms_thresholds(alarmConfig_t const *p_config, plantTarget_t const *p_target, plantTarget_t *p_thresholds) {
+  plantTarget_t const no_target = {0};
+  plantTarget_t const *p = (p_target == NULL) ? &no_target : p_target;
+  p_thresholds->pH_min_x100 = threshold(p_config->pH_low_x100,p->pH_min_x100,p_target);
+  p_thresholds->pH_max_x100 = threshold(p_config->pH_high_x100,p->pH_max_x100,p_target);
+  p_thresholds->EC_min_uS = threshold(p_config->EC_low_uS,p->EC_min_uS,p_target);
+  p_thresholds->EC_max_uS = threshold(p_config->EC_high_uS,p->EC_max_uS,p_target);
+}
+/**
+ * \callgraph
+ * \brief check the readings against the thresholds.
+ * @param p_config	the thresholds, hysteresis, and dwell time
+ * @param p_target	the targets of the plant in plantInfo.  NULL if the plant isn't known.
+ * @param pH_x100	0 if the pH isn't known.  The pH alarms are left as they are.
+ * @param EC_uS		0 if the EC isn't known.  The EC alarms are left as they are.
+ * @param now_s		ladybug_time_now()
+ * @return		the ALARM_PH_LOW, ALARM_PH_HIGH, ALARM_EC_LOW, and ALARM_EC_HIGH alarms that are raised.
+ */
+uint8_t ladybug_alarms_evaluate(alarmConfig_t const *p_config, plantTarget_t const *p_target, uint16_t pH_x100, uint16_t EC_uS, uint32_t now_s) {
+  plantTarget_t thresholds;
+  ladybug_alarms_thresholds(p_config,p_target,&thresholds);
+  uint16_t pH_low = thresholds.pH_min_x100;
+  uint16_t pH_high = thresholds.pH_max_x100;
+  uint16_t EC_low = thresholds.EC_min_uS;
+  uint16_t EC_high = thresholds.EC_max_uS;
+  //an alarm whose threshold is 0 is off
+  if (pH_x100 != 0) {
+      evaluate_alarm(pHLow,pH_low != 0 && pH_x100 < pH_low,pH_low == 0 || pH_x100 >= pH_low + p_config->pH_hysteresis_x100,
+		     p_config->dwell_s,now_s);
+      evaluate_alarm(pHHigh,pH_high != 0 && pH_x100 > pH_high,pH_high == 0 || pH_x100 + p_config->pH_hysteresis_x100 <= pH_high,
+		     p_config->dwell_s,now_s);
+  }
+  if (EC_uS != 0) {
+      evaluate_alarm(ECLow,EC_low != 0 && EC_uS < EC_low,EC_low == 0 || EC_uS >= EC_low + p_config->EC_hysteresis_uS,
+		     p_config->dwell_s,now_s);
+      evaluate_alarm(ECHigh,EC_high != 0 && EC_uS > EC_high,EC_high == 0 || (uint32_t)EC_uS + p_config->EC_hysteresis_uS <= EC_high,
+		     p_config->dwell_s,now_s);
+  }
+  return m_alarms;
+}
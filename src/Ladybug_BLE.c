@@ -8,20 +8,26 @@
 #define	DEBUG	///< Used in app_error.h to give line / function name input.
 #include "Ladybug_BLE.h"
 #include <string.h>
+#include <stddef.h>
 #include "nordic_common.h"
 #include "ble_srv_common.h"
 #include "ble_advertising.h"
 #include "app_util.h"
 #include "Ladybug_ADC.h"
 #include "Ladybug_Hydro.h"
+#include "Ladybug_Time.h"
 #include "app_error.h"
 #include "SEGGER_RTT.h"
 
 extern ADC_interface adc;
 
-#define	battery_level_AIN	2
-
 extern void display_bytes(uint8_t *dest_bytes,int num_bytes); ///<code is in main.c
+/**
+ * \brief The length of the control writes that carry a config: the command and then the config's UInt16s (not the unused padding).
+ */
+#define SAMPLING_CONFIG_WRITE_LEN	(1 + offsetof(samplingConfig_t,unused))
+#define ALARM_CONFIG_WRITE_LEN		(1 + offsetof(alarmConfig_t,unused))
+#define SET_TIME_WRITE_LEN		(1 + sizeof(uint32_t))	///<the command and the seconds since 1970
 
 /**@brief Function for handling the Connect event.
  *\callgraph
@@ -42,6 +48,44 @@ static void on_disconnect(ble_lbl_t * p_lbl, ble_evt_t * p_ble_evt)
   UNUSED_PARAMETER(p_ble_evt);
   p_lbl->conn_handle = BLE_CONN_HANDLE_INVALID;
 }
+static ble_lbl_t *			m_p_adv_lbl;
+static uint8_t				m_adv_alarms;	///<the alarms in the advertising data
+static ble_uuid_t			m_adv_uuids[1];
+static ble_advdata_manuf_data_t		m_adv_manuf_data;
+/**
+ * \callgraph
+ * \brief build the advertising and scan response data.  The uuid and manufacturer data are static because the advertising module
+ * keeps pointers to them.
+ */
+void ladybug_BLE_advertising_data(ble_lbl_t * p_lbl, ble_advdata_t * p_advdata, ble_advdata_t * p_scanrsp) {
+  m_p_adv_lbl = p_lbl;
+  m_adv_uuids[0].uuid = LBL_UUID_SERVICE;
+  m_adv_uuids[0].type = p_lbl->uuid_type;
+  m_adv_manuf_data.company_identifier = LBL_ADV_COMPANY_IDENTIFIER;
+  m_adv_manuf_data.data.size = sizeof(m_adv_alarms);
+  m_adv_manuf_data.data.p_data = &m_adv_alarms;
+  memset(p_advdata, 0, sizeof(ble_advdata_t));
+  //a name that doesn't fit with the flags and alarms is cut short
+  p_advdata->name_type               = BLE_ADVDATA_SHORT_NAME;
+  p_advdata->short_name_len          = BLE_GAP_ADV_MAX_SIZE - 3 - 2 - (2 + sizeof(uint16_t) + sizeof(m_adv_alarms));
+  p_advdata->include_appearance      = false;
+  p_advdata->flags                   = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
+  p_advdata->p_manuf_specific_data   = &m_adv_manuf_data;
+  memset(p_scanrsp, 0, sizeof(ble_advdata_t));
+  p_scanrsp->uuids_complete.uuid_cnt = sizeof(m_adv_uuids)/sizeof(m_adv_uuids[0]);
+  p_scanrsp->uuids_complete.p_uuids  = m_adv_uuids;
+}
+/**
+ * \callgraph
+ * \brief Give the SoftDevice the advertising data again after the name or the alarms changed.
+ */
+static void set_advertising_data(void) {
+  ble_advdata_t advdata;
+  ble_advdata_t scanrsp;
+  ladybug_BLE_advertising_data(m_p_adv_lbl,&advdata,&scanrsp);
+  uint32_t err_code = ble_advdata_set(&advdata, &scanrsp);
+  APP_ERROR_CHECK(err_code);
+}
 /**
  * \callgraph
  * \brief changes the Ladybug's device name.  What changes on the iOS side is the kCBAdvDataLocalName value within the
@@ -73,37 +117,92 @@ static void update_device_name(char *p_device_name,uint8_t len){
                                         len-1);
   APP_ERROR_CHECK(err_code);
   //let BLE GAP advertising gunk know of the change in the device name.
-  //To do this, the advdata structure needs to be built up
-  ble_advdata_t advdata;
-  ble_uuid_t adv_uuids[] = {{LBL_UUID_SERVICE,BLE_UUID_TYPE_BLE}};
-  memset(&advdata, 0, sizeof(advdata));
-
-  advdata.name_type               = BLE_ADVDATA_FULL_NAME;
-  advdata.include_appearance      = true;
-  advdata.flags                   = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
-  advdata.uuids_complete.uuid_cnt = sizeof(adv_uuids) / sizeof(adv_uuids[0]);
-  advdata.uuids_complete.p_uuids  = adv_uuids;
-  //now that the advdata structure is ready, call ble_advdata_set()
-  err_code = ble_advdata_set(&advdata, NULL);
+  set_advertising_data();
 //  SEGGER_RTT_WriteString(0,"--->>>advertising_start\n");
 //  err_code =   ble_advertising_start(BLE_ADV_MODE_FAST);
 //  APP_ERROR_CHECK(err_code);
   //the device name is stored in flash to maintain the name across restarts of the device.
   ladybug_write_device_name(p_device_name,len);
 }
-static void update_measurement_characteristic(ble_lbl_t * p_lbl) {
+/**
+ * \callgraph
+ * \brief Notify the client of the measurements.
+ * @return true if the notification went out.  It won't if the client isn't connected or hasn't turned on notifications.
+ */
+static bool update_measurement_characteristic(ble_lbl_t * p_lbl, measurements_t *p_measurements) {
   SEGGER_RTT_WriteString(0,"---> IN update_measurement_characteristic\n");
   ble_gatts_hvx_params_t params;
   uint16_t len = sizeof(measurements_t);
+  if (p_lbl->conn_handle == BLE_CONN_HANDLE_INVALID) {
+      return false;
+  }
   memset(&params, 0, sizeof(params));
   params.type = BLE_GATT_HVX_NOTIFICATION;
   params.handle = p_lbl->measurement_char_handles.value_handle;
-  measurements_t *p_measurements;
-  ladybug_get_measurements(&p_measurements);
   params.p_data = (uint8_t *)p_measurements;
   params.p_len = &len;
   //The characteristic is updated and then a didUpdate is sent to the client.  NOTE: max 20 bytes can be returned in a NOTIFY
   uint32_t err_code =  sd_ble_gatts_hvx(p_lbl->conn_handle, &params);
+  //The client not having subscribed to notifications (yet) is not an error.
+  if (err_code == NRF_ERROR_INVALID_STATE || err_code == BLE_ERROR_GATTS_SYS_ATTR_MISSING ||
+      err_code == BLE_ERROR_NO_TX_BUFFERS || err_code == BLE_ERROR_INVALID_CONN_HANDLE) {
+      return false;
+  }
+  APP_ERROR_CHECK(err_code);
+  return true;
+}
+/**
+ * \callgraph
+ * \brief Take a measurement and update the measurement characteristic.  A measurement the client asked for is always notified.  A
+ * scheduled measurement is only notified when pH or EC has moved by more than the configured delta since the last notification.  Otherwise
+ * the characteristic's value is quietly updated so a read still gets the latest measurement.
+ * \note called from the main loop.
+ * @param p_lbl			LBL Service structure.
+ * @param requested_by_client	true if the client sent updatePHandEC.
+ */
+void ladybug_BLE_update_measurement(ble_lbl_t * p_lbl, bool requested_by_client) {
+  SEGGER_RTT_WriteString(0,"---> IN ladybug_BLE_update_measurement\n");
+  measurements_t measurements;
+  ladybug_take_measurements();
+  ladybug_get_measurements(&measurements);
+  uint8_t alarms = ladybug_get_alarms();
+  if (alarms != m_adv_alarms && m_p_adv_lbl != NULL) {
+      SEGGER_RTT_printf(0,"...alarms changed to 0x%x\n",alarms);
+      m_adv_alarms = alarms;
+      set_advertising_data();
+  }
+  ble_gatts_value_t gatts_value;
+  uint32_t err_code;
+  sensorMeasurements_t sensorMeasurements;
+  ladybug_get_sensor_measurements(&sensorMeasurements);
+  memset(&gatts_value, 0, sizeof(gatts_value));
+  gatts_value.len     = sizeof(sensorMeasurements_t);
+  gatts_value.offset  = 0;
+  gatts_value.p_value = (uint8_t *)&sensorMeasurements;
+  err_code = sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, p_lbl->sensors_char_handles.value_handle, &gatts_value);
+  APP_ERROR_CHECK(err_code);
+  //the forecast's readings must be a sampling period apart, so a measurement the client asked for is left out.
+  if (!requested_by_client) {
+      forecastReport_t forecast;
+      ladybug_update_forecast(&forecast);
+      memset(&gatts_value, 0, sizeof(gatts_value));
+      gatts_value.len     = sizeof(forecastReport_t);
+      gatts_value.offset  = 0;
+      gatts_value.p_value = (uint8_t *)&forecast;
+      err_code = sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, p_lbl->forecast_char_handles.value_handle, &gatts_value);
+      APP_ERROR_CHECK(err_code);
+  }
+  if (requested_by_client || ladybug_measurements_moved_beyond_delta(&measurements)) {
+      if (update_measurement_characteristic(p_lbl, &measurements)) {
+	  ladybug_measurements_were_notified(&measurements);
+	  return;
+      }
+  }
+  memset(&gatts_value, 0, sizeof(gatts_value));
+  gatts_value.len     = sizeof(measurements_t);
+  gatts_value.offset  = 0;
+  gatts_value.p_value = (uint8_t *)&measurements;
+  err_code = sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, p_lbl->measurement_char_handles.value_handle, &gatts_value);
   APP_ERROR_CHECK(err_code);
 }
 static void update_battery_level_characteristic(ble_lbl_t * p_lbl) {
@@ -121,6 +220,41 @@ static void update_battery_level_characteristic(ble_lbl_t * p_lbl) {
   uint32_t err_code =  sd_ble_gatts_hvx(p_lbl->conn_handle, &params);
   APP_ERROR_CHECK(err_code);
 }
+/**
+ * \callgraph
+ * \brief Notify the client of a characteristic's new value.  If the client isn't connected or hasn't turned on notifications, the value is
+ * set so the client gets it on its next read.
+ * @return true if the notification went out.
+ */
+static bool notify_or_set(ble_lbl_t * p_lbl, uint16_t value_handle, uint8_t *p_data, uint16_t len) {
+  uint32_t err_code = BLE_ERROR_INVALID_CONN_HANDLE;
+  if (p_lbl->conn_handle != BLE_CONN_HANDLE_INVALID) {
+      ble_gatts_hvx_params_t params;
+      memset(&params, 0, sizeof(params));
+      params.type = BLE_GATT_HVX_NOTIFICATION;
+      params.handle = value_handle;
+      params.p_data = p_data;
+      params.p_len = &len;
+      //The characteristic is updated and then a didUpdate is sent to the client.  NOTE: max 20 bytes can be returned in a NOTIFY
+      err_code = sd_ble_gatts_hvx(p_lbl->conn_handle, &params);
+  }
+  if (err_code == NRF_SUCCESS) {
+      return true;
+  }
+  if (err_code != NRF_ERROR_INVALID_STATE && err_code != BLE_ERROR_GATTS_SYS_ATTR_MISSING &&
+      err_code != BLE_ERROR_NO_TX_BUFFERS && err_code != BLE_ERROR_INVALID_CONN_HANDLE) {
+      APP_ERROR_HANDLER(err_code);
+      return false;
+  }
+  ble_gatts_value_t gatts_value;
+  memset(&gatts_value, 0, sizeof(gatts_value));
+  gatts_value.len     = len;
+  gatts_value.offset  = 0;
+  gatts_value.p_value = p_data;
+  err_code = sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, value_handle, &gatts_value);
+  APP_ERROR_CHECK(err_code);
+  return false;
+}
 /**
  * \brief This function will update the calibration characteristic with the calibration data currently stored
  * in ladybug's calibrationValues_t structure.  It is called after this structure has been filled with updated
@@ -130,21 +264,78 @@ static void update_battery_level_characteristic(ble_lbl_t * p_lbl) {
  */
 static void update_calibration_characteristic(ble_lbl_t * p_lbl){
   SEGGER_RTT_WriteString(0,"--> in update_calibration_characteristic\n");
-  ble_gatts_hvx_params_t params;
-  uint16_t len = sizeof(calibrationValues_t);
-  memset(&params, 0, sizeof(params));
-  params.type = BLE_GATT_HVX_NOTIFICATION;
-  params.handle = p_lbl->calibration_char_handles.value_handle;
   //get the location where the calibration data is stored
   calibrationValues_t *p_calibrationValues;
   ladybug_get_calibration_values_memory_location(&p_calibrationValues);
-  params.p_data = (uint8_t *)p_calibrationValues;
-  params.p_len = &len;
-  //The characteristic is updated and then a didUpdate is sent to the client.  NOTE: max 20 bytes can be returned in a NOTIFY
-  uint32_t err_code =  sd_ble_gatts_hvx(p_lbl->conn_handle, &params);
+  //a calibration that waited for the reading to settle is made from the main loop.  The client may have gone by then.
+  notify_or_set(p_lbl,p_lbl->calibration_char_handles.value_handle,(uint8_t *)p_calibrationValues,sizeof(calibrationValues_t));
+}
+/**
+ * \brief Put the statistics since the last report into the statistics characteristic and start a new window.  The statistics
+ * characteristic is bigger than the 20 bytes a notify can carry, so the client reads the characteristic after sending updateStatistics.
+ * @param p_lbl
+ */
+static void update_statistics_characteristic(ble_lbl_t * p_lbl){
+  SEGGER_RTT_WriteString(0,"--> in update_statistics_characteristic\n");
+  statistics_t statistics;
+  ladybug_report_statistics(&statistics);
+  ble_gatts_value_t gatts_value;
+  memset(&gatts_value, 0, sizeof(gatts_value));
+  gatts_value.len     = sizeof(statistics_t);
+  gatts_value.offset  = 0;
+  gatts_value.p_value = (uint8_t *)&statistics;
+  uint32_t err_code = sd_ble_gatts_value_set(p_lbl->conn_handle, p_lbl->statistics_char_handles.value_handle, &gatts_value);
+  APP_ERROR_CHECK(err_code);
+}
+/**
+ * \brief Put the EC calibration table into the EC calibration table characteristic.  Like the statistics, the table is bigger than a notify
+ * can carry so the client reads the characteristic after sending an add, remove, or list command.
+ * @param p_lbl
+ */
+static void update_EC_calibration_table_characteristic(ble_lbl_t * p_lbl){
+  SEGGER_RTT_WriteString(0,"--> in update_EC_calibration_table_characteristic\n");
+  ECcalibrationTable_t ECcalibrationTable;
+  ladybug_get_EC_calibration_table(&ECcalibrationTable);
+  ble_gatts_value_t gatts_value;
+  memset(&gatts_value, 0, sizeof(gatts_value));
+  gatts_value.len     = sizeof(ECcalibrationTable_t);
+  gatts_value.offset  = 0;
+  gatts_value.p_value = (uint8_t *)&ECcalibrationTable;
+  uint32_t err_code = sd_ble_gatts_value_set(p_lbl->conn_handle, p_lbl->EC_calibration_table_char_handles.value_handle, &gatts_value);
   APP_ERROR_CHECK(err_code);
 }
 
+/**
+ * \callgraph
+ * \brief Take the next step of a calibration.  While the calibration waits for the reading to settle, the client is told how the reading
+ * is doing after each step.  Once the calibration is made, the client is sent the new calibration.
+ * \note called from the main loop.
+ * @param p_lbl
+ */
+void ladybug_BLE_calibration_step(ble_lbl_t * p_lbl) {
+  settlingStatus_t status;
+  bool finished = ladybug_calibration_step(&status);
+  if (status.state != settlingIdle) {
+      notify_or_set(p_lbl,p_lbl->settling_char_handles.value_handle,(uint8_t *)&status,sizeof(settlingStatus_t));
+  }
+  if (!finished || status.state == settlingTimedOut) {
+      return;
+  }
+  switch (status.command) {
+    case calibratePH4:
+    case calibratepH7:
+    case calibratePH10:
+    case calibrateEC1:
+    case calibrateEC2:
+      update_calibration_characteristic(p_lbl);
+      break;
+    case addECcalibrationPoint:
+      update_EC_calibration_table_characteristic(p_lbl);
+      break;
+    default:
+      break;
+  }
+}
 /**
  * \callgraph
  * \brief function called when the client asks LBL to perform an action - like update the hydro readings or battery level check.
@@ -158,6 +349,10 @@ static void on_write(ble_lbl_t * p_lbl, ble_evt_t * p_ble_evt)
   ble_gatts_evt_write_t * p_evt_write = &p_ble_evt->evt.gatts_evt.params.write;
   SEGGER_RTT_printf(0,"...command integer value: %d\n",p_evt_write->data[0]);
   int calValue ;
+  if (p_evt_write->handle == p_lbl->plantInfo_char_handles.value_handle) {
+      SEGGER_RTT_WriteString(0,"...plant info written\n");
+      ladybug_update_plantInfo(p_evt_write->data,p_evt_write->len);
+  }
   if (p_evt_write->handle == p_lbl->control_char_handles.value_handle) {
       switch (p_evt_write->data[0]) {
 	case resetPHcalValues:
@@ -166,16 +361,17 @@ static void on_write(ble_lbl_t * p_lbl, ble_evt_t * p_ble_evt)
 	  update_calibration_characteristic(p_lbl);
 	  break;
 	  //ask the ladybug to read the probe's value.  The value is then written to flash
+	  //the probe's value is read in the main loop - right away, or once the reading has settled if the client sent a 1 after the command
+	  //(and solution value).  The calibration characteristic is updated when the calibration is made.
 	case calibratePH4:
 	case calibratepH7:
-	  ladybug_update_calibration_value(p_evt_write->data[0],0);  //the ECvalue is not needed so sending in a 0
-	  update_calibration_characteristic(p_lbl);
+	case calibratePH10:
+	  ladybug_request_calibration(p_evt_write->data[0],0,p_evt_write->len > 1 && p_evt_write->data[1] == 1);  //the ECvalue is not needed so sending in a 0
 	  break;
 	case calibrateEC1:
 	  SEGGER_RTT_WriteString(0,"...calibrate EC1\n");
 	  calValue = p_evt_write->data[2] << 8 | p_evt_write->data[1];
-	  ladybug_update_calibration_value(p_evt_write->data[0],calValue);
-	  update_calibration_characteristic(p_lbl);
+	  ladybug_request_calibration(p_evt_write->data[0],calValue,p_evt_write->len > 3 && p_evt_write->data[3] == 1);
 	  SEGGER_RTT_printf(0,"...EC1 calibration solution value: %d\n",	  calValue);
 	  break;
 	case calibrateEC2:
@@ -183,12 +379,23 @@ static void on_write(ble_lbl_t * p_lbl, ble_evt_t * p_ble_evt)
 	  //get the calibration solution value typed in by the user.   The units are µS/cm.  The data type is Int16
 	  calValue = p_evt_write->data[2] << 8 | p_evt_write->data[1];
 	  SEGGER_RTT_printf(0,"...EC2 calibration solution value: %d\n",calValue);
-	  ladybug_update_calibration_value(p_evt_write->data[0],calValue);
-	  update_calibration_characteristic(p_lbl);
+	  ladybug_request_calibration(p_evt_write->data[0],calValue,p_evt_write->len > 3 && p_evt_write->data[3] == 1);
+	  break;
+	case checkPHsettling:
+	case checkECsettling:
+	  SEGGER_RTT_WriteString(0,"...check settling\n");
+	  ladybug_request_calibration(p_evt_write->data[0],0,true);
 	  break;
 	case undoPH4:
 	case undoPH7:
 	  SEGGER_RTT_WriteString(0,"...undo either pH4, pH7\n");
+	  //a command without values asks the Ladybug to step back through its calibration history.
+	  if (p_evt_write->len == 1) {
+	      if (ladybug_undo_calibration(p_evt_write->data[0])) {
+		  update_calibration_characteristic(p_lbl);
+	      }
+	      break;
+	  }
 	  int16_t calValue = p_evt_write->data[1] | p_evt_write->data[2] << 8;
 	  SEGGER_RTT_printf(0,"pH calibration value: %d\n",calValue);
 	  ladybug_undo_pH_calibration(p_evt_write->data[0],calValue);
@@ -197,15 +404,72 @@ static void on_write(ble_lbl_t * p_lbl, ble_evt_t * p_ble_evt)
 	case undoEC1:
 	case undoEC2:
 	  SEGGER_RTT_WriteString(0,"...undo either EC1 (Vin and Vout), or EC2 (Vin and Vout)\n");
+	  if (p_evt_write->len == 1) {
+	      if (ladybug_undo_calibration(p_evt_write->data[0])) {
+		  update_calibration_characteristic(p_lbl);
+	      }
+	      break;
+	  }
 	  int16_t EC_Vin = p_evt_write->data[1] | p_evt_write->data[2] << 8;
 	  int16_t EC_Vout = p_evt_write->data[3] | p_evt_write->data[4] << 8;
 	  ladybug_undo_EC_calibration(p_evt_write->data[0], EC_Vin, EC_Vout);
 
 	  update_calibration_characteristic(p_lbl);
 	  break;
+	case redoPH4:
+	case redoPH7:
+	case redoEC1:
+	case redoEC2:
+	  SEGGER_RTT_WriteString(0,"...redo a calibration\n");
+	  if (ladybug_redo_calibration(p_evt_write->data[0])) {
+	      update_calibration_characteristic(p_lbl);
+	  }
+	  break;
+	case setTime:
+	  //seconds since 1970 (UTC) as a UInt32.  The calibration history is stamped with this time.
+	  if (p_evt_write->len != SET_TIME_WRITE_LEN){
+	      SEGGER_RTT_printf(0,"...time not set.  Expected %d bytes, got %d\n",SET_TIME_WRITE_LEN,p_evt_write->len);
+	      break;
+	  }
+	  ladybug_time_set(p_evt_write->data[1] | p_evt_write->data[2] << 8 | p_evt_write->data[3] << 16 | (uint32_t)p_evt_write->data[4] << 24);
+	  break;
+	case updateAlarmConfig:
+	  {
+	    //pH low, pH high (pH * 100), EC low, EC high (µS/cm), pH hysteresis (pH * 100), EC hysteresis (µS/cm), dwell (seconds).  All are UInt16.
+	    alarmConfig_t alarmConfig;
+	    uint16_t *p_values = &alarmConfig.pH_low_x100;
+	    if (p_evt_write->len != ALARM_CONFIG_WRITE_LEN){
+		SEGGER_RTT_printf(0,"...alarm config not changed.  Expected %d bytes, got %d\n",ALARM_CONFIG_WRITE_LEN,p_evt_write->len);
+		break;
+	    }
+	    memset(&alarmConfig,0,sizeof(alarmConfig));
+	    for (int i=0;i<7;i++) {
+		p_values[i] = p_evt_write->data[1+2*i] | p_evt_write->data[2+2*i] << 8;
+	    }
+	    ladybug_update_alarm_config(&alarmConfig);
+	  }
+	  break;
+	case calibrateSensor:
+	  //the sensor (index into the registry), the calibration point, the solution's value in the sensor's units (Int16), and a 1 to wait
+	  //for the reading to settle.
+	  if (p_evt_write->len < 5){
+	      SEGGER_RTT_printf(0,"...sensor calibration needs at least 5 bytes, got %d\n",p_evt_write->len);
+	      break;
+	  }
+	  ladybug_request_sensor_calibration(p_evt_write->data[1],p_evt_write->data[2],p_evt_write->data[3] | p_evt_write->data[4] << 8,
+					     p_evt_write->len > 5 && p_evt_write->data[5] == 1);
+	  break;
+	case resetSensorCalibration:
+	  if (p_evt_write->len < 2){
+	      SEGGER_RTT_WriteString(0,"...reset sensor calibration needs the sensor\n");
+	      break;
+	  }
+	  ladybug_reset_sensor_calibration(p_evt_write->data[1]);
+	  break;
 	case updatePHandEC:
 	  SEGGER_RTT_WriteString(0,"update pH and EC\n");
-	  update_measurement_characteristic(p_lbl);
+	  //the measurement is taken in the main loop so this event never interrupts a scheduled measurement that is using the ADC.
+	  ladybug_request_measurement();
 	  break;
 	case updateBatteryLevel:
 	  SEGGER_RTT_WriteString(0,"update battery level\n");
@@ -216,6 +480,45 @@ static void on_write(ble_lbl_t * p_lbl, ble_evt_t * p_ble_evt)
 	  display_bytes(&p_evt_write->data[1],p_evt_write->len);
 	  update_device_name(&p_evt_write->data[1],p_evt_write->len);
 	  break;
+	case updateStatistics:
+	  SEGGER_RTT_WriteString(0,"update statistics\n");
+	  update_statistics_characteristic(p_lbl);
+	  break;
+	case addECcalibrationPoint:
+	  //the calibration solution value typed in by the user.   The units are µS/cm.
+	  if (p_evt_write->len < 3){
+	      SEGGER_RTT_printf(0,"...add EC calibration point needs at least 3 bytes, got %d\n",p_evt_write->len);
+	      break;
+	  }
+	  calValue = p_evt_write->data[2] << 8 | p_evt_write->data[1];
+	  SEGGER_RTT_printf(0,"...add EC calibration point, solution value: %d\n",calValue);
+	  ladybug_request_calibration(p_evt_write->data[0],calValue,p_evt_write->len > 3 && p_evt_write->data[3] == 1);
+	  break;
+	case removeECcalibrationPoint:
+	  if (p_evt_write->len < 3){
+	      SEGGER_RTT_printf(0,"...remove EC calibration point needs 3 bytes, got %d\n",p_evt_write->len);
+	      break;
+	  }
+	  calValue = p_evt_write->data[2] << 8 | p_evt_write->data[1];
+	  SEGGER_RTT_printf(0,"...remove EC calibration point, solution value: %d\n",calValue);
+	  ladybug_remove_EC_calibration_point(calValue);
+	  update_EC_calibration_table_characteristic(p_lbl);
+	  break;
+	case listECcalibrationPoints:
+	  SEGGER_RTT_WriteString(0,"...list EC calibration points\n");
+	  update_EC_calibration_table_characteristic(p_lbl);
+	  break;
+	case updateSamplingConfig:
+	  SEGGER_RTT_WriteString(0,"update sampling config\n");
+	  //sampling period in seconds, then the pH delta and the EC delta in mV.  All are UInt16.
+	  if (p_evt_write->len != SAMPLING_CONFIG_WRITE_LEN){
+	      SEGGER_RTT_printf(0,"...sampling config not changed.  Expected %d bytes, got %d\n",SAMPLING_CONFIG_WRITE_LEN,p_evt_write->len);
+	      break;
+	  }
+	  ladybug_update_sampling_config(p_evt_write->data[1] | p_evt_write->data[2] << 8,
+					 p_evt_write->data[3] | p_evt_write->data[4] << 8,
+					 p_evt_write->data[5] | p_evt_write->data[6] << 8);
+	  break;
 	default:
 	  SEGGER_RTT_WriteString(0,"Unknown control\n");
 	  break;
@@ -365,7 +668,8 @@ static uint32_t batt_char_add(ble_lbl_t * p_lbl)
 /**
  * \brief The characteristic that contains the pH(mV) , EC_VIN(mV), and EC_VOUT(mV) readings.
  * \details This characteristic will Notify the client when the values have been updated.  Measurements are updated
- * when the client sends the command to update the measurement.  Do it this way saves constantly updating readings by the device.
+ * when the client sends the command to update the measurement and on the sampling schedule.  Scheduled measurements only notify when
+ * the readings have moved by more than the configured delta.  This saves radio traffic when the nutrient bath is stable.
  * @param p_lbl
  * @return
  */
@@ -410,19 +714,202 @@ static uint32_t measurement_char_add(ble_lbl_t * p_lbl)
   /************************************
    * get pH(mV), EC_VIN(mV), and EC_VOUT(mV) readings
    *************************************/
-  measurements_t *p_measurements;
-  ladybug_get_measurements(&p_measurements);
+  measurements_t measurements;
+  ladybug_take_measurements();
+  ladybug_get_measurements(&measurements);
   attr_char_value.p_uuid       = &ble_uuid;  //a bit earlier in this function this was set to the batt characteristic
   attr_char_value.p_attr_md    = &attr_md;
   attr_char_value.init_len     = sizeof(measurements_t);
   attr_char_value.init_offs    = 0;
   attr_char_value.max_len      = sizeof(measurements_t);
-  attr_char_value.p_value      = (uint8_t *)p_measurements;
+  attr_char_value.p_value      = (uint8_t *)&measurements;  //BLE_GATTS_VLOC_STACK means the SoftDevice keeps its own copy of the value
 
   return sd_ble_gatts_characteristic_add(p_lbl->service_handle, &char_md,
 					 &attr_char_value,
 					 &p_lbl->measurement_char_handles);
 }
+/**
+ * \brief Add a characteristic the client can read (and, with notify, be notified of) but not write.
+ * @param p_lbl
+ * @param uuid		the characteristic's 16 bit UUID (LBL_UUID_..._CHAR)
+ * @param p_value	the initial value.  With BLE_GATTS_VLOC_USER, the Ladybug's memory the value is read from.
+ * @param len		the value's length
+ * @param vloc		BLE_GATTS_VLOC_STACK if the SoftDevice keeps its own copy of the value, BLE_GATTS_VLOC_USER if it reads p_value
+ * @param notify	the client can turn on notifications of the value
+ * @param p_handles	where the characteristic's handles go
+ * @return
+ */
+static uint32_t add_read_only_char(ble_lbl_t * p_lbl, uint16_t uuid, uint8_t *p_value, uint16_t len, uint8_t vloc, bool notify,
+				   ble_gatts_char_handles_t *p_handles)
+{
+  ble_gatts_char_md_t char_md;
+  ble_gatts_attr_md_t cccd_md;
+  ble_gatts_attr_t    attr_char_value;
+  ble_uuid_t          ble_uuid;
+  ble_gatts_attr_md_t attr_md;
+//setting up the cccd_md is needed for a notify characteristic but not for just a read characteristic
+  memset(&cccd_md, 0, sizeof(cccd_md));
+
+  BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
+  BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.write_perm);
+  cccd_md.vloc = BLE_GATTS_VLOC_STACK;
+
+  memset(&char_md, 0, sizeof(char_md));
+
+  char_md.char_props.read   = 1;
+  char_md.char_props.notify = notify ? 1 : 0;
+  char_md.p_char_user_desc  = NULL;
+  char_md.p_char_pf         = NULL;
+  char_md.p_user_desc_md    = NULL;
+  char_md.p_cccd_md         = notify ? &cccd_md : NULL;
+  char_md.p_sccd_md         = NULL;
+
+  ble_uuid.type = p_lbl->uuid_type;
+  ble_uuid.uuid = uuid;
+
+  memset(&attr_md, 0, sizeof(attr_md));
+
+  BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+  BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+  attr_md.vloc       = vloc;
+  attr_md.rd_auth    = 0;
+  attr_md.wr_auth    = 0;
+  attr_md.vlen       = 0;
+
+  memset(&attr_char_value, 0, sizeof(attr_char_value));
+  attr_char_value.p_uuid       = &ble_uuid;
+  attr_char_value.p_attr_md    = &attr_md;
+  attr_char_value.init_len     = len;
+  attr_char_value.init_offs    = 0;
+  attr_char_value.max_len      = len;
+  attr_char_value.p_value      = p_value;
+
+  return sd_ble_gatts_characteristic_add(p_lbl->service_handle, &char_md,
+					 &attr_char_value,
+					 p_handles);
+}
+/**
+ * \brief The read only characteristic that contains the min, max, mean, and standard deviation of the pH(mV), EC_VIN(mV), and EC_VOUT(mV)
+ * readings taken since the client last sent updateStatistics.
+ * @param p_lbl
+ * @return
+ */
+static uint32_t statistics_char_add(ble_lbl_t * p_lbl)
+{
+  SEGGER_RTT_WriteString(0,"---> in statistics_char_add\n");
+  //there are no statistics until measurements have been taken.
+  statistics_t statistics;
+  memset(&statistics, 0, sizeof(statistics));
+  return add_read_only_char(p_lbl,LBL_UUID_STATISTICS_CHAR,(uint8_t *)&statistics,sizeof(statistics_t),BLE_GATTS_VLOC_STACK,false,
+			    &p_lbl->statistics_char_handles);
+}
+/**
+ * \brief The read only characteristic that contains the EC calibration table - the number of points followed by the (solution value in µS/cm,
+ * EC_VOUT/EC_VIN in Q12) of each point.  The points are in order of the probe's reading.
+ * @param p_lbl
+ * @return
+ */
+static uint32_t EC_calibration_table_char_add(ble_lbl_t * p_lbl)
+{
+  SEGGER_RTT_WriteString(0,"---> in EC_calibration_table_char_add\n");
+  ECcalibrationTable_t ECcalibrationTable;
+  ladybug_get_EC_calibration_table(&ECcalibrationTable);
+  return add_read_only_char(p_lbl,LBL_UUID_EC_CALIBRATION_TABLE_CHAR,(uint8_t *)&ECcalibrationTable,sizeof(ECcalibrationTable_t),
+			    BLE_GATTS_VLOC_STACK,false,&p_lbl->EC_calibration_table_char_handles);
+}
+/**
+ * \brief The read/notify characteristic that tells the client how the probe's reading is settling (settlingStatus_t) while a calibration
+ * waits for it.
+ * @param p_lbl
+ * @return
+ */
+static uint32_t settling_char_add(ble_lbl_t * p_lbl)
+{
+  SEGGER_RTT_WriteString(0,"---> in settling_char_add\n");
+  settlingStatus_t status;
+  memset(&status, 0, sizeof(status));
+  return add_read_only_char(p_lbl,LBL_UUID_SETTLING_CHAR,(uint8_t *)&status,sizeof(settlingStatus_t),BLE_GATTS_VLOC_STACK,true,
+			    &p_lbl->settling_char_handles);
+}
+/**
+ * \brief The read only characteristic that contains a reading of each sensor in the registry (sensorMeasurements_t).  Its length is set by
+ * the number of sensors on the board.  It is updated after each measurement.
+ * @param p_lbl
+ * @return
+ */
+static uint32_t sensors_char_add(ble_lbl_t * p_lbl)
+{
+  SEGGER_RTT_WriteString(0,"---> in sensors_char_add\n");
+  //there are no readings until measurements have been taken.
+  sensorMeasurements_t sensorMeasurements;
+  memset(&sensorMeasurements, 0, sizeof(sensorMeasurements));
+  sensorMeasurements.num_sensors = NUM_SENSORS;
+  for (uint8_t sensor = 0; sensor < NUM_SENSORS; sensor++) {
+      sensorMeasurements.sensors[sensor].type = ladybug_sensor_type(sensor);
+  }
+  return add_read_only_char(p_lbl,LBL_UUID_SENSORS_CHAR,(uint8_t *)&sensorMeasurements,sizeof(sensorMeasurements_t),
+			    BLE_GATTS_VLOC_STACK,false,&p_lbl->sensors_char_handles);
+}
+/**
+ * \brief The read only characteristic that contains the calibration (sensorCalibration_t) of each sensor in the registry.
+ * The value is kept in the Ladybug's memory (BLE_GATTS_VLOC_USER) so a read always returns the calibrations in use.
+ * @param p_lbl
+ * @return
+ */
+static uint32_t sensor_calibrations_char_add(ble_lbl_t * p_lbl)
+{
+  SEGGER_RTT_WriteString(0,"---> in sensor_calibrations_char_add\n");
+  storeSensorCalibrations_t *p_storeSensorCalibrations;
+  ladybug_get_sensor_calibrations(&p_storeSensorCalibrations);
+  return add_read_only_char(p_lbl,LBL_UUID_SENSOR_CALIBRATIONS_CHAR,(uint8_t *)p_storeSensorCalibrations->calibrations,
+			    sizeof(p_storeSensorCalibrations->calibrations),BLE_GATTS_VLOC_USER,false,
+			    &p_lbl->sensor_calibrations_char_handles);
+}
+/**
+ * \brief The read only characteristic that contains the pH10 calibration point and the line fitted through the pH calibration points
+ * (pHFit_t).  The value is kept in the Ladybug's memory (BLE_GATTS_VLOC_USER) so a read always returns the fit in use.
+ * @param p_lbl
+ * @return
+ */
+static uint32_t pH_fit_char_add(ble_lbl_t * p_lbl)
+{
+  SEGGER_RTT_WriteString(0,"---> in pH_fit_char_add\n");
+  pHFit_t *p_pHFit;
+  ladybug_get_pH_fit_memory_location(&p_pHFit);
+  return add_read_only_char(p_lbl,LBL_UUID_PH_FIT_CHAR,(uint8_t *)p_pHFit,sizeof(pHFit_t),BLE_GATTS_VLOC_USER,false,
+			    &p_lbl->pH_fit_char_handles);
+}
+/**
+ * \brief The read only characteristic that contains the forecast (forecastReport_t) - how fast the pH and EC are moving and how long until
+ * they cross the alarm thresholds.  It is updated after each scheduled measurement.
+ * @param p_lbl
+ * @return
+ */
+static uint32_t forecast_char_add(ble_lbl_t * p_lbl)
+{
+  SEGGER_RTT_WriteString(0,"---> in forecast_char_add\n");
+  //there is no forecast until scheduled measurements have been taken.
+  forecastReport_t forecast;
+  memset(&forecast, 0, sizeof(forecast));
+  forecast.pH_minutes_to_threshold = FORECAST_UNKNOWN;
+  forecast.EC_minutes_to_threshold = FORECAST_UNKNOWN;
+  return add_read_only_char(p_lbl,LBL_UUID_FORECAST_CHAR,(uint8_t *)&forecast,sizeof(forecastReport_t),BLE_GATTS_VLOC_STACK,false,
+			    &p_lbl->forecast_char_handles);
+}
+/**
+ * \brief The read only characteristic that contains the calibration history of the pH4, pH7, EC1, and EC2 points (calibrationHistory_t).
+ * The value is kept in the Ladybug's memory (BLE_GATTS_VLOC_USER) so a read always returns the history in use.
+ * @param p_lbl
+ * @return
+ */
+static uint32_t calibration_history_char_add(ble_lbl_t * p_lbl)
+{
+  SEGGER_RTT_WriteString(0,"---> in calibration_history_char_add\n");
+  storeCalibrationHistory_t *p_storeCalibrationHistory;
+  ladybug_get_calibration_history(&p_storeCalibrationHistory);
+  return add_read_only_char(p_lbl,LBL_UUID_CALIBRATION_HISTORY_CHAR,(uint8_t *)p_storeCalibrationHistory->history,
+			    sizeof(p_storeCalibrationHistory->history),BLE_GATTS_VLOC_USER,false,&p_lbl->calibration_history_char_handles);
+}
 /**@brief  This is a read/notify characteristic.  Contains the pH,EC, and pH calibration info.  The code logic is for the client to first send a command to update a calibration
  * value - for example, if the probe is in the pH4 calibration solution, the update is to update pH4.  The calibration characteristic
  * also contains the mV values for pH4, EC1, and EC2 (i.e.: pH calibration requires two points.  EC calibration can be either one point
@@ -588,11 +1075,48 @@ uint32_t ladybug_BLE_init(ble_lbl_t * p_lbl)
    *************************************/
   err_code = measurement_char_add(p_lbl);
   APP_ERROR_CHECK(err_code);
+  /************************************
+   * Add the statistics characteristic to the LBL Service
+   *************************************/
+  err_code = statistics_char_add(p_lbl);
+  APP_ERROR_CHECK(err_code);
   /************************************
    * Add the calibration characteristic to the LBL Service
    *************************************/
   err_code = calibration_char_add(p_lbl);
   APP_ERROR_CHECK(err_code);
+  /************************************
+   * Add the EC calibration table characteristic to the LBL Service
+   *************************************/
+  err_code = EC_calibration_table_char_add(p_lbl);
+  APP_ERROR_CHECK(err_code);
+  /************************************
+   * Add the calibration history characteristic to the LBL Service
+   *************************************/
+  err_code = calibration_history_char_add(p_lbl);
+  APP_ERROR_CHECK(err_code);
+  /************************************
+   * Add the settling characteristic to the LBL Service
+   *************************************/
+  err_code = settling_char_add(p_lbl);
+  APP_ERROR_CHECK(err_code);
+  /************************************
+   * Add the forecast characteristic to the LBL Service
+   *************************************/
+  err_code = forecast_char_add(p_lbl);
+  APP_ERROR_CHECK(err_code);
+  /************************************
+   * Add the sensors and sensor calibrations characteristics to the LBL Service
+   *************************************/
+  err_code = sensors_char_add(p_lbl);
+  APP_ERROR_CHECK(err_code);
+  err_code = sensor_calibrations_char_add(p_lbl);
+  APP_ERROR_CHECK(err_code);
+  /************************************
+   * Add the pH fit characteristic to the LBL Service
+   *************************************/
+  err_code = pH_fit_char_add(p_lbl);
+  APP_ERROR_CHECK(err_code);
   /************************************
    * Add the battery level characteristic to the LBL Service
    *************************************/
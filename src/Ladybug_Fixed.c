@@ -0,0 +1,140 @@
+/**
+ * \file		Ladybug_Fixed.c
+ * \brief	The fixed point routines that are too big to inline, and the cycle count harness.
+ * \sa		Ladybug_Fixed.h
+ */
+#include <stddef.h>
+#include "Ladybug_Fixed.h"
+#ifdef LADYBUG_BENCHMARK
+#include "nrf.h"
+#include "SEGGER_RTT.h"
+#endif
+
+/**
+ * \brief ceil(2^32 / n).  value * m_reciprocals[n] >> 32 is value / n (exactly, for |value| < 2^28).
+ */
+static uint32_t const m_reciprocals[FIXED_SMALL_DIVISOR_MAX + 1] = {
+    0,0,0x80000000,0x55555556,0x40000000,0x33333334,0x2aaaaaab,0x24924925,0x20000000,
+    0x1c71c71d,0x1999999a,0x1745d175,0x15555556,0x13b13b14,0x12492493,0x11111112,0x10000000
+};
+/**
+ * \callgraph
+ * \brief value / divisor (rounded toward 0 like C's /) for the counts a window is averaged over.
+ * @param value		|value| < 2^28
+ * @param divisor	1 to FIXED_SMALL_DIVISOR_MAX.  A larger divisor falls back to /.
+ */
+int32_t ladybug_fixed_div_small(int32_t value, uint8_t divisor) {
+  if (divisor <= 1 || divisor > FIXED_SMALL_DIVISOR_MAX) {
+      return divisor == 1 ? value : (divisor == 0 ? 0 : value / divisor);
+  }
+  uint32_t magnitude = value < 0 ? -(uint32_t)value : (uint32_t)value;
+  int32_t quotient = (int32_t)(((uint64_t)magnitude * m_reciprocals[divisor]) >> 32);
+  return value < 0 ? -quotient : quotient;
+}
+/**
+ * \callgraph
+ * \brief numerator / divisor in Q16, so later divides by divisor become ladybug_fixed_q16_mul(value, reciprocal).
+ * @return 0 if divisor is 0.  Saturates at INT32_MIN / INT32_MAX.
+ */
+int32_t ladybug_fixed_reciprocal_q16(int32_t numerator, int32_t divisor) {
+  if (divisor == 0) {
+      return 0;
+  }
+  int64_t reciprocal = ((int64_t)numerator << 16) / divisor;
+  return reciprocal < INT32_MIN ? INT32_MIN : (reciprocal > INT32_MAX ? INT32_MAX : (int32_t)reciprocal);
+}
+/**
+ * \callgraph
+ * \brief Integer square root (floor) of a 64 bit value using the digit by digit method.  Only shifts, adds and compares - no divides.
+ */
+uint32_t ladybug_fixed_isqrt64(uint64_t value) {
+  uint64_t result = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+  while (bit > value) {
+      bit >>= 2;
+  }
+  while (bit != 0) {
+      if (value >= result + bit) {
+	  value -= result + bit;
+	  result = (result >> 1) + bit;
+      } else {
+	  result >>= 1;
+      }
+      bit >>= 2;
+  }
+  return (uint32_t)result;
+}
+/**
+ * \callgraph
+ * \brief log2 of a positive value in Q8.  The fraction is a straight line between powers of two, which is close enough for an estimate.
+ * Only shifts - the divide by the power of two is a shift.
+ */
+int32_t ladybug_fixed_log2_q8(uint32_t value) {
+  int32_t whole = 0;
+  while ((value >> whole) > 1) {
+      whole++;
+  }
+  uint32_t power = (uint32_t)1 << whole;
+  int32_t fraction_q8 = whole >= 8 ? (int32_t)((value - power) >> (whole - 8)) : (int32_t)((value - power) << (8 - whole));
+  return (whole << 8) + fraction_q8;
+}
+#ifdef LADYBUG_BENCHMARK
+#define BENCHMARK_LOOPS		64
+static volatile int32_t		m_sink;			///<the results go here so the ops aren't optimized away
+static volatile int32_t		m_input = 12345;	///<and the inputs come from here so they aren't folded into constants
+/**
+ * \brief TIMER2 counts HFCLK (16MHz, the CPU clock) with no prescaling, so each tick is a cycle.  The SoftDevice uses TIMER0.  The other
+ * benchmarks (e.g.: ladybug_crc_benchmark()) time with it too.
+ */
+void ladybug_fixed_benchmark_start(void) {
+  NRF_TIMER2->TASKS_STOP = 1;
+  NRF_TIMER2->MODE = TIMER_MODE_MODE_Timer;
+  NRF_TIMER2->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+  NRF_TIMER2->PRESCALER = 0;
+  NRF_TIMER2->TASKS_CLEAR = 1;
+  NRF_TIMER2->TASKS_START = 1;
+}
+uint32_t ladybug_fixed_benchmark_now(void) {
+  NRF_TIMER2->TASKS_CAPTURE[0] = 1;
+  return NRF_TIMER2->CC[0];
+}
+void ladybug_fixed_benchmark_stop(void) {
+  NRF_TIMER2->TASKS_STOP = 1;
+}
+#define BENCHMARK(name, expression)								\
+  do {												\
+    uint32_t start = ladybug_fixed_benchmark_now();								\
+    for (int32_t i = 0; i < BENCHMARK_LOOPS; i++) {						\
+	m_sink = (expression);									\
+    }												\
+    uint32_t cycles = ladybug_fixed_benchmark_now() - start;							\
+    cycles = cycles > overhead ? cycles - overhead : 0;						\
+    SEGGER_RTT_printf(0,"%s: %d.%02d cycles per op\n",name,cycles / BENCHMARK_LOOPS,		\
+		      (cycles % BENCHMARK_LOOPS) * 100 / BENCHMARK_LOOPS);			\
+  } while (0)
+/**
+ * \callgraph
+ * \brief Time each op over BENCHMARK_LOOPS runs and print the cycles per op (less the loop's own cycles) to RTT.
+ * \note Call before the SoftDevice is enabled so its interrupts don't land in the timings.
+ */
+void ladybug_fixed_benchmark(void) {
+  SEGGER_RTT_WriteString(0,"---> in ladybug_fixed_benchmark\n");
+  ladybug_fixed_benchmark_start();
+  uint32_t overhead = 0;
+  uint32_t start = ladybug_fixed_benchmark_now();
+  for (int32_t i = 0; i < BENCHMARK_LOOPS; i++) {
+      m_sink = m_input + i;
+  }
+  overhead = ladybug_fixed_benchmark_now() - start;
+  BENCHMARK("the loop (subtracted from the others)",m_input + i);
+  BENCHMARK("int32 / (the library divide)",m_input / (i + 3));
+  BENCHMARK("div_small",ladybug_fixed_div_small(m_input + i,(i & 15) + 1));
+  BENCHMARK("q15_mul",ladybug_fixed_q15_mul(m_input + i,m_input));
+  BENCHMARK("q16_mul",ladybug_fixed_q16_mul(m_input + i,m_input));
+  BENCHMARK("reciprocal_q16",ladybug_fixed_reciprocal_q16(300,m_input + i));
+  BENCHMARK("sat_add_s16",ladybug_fixed_sat_add_s16(m_input + i,m_input));
+  BENCHMARK("isqrt64",ladybug_fixed_isqrt64((uint64_t)(m_input + i) * m_input));
+  BENCHMARK("log2_q8",ladybug_fixed_log2_q8(m_input + i));
+  ladybug_fixed_benchmark_stop();
+}
+#endif
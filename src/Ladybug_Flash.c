@@ -3,78 +3,596 @@
  * \author	Margaret Johnson
  * \version	1.0
  * \brief	Functions that read/write to/from the nRF51822's Flash.
+ * \details	The records are kept in a log over FLASH_LOG_SEGMENTS segments.  Writing a record appends a new version of it to the segment
+ * 		in use - no erase.  The version with the highest sequence is the newest.  When the segment fills up, the next segment is erased
+ * 		and the newest version of every record is written to it (the compaction).  Its page header is written last, so a segment the
+ * 		power went out on while it was compacted to isn't used.  So the pages are erased once every
+ * 		segment full of writes instead of on every write.  A record that is the same as its version in the log isn't written.  A change that
+ * 		only clears bits (1 -> 0) of one word is programmed over the version in the log.
+ * 		Each version has the record's length, the version of its layout, a sequence number and a CRC-32 that is stored after its
+ * 		bytes.  A version the power went out on fails its CRC, and the version before it is used.
+ * 		The only hardware the module touches is through pstorage (and app_timer for its time outs), and it reads the records through
+ * 		a pointer to the registered flash.  So it runs on a host over a pstorage that programs 1 -> 0 only, erases pages, calls back
+ * 		later and can stop at any operation to play a power cut.  ladybug_flash_cache_stats() counts the stores and each log page's
+ * 		erases.
  * \date		Jan 4, 2016
  */
 #define	DEBUG	///< Used in app_error.h to give line / function name input.
 
+#include <stddef.h>
+#include <string.h>
 #include "Ladybug_Flash.h"
+#include "nrf.h"
 #include "app_timer.h"
+#include "app_util_platform.h"
 #include "app_error.h"
 #include "Ladybug_Error.h"
 #include "SEGGER_RTT.h"
 #include "Ladybug_Hydro.h"
-static pstorage_handle_t			m_block_calibration_store_handle;
-static pstorage_handle_t			m_block_plantInfo_store_handle;
-static pstorage_handle_t			m_block_device_name_store_handle;
-static uint8_t 				m_mypstorage_wait_flag;
-static app_timer_id_t                   m_timer_id;   /**< identifies this timer in the timer queue (only one in queue so...) */
-/*!
- * \brief
- *  m_return: 	pointer to the call back function passed into ladybug_flash_write().
+#include "Ladybug_CRC.h"
+static pstorage_handle_t			m_base_store_handle; ///<handle to the chunk-o-flash returned when registering with pstorage.
+static bool					m_mounted = false;	///<the pages are registered where the log expects them and the log is mounted
+/**
+ * \brief How big each record can get (num_blocks * BLOCK_SIZE).  Before the log, each record lived in LEGACY_PAGE at first_block.  A
+ * record that hasn't been written to the log yet is read from there.  version is the version of the record's layout that is written.
+ */
+typedef struct {
+  uint8_t	first_block;
+  uint8_t	num_blocks;
+  uint8_t	version;
+}flash_record_t;
+#define SENSOR_CALIBRATIONS_BLOCKS	((sizeof(storeSensorCalibrations_t) + BLOCK_SIZE - 1) / BLOCK_SIZE)	///<as many as the sensors in the registry need.  The last record, so it can grow into the rest of LEGACY_PAGE.
+static const flash_record_t			m_flash_records[] = {
+    [calibrationValues]  = {0,1,CALIBRATION_VALUES_VERSION},
+    [plantInfo]          = {1,1,PLANT_INFO_VERSION},
+    [deviceName]         = {2,1,DEVICE_NAME_VERSION},
+    [samplingConfig]     = {3,1,SAMPLING_CONFIG_VERSION},
+    [ECcalibrationTable] = {4,2,EC_CALIBRATION_TABLE_VERSION},
+    [calibrationHistory] = {6,7,CALIBRATION_HISTORY_VERSION},
+    [probeHealthTrend] = {13,2,PROBE_HEALTH_TREND_VERSION},
+    [alarmConfig] = {15,1,ALARM_CONFIG_VERSION},
+    [sensorCalibrations] = {16,SENSOR_CALIBRATIONS_BLOCKS,SENSOR_CALIBRATIONS_VERSION},
+};
+#define NUM_FLASH_RECORDS	(sizeof(m_flash_records)/sizeof(m_flash_records[0]))
+#define NUM_FLASH_BLOCKS	(16 + SENSOR_CALIBRATIONS_BLOCKS) ///<the total of the num_blocks in m_flash_records.  A compaction writes all of them (and their headers, and a header's worth at the end of each page) to a segment.
+#define FLASH_NO_RECORD		0xFF
+/**
+ * \brief The log.  A segment in use starts with a log_page_header_t.  The entries follow, each a log_entry_header_t and then the record's
+ * bytes (padded to a word).  The rest of the segment is erased (0xFF).  The segment with the highest sequence is the one being appended to.
+ */
+#define FIRST_LOG_PAGE		0
+#define LEGACY_PAGE		FLASH_LOG_PAGES	///<the blocks the records were kept in before the log.  The page below pstorage's swap page.
+#define LOG_PAGE_MAGIC		0x4C424C47	///<"LBLG"
+#define LOG_ENTRY_TAG		0xE7		///<an erased tag (0xFF) is where the free space starts
+#define LOG_CRC_ERASED		0xFFFFFFFF
+#define LOG_SEQUENCE_ERASED	0xFFFFFFFF
+#define NO_LOG_ENTRY		0xFFFF
+#define LOG_SEGMENT_SIZE	(FLASH_LOG_SEGMENT_PAGES * FLASH_PAGE_SIZE)
+typedef struct {
+  uint32_t	magic;
+  uint32_t	sequence;	///<one more than the segment compacted from.  Written once the compaction has written every record.
+}log_page_header_t;
+/**
+ * \brief Each word is programmed once, so a word isn't written more than twice between erases.  The bytes after the header are programmed
+ * twice at most (when they are programmed over).
+ */
+typedef struct {
+  uint8_t	record;		///<flash_rw_t in the low nibble, the version of the record's layout in the high nibble (0 in entries written before versions)
+  uint8_t	tag;
+  uint16_t	num_bytes;
+  uint32_t	sequence;	///<one more than the version written before it (of any record)
+  uint32_t	crc;		///<the CRC-32 of the bytes.  Programmed after the bytes.
+  uint32_t	crc_in_place;	///<the CRC-32 the bytes have once they are programmed over.  Programmed before them, and erased until then.
+}log_entry_header_t;
+#define LOG_ENTRY_SIZE(num_bytes)	(sizeof(log_entry_header_t) + (((num_bytes) + 3) & ~3))
+#define LOG_ENTRY_RECORD(p_entry)	((p_entry)->record & 0x0F)
+#define LOG_ENTRY_VERSION(p_entry)	((p_entry)->record >> 4)
+static uint16_t					m_log_index[NUM_FLASH_RECORDS];	///<where in the log the newest version of each record is (the offset from the first log page).  NO_LOG_ENTRY if it isn't in the log.
+static uint8_t					m_log_segment;		///<the log segment being appended to (0 to FLASH_LOG_SEGMENTS - 1)
+static uint16_t					m_log_free;		///<the offset in m_log_segment of the free space.  LOG_SEGMENT_SIZE when a compaction is needed.
+static uint32_t					m_log_sequence;		///<the sequence of m_log_segment
+static uint32_t					m_entry_sequence;	///<the sequence of the next version written
+/**
+ * \brief A read or write waiting in the queue.  A read loads the newest version of the record.  A write appends a version of each of its
+ * records - or, if they don't fit in the segment, compacts to the next segment.  pstorage is asked for one operation at a time.  The next is
+ * asked for from ladybug_flash_handler() when the one before completes.  Everything pstorage loads or stores goes through m_staging, so
+ * the caller's bytes don't need to be word aligned.
+ */
+typedef enum {
+  stepLoad,		///<load the next chunk of the record
+  stepErase,		///<erase the next page of the segment the compaction writes to
+  stepEntryHeader,
+  stepEntryData,	///<store the next chunk of the record
+  stepEntryCRC,		///<store the CRC of the bytes that were stored (or, programming over, are about to be)
+  stepPageHeader	///<put the segment the compaction wrote in use
+}flash_step_t;
+/**
+ * \brief How a write changes a record compared to its version in the log.
+ */
+typedef enum {
+  entryUnchanged,
+  entryInPlace,		///<only bits of one word are cleared
+  entryAppend
+}entry_change_t;
+typedef struct {
+  flash_request_id_t	id;
+  uint8_t		record;		///<the record p_bytes is for.  FLASH_NO_RECORD for the cache's flush.
+  bool			is_write;
+  bool			compacting;
+  bool			in_place;	///<the record being written is programmed over its version in the log
+  uint8_t		step;		///<flash_step_t
+  uint8_t		op_code;	///<the pstorage operation in flight and the page it was asked for.  An event that doesn't match is left
+  pstorage_block_t	block_id;	///<over from a request that timed out.
+  uint16_t		records;	///<a write's records still to append.  A bit for each flash_rw_t.
+  uint8_t		entry_record;	///<the record being read or appended
+  uint8_t		entry_version;	///<the version of the record's layout being appended
+  uint16_t		entry_offset;	///<where in the chunk-o-flash the record's bytes are read from or written to
+  uint8_t const		*p_source;	///<what is being appended (RAM or the memory mapped flash)
+  pstorage_size_t	entry_bytes;	///<how many bytes of the record are read or appended
+  pstorage_size_t	done_bytes;	///<how many of them have been loaded or stored.  How many pages have been erased in stepErase.
+  pstorage_size_t	chunk_bytes;	///<how many bytes the operation in flight loads or stores.  A chunk doesn't go past a page.
+  uint32_t		crc;		///<of the chunks stored so far.  Of all the bytes when programming over.
+  uint8_t		*p_bytes;	///<the caller's bytes
+  pstorage_size_t	num_bytes;
+  flash_done_t		did_flash_action;
+}flash_request_t;
+static flash_request_t				m_requests[FLASH_QUEUE_DEPTH];	///<the queue.  The request at m_first_request is the one pstorage is working on.
+static uint8_t					m_first_request = 0;
+static volatile uint8_t				m_num_requests = 0;
+static flash_request_id_t			m_next_request_id = FLASH_NO_REQUEST + 1;
+static volatile flash_request_id_t		m_last_finished_id = FLASH_NO_REQUEST;	///<requests finish in the order they are made
+static uint32_t					m_results[FLASH_QUEUE_DEPTH];	///<the err_code of each request, by id % FLASH_QUEUE_DEPTH.  Read by ladybug_flash_wait().
+static uint32_t					m_staging[BLOCK_SIZE / sizeof(uint32_t)];	///<the word aligned bytes of the pstorage operation in flight
+static uint32_t					m_in_place;	///<the word a record is programmed over with.  The CRC the record then has is stored first.
+static app_timer_id_t                   	m_timer_id;   /**< times out the request pstorage is working on */
+/**
+ * \brief The write-back cache.  Each record's RAM copy is registered once it has been read.  A change marks the record dirty and the
+ * dirty records are written together FLASH_CACHE_DEBOUNCE_MS after the last change (or FLASH_CACHE_MAX_DELAY_MS after the first).
+ */
+typedef struct {
+  uint8_t		*p_bytes;
+  pstorage_size_t	num_bytes;
+}flash_cache_entry_t;
+static flash_cache_entry_t			m_cache[NUM_FLASH_RECORDS];
+static volatile uint16_t			m_dirty_records = 0;	///<a bit for each flash_rw_t
+static uint16_t					m_marks_since_flush = 0;
+static uint32_t					m_first_mark_ticks;
+static uint32_t					m_last_mark_ticks;
+static flashCacheStats_t			m_cache_stats;
+static app_timer_id_t				m_debounce_timer_id;
+static void start_request(void);
+/**
+ * \brief The offset in the chunk-o-flash of a position in the log.
+ */
+static uint16_t log_offset(uint16_t log_position) {
+  return FIRST_LOG_PAGE * FLASH_PAGE_SIZE + log_position;
+}
+/**
+ * \brief The flash is memory mapped, so what is in it can be read through a pointer.
+ */
+static uint8_t const *flash_address(uint16_t offset) {
+  return (uint8_t const *)(uintptr_t)(m_base_store_handle.block_id + offset);
+}
+/**
+ * \brief Where an entry appended at an offset in a segment starts.  pstorage stores within a page, so an entry whose header would run past
+ * the end of a page starts on the next page.  Its bytes can run past it, since they are stored a chunk at a time.
+ */
+static uint16_t entry_start(uint16_t offset) {
+  if (offset % FLASH_PAGE_SIZE + sizeof(log_entry_header_t) > FLASH_PAGE_SIZE){
+      return offset - offset % FLASH_PAGE_SIZE + FLASH_PAGE_SIZE;
+  }
+  return offset;
+}
+/**
+ * \brief A version is good if its bytes match the CRC stored after them.  The power didn't go out while it was written.  A version
+ * programmed over matches its crc until the one word that changes is programmed, and its crc_in_place after.  A word is the most the
+ * flash programs at once, so the power going out can't leave it matching neither.
  */
-void (*m_flash_return)(uint32_t);
+static bool entry_is_valid(log_entry_header_t const *p_entry) {
+  if (p_entry->sequence == LOG_SEQUENCE_ERASED){
+      return false;
+  }
+  uint32_t crc = ladybug_crc32(CRC32_INITIAL,(uint8_t const *)(p_entry + 1),p_entry->num_bytes);
+  return crc == p_entry->crc || (p_entry->crc_in_place != LOG_CRC_ERASED && crc == p_entry->crc_in_place);
+}
+/**
+ * \brief Walk the versions in a segment.  A good version of a record replaces the one found before it if its sequence is higher.
+ * @return the offset in the segment of the free space
+ */
+static uint16_t mount_segment(uint8_t segment) {
+  uint16_t offset = sizeof(log_page_header_t);
+  while ((offset = entry_start(offset)) + sizeof(log_entry_header_t) <= LOG_SEGMENT_SIZE){
+      log_entry_header_t const *p_entry = (log_entry_header_t const *)flash_address(log_offset(segment * LOG_SEGMENT_SIZE + offset));
+      if (p_entry->tag != LOG_ENTRY_TAG || offset + LOG_ENTRY_SIZE(p_entry->num_bytes) > LOG_SEGMENT_SIZE){
+	  break;
+      }
+      if (p_entry->sequence != LOG_SEQUENCE_ERASED && p_entry->sequence >= m_entry_sequence){
+	  m_entry_sequence = p_entry->sequence + 1;
+      }
+      uint8_t record = LOG_ENTRY_RECORD(p_entry);
+      if (record < NUM_FLASH_RECORDS && entry_is_valid(p_entry)){
+	  log_entry_header_t const *p_newest = (log_entry_header_t const *)flash_address(log_offset(m_log_index[record]));
+	  if (m_log_index[record] == NO_LOG_ENTRY || p_entry->sequence > p_newest->sequence){
+	      m_log_index[record] = segment * LOG_SEGMENT_SIZE + offset;
+	  }
+      }
+      offset += LOG_ENTRY_SIZE(p_entry->num_bytes);
+  }
+  return offset;
+}
 /**
  * \callgraph
- * \brief Called by the system when the timer goes off.  If the timer goes off, this means the Flash activity didn't complete.  The caller
- * is notified by calling the caller's callback with an error code.
- * @param p_context
+ * \brief Find the newest good version of each record in the log and the free space in the segment in use.  The newest is the good version
+ * with the highest sequence in any segment in use.  The segment in use is the one with the highest sequence in its page header.
+ * \details A version the power went out on while it was written fails its CRC, so the version before it is used.  One programmed over
+ * 	    matches one of its CRCs (see entry_is_valid()).  A
+ * 	    segment is only in use once its compaction has written every record, so a compaction the power went out on is done again from
+ * 	    the segment before it, which is still whole.
+ */
+static void mount_log(void) {
+  m_log_segment = FLASH_LOG_SEGMENTS;
+  m_log_sequence = 0;
+  m_entry_sequence = 0;
+  for (uint8_t record = 0;record < NUM_FLASH_RECORDS;record++){
+      m_log_index[record] = NO_LOG_ENTRY;
+  }
+  for (uint8_t segment = 0;segment < FLASH_LOG_SEGMENTS;segment++){
+      log_page_header_t const *p_header = (log_page_header_t const *)flash_address(log_offset(segment * LOG_SEGMENT_SIZE));
+      //a header the power went out on while it was written has an erased sequence.
+      if (p_header->magic != LOG_PAGE_MAGIC || p_header->sequence == LOG_SEQUENCE_ERASED){
+	  continue;
+      }
+      uint16_t free = mount_segment(segment);
+      if (m_log_segment == FLASH_LOG_SEGMENTS || p_header->sequence > m_log_sequence){
+	  m_log_segment = segment;
+	  m_log_sequence = p_header->sequence;
+	  m_log_free = free;
+      }
+  }
+  //with no segment in use, the first write compacts to the first segment.
+  if (m_log_segment == FLASH_LOG_SEGMENTS){
+      m_log_segment = FLASH_LOG_SEGMENTS - 1;
+      m_log_free = LOG_SEGMENT_SIZE;
+  }
+  SEGGER_RTT_printf(0,"...log mounted.  segment: %d, sequence: %d, free: %d\n",m_log_segment,m_log_sequence,LOG_SEGMENT_SIZE - m_log_free);
+}
+/**
+ * \brief Put back the dirty bits of records a flush didn't write, so the next flush writes them.
+ */
+static void restore_dirty(uint16_t records, uint16_t marks) {
+  bool was_clean;
+  CRITICAL_REGION_ENTER();
+  was_clean = (m_dirty_records == 0);
+  m_dirty_records |= records;
+  m_marks_since_flush += marks;
+  CRITICAL_REGION_EXIT();
+  if (was_clean && records != 0){
+      static const uint32_t app_timer_prescaler = 0;
+      uint32_t err_code = app_timer_start(m_debounce_timer_id,APP_TIMER_TICKS(FLASH_CACHE_DEBOUNCE_MS,app_timer_prescaler),NULL);
+      APP_ERROR_CHECK(err_code);
+  }
+}
+/**
+ * \callgraph
+ * \brief The request pstorage was working on is done (or failed).  Take it off the queue, let the caller know, and start the next one.
+ * \note	called from ladybug_flash_handler() (the SoftDevice's event interrupt), the timeout handler, or when a request is made.
+ * @param id		the request that finished.  Nothing happens if it has already finished (e.g. it timed out and then pstorage completed).
+ * @param err_code	0 if successful
+ */
+static void finish_request(flash_request_id_t id, uint32_t err_code) {
+  flash_done_t did_flash_action = NULL;
+  bool start_next = false;
+  uint16_t unwritten_records = 0;
+  CRITICAL_REGION_ENTER();
+  if (m_num_requests > 0 && m_requests[m_first_request].id == id){
+      did_flash_action = m_requests[m_first_request].did_flash_action;
+      //a flush that failed hasn't written the records still in its records.
+      if (err_code != NRF_SUCCESS && m_requests[m_first_request].is_write && m_requests[m_first_request].record == FLASH_NO_RECORD){
+	  unwritten_records = m_requests[m_first_request].records;
+      }
+      m_results[id % FLASH_QUEUE_DEPTH] = err_code;
+      m_last_finished_id = id;
+      m_first_request = (m_first_request + 1) % FLASH_QUEUE_DEPTH;
+      m_num_requests--;
+      start_next = m_num_requests > 0;
+  }else {
+      id = FLASH_NO_REQUEST;
+  }
+  CRITICAL_REGION_EXIT();
+  if (id == FLASH_NO_REQUEST){
+      return;
+  }
+  uint32_t timer_err_code = app_timer_stop(m_timer_id);
+  APP_ERROR_CHECK(timer_err_code);
+  for (uint8_t record = 0;record < NUM_FLASH_RECORDS;record++){
+      if (m_cache[record].p_bytes == NULL){
+	  unwritten_records &= ~(1 << record);
+      }
+  }
+  restore_dirty(unwritten_records,0);
+  if (did_flash_action != NULL){
+      did_flash_action(id,err_code);
+  }
+  if (start_next){
+      start_request();
+  }
+}
+/**
+ * \callgraph
+ * \brief Called by the system when the timer goes off.  If the timer goes off, the request pstorage was working on didn't complete.  The
+ * caller of that request is let know with LADYBUG_ERROR_FLASH_ACTION_NOT_COMPLETED and the next request is started.
+ * @param p_context	the id of the request the timer was started for
  */
 static void timeout_handler(void * p_context)
 {
   SEGGER_RTT_WriteString (0, "--> in timeout handler\n");
-  //  UNUSED_PARAMETER(p_context);
-
-  // Call back the caller with an error
-  uint32_t err_code = LADYBUG_ERROR_FLASH_ACTION_NOT_COMPLETED;
-  m_flash_return(err_code);
+  finish_request((flash_request_id_t)(uintptr_t)p_context,LADYBUG_ERROR_FLASH_ACTION_NOT_COMPLETED);
 }
 /**
- * \callgraph
- * \brief create a timer to be used before a call to write/read to flash in case the flash action doesn't happen it won't hang the system.
+ * \brief What a write appends for a record - the caller's bytes, the RAM copy in the cache, or (when compacting a record that isn't cached)
+ * the newest version in the log.
+ * @param p_version	set to the version of the record's layout.  RAM has the layout the code has.  A version copied from the log keeps its own.
+ * @return false if there is nothing to append for the record.
  */
-void create_timer() {
-  SEGGER_RTT_WriteString (0, "--> in create_timer\n");
-  uint32_t err_code = app_timer_create(&m_timer_id,APP_TIMER_MODE_SINGLE_SHOT, timeout_handler);
-  APP_ERROR_CHECK(err_code);
+static bool entry_source(flash_request_t const *p_request, uint8_t record, uint8_t const **p_source, pstorage_size_t *p_num_bytes,
+			 uint8_t *p_version) {
+  *p_version = m_flash_records[record].version;
+  if (record == p_request->record){
+      *p_source = p_request->p_bytes;
+      *p_num_bytes = p_request->num_bytes;
+  }else if (m_cache[record].p_bytes != NULL){
+      *p_source = m_cache[record].p_bytes;
+      *p_num_bytes = m_cache[record].num_bytes;
+  }else if (m_log_index[record] != NO_LOG_ENTRY){
+      log_entry_header_t const *p_entry = (log_entry_header_t const *)flash_address(log_offset(m_log_index[record]));
+      *p_source = (uint8_t const *)(p_entry + 1);
+      *p_num_bytes = p_entry->num_bytes;
+      *p_version = LOG_ENTRY_VERSION(p_entry);
+  }else {
+      return false;
+  }
+  return true;
+}
+/**
+ * \brief Compare what a write has for a record with the record's version in the log.  The flash is memory mapped so there is no read to
+ * wait for.  A record in a newer layout is appended so the entry has the new version.  A record is only programmed over if the change is
+ * in one word, so the power going out leaves the record as it was or as it is now - never a mix of the two.
+ * @param p_word	set to the offset of the word that changes when the record is programmed over
+ */
+static entry_change_t entry_change(uint8_t record, uint8_t const *p_source, pstorage_size_t num_bytes, uint8_t version,
+				   pstorage_size_t *p_word) {
+  if (m_log_index[record] == NO_LOG_ENTRY){
+      return entryAppend;
+  }
+  log_entry_header_t const *p_entry = (log_entry_header_t const *)flash_address(log_offset(m_log_index[record]));
+  if (p_entry->num_bytes != num_bytes || LOG_ENTRY_VERSION(p_entry) != version){
+      return entryAppend;
+  }
+  uint8_t const *p_current = (uint8_t const *)(p_entry + 1);
+  uint8_t changed_words = 0;
+  bool clears_bits = true;
+  for (pstorage_size_t i = 0;i < num_bytes;i++){
+      if (p_source[i] != p_current[i]){
+	  //the entry's bytes start on a word.
+	  if (changed_words == 0 || *p_word != (i & ~3)){
+	      changed_words++;
+	      *p_word = i & ~3;
+	  }
+	  clears_bits &= ((p_source[i] & p_current[i]) == p_source[i]);
+      }
+  }
+  if (changed_words == 0){
+      return entryUnchanged;
+  }
+  return clears_bits && changed_words == 1 && p_entry->crc_in_place == LOG_CRC_ERASED ? entryInPlace : entryAppend;
+}
+/**
+ * \brief Set the request up to erase the next segment and write the newest version of every record to it.
+ */
+static void start_compaction(flash_request_t *p_request) {
+  p_request->compacting = true;
+  for (uint8_t record = 0;record < NUM_FLASH_RECORDS;record++){
+      if (m_cache[record].p_bytes != NULL || m_log_index[record] != NO_LOG_ENTRY){
+	  p_request->records |= 1 << record;
+      }
+  }
+  p_request->done_bytes = 0;
+  p_request->step = stepErase;
+}
+/**
+ * \brief Set the request up to write the next of its records.  A record that hasn't changed is skipped.  When compacting, every record is
+ * appended and then the segment's page header is written.  The records are compared again here since a cached record can change after start_request() sized the write.  If the one
+ * to append no longer fits in the segment, the request compacts instead, so an entry never runs past its segment.
+ * @return false if there are no more records to write.
+ */
+static bool next_entry(flash_request_t *p_request) {
+  for (uint8_t record = 0;record < NUM_FLASH_RECORDS;record++){
+      if (p_request->records & (1 << record)){
+	  if (entry_source(p_request,record,&p_request->p_source,&p_request->entry_bytes,&p_request->entry_version)){
+	      pstorage_size_t word = 0;
+	      entry_change_t change = p_request->compacting ? entryAppend :
+		  entry_change(record,p_request->p_source,p_request->entry_bytes,p_request->entry_version,&word);
+	      p_request->entry_record = record;
+	      p_request->in_place = (change == entryInPlace);
+	      if (change == entryAppend && !p_request->compacting &&
+		  entry_start(m_log_free) + LOG_ENTRY_SIZE(p_request->entry_bytes) > LOG_SEGMENT_SIZE){
+		  start_compaction(p_request);
+		  return true;
+	      }
+	      if (change == entryAppend){
+		  p_request->entry_offset = log_offset(m_log_segment * LOG_SEGMENT_SIZE + entry_start(m_log_free));
+		  p_request->step = stepEntryHeader;
+		  return true;
+	      }
+	      if (change == entryInPlace){
+		  //only the word that changes is programmed.  It is copied so the CRC stored first is of what is programmed, even if the
+		  //RAM copy changes in between.  The rest of the record is the same as in flash.
+		  uint8_t const *p_current = flash_address(log_offset(m_log_index[record]) + sizeof(log_entry_header_t));
+		  pstorage_size_t word_bytes = p_request->entry_bytes - word < sizeof(uint32_t) ? p_request->entry_bytes - word : sizeof(uint32_t);
+		  m_cache_stats.in_place++;
+		  m_in_place = 0xFFFFFFFF;
+		  memcpy(&m_in_place,p_request->p_source + word,word_bytes);
+		  p_request->crc = ladybug_crc32(CRC32_INITIAL,p_current,word);
+		  p_request->crc = ladybug_crc32(p_request->crc,(uint8_t const *)&m_in_place,word_bytes);
+		  p_request->crc = ladybug_crc32(p_request->crc,p_current + word + word_bytes,p_request->entry_bytes - word - word_bytes);
+		  p_request->p_source = (uint8_t const *)&m_in_place;
+		  p_request->entry_offset = log_offset(m_log_index[record]) + sizeof(log_entry_header_t) + word;
+		  p_request->entry_bytes = word_bytes;
+		  p_request->done_bytes = 0;
+		  p_request->step = stepEntryCRC;
+		  return true;
+	      }
+	      m_cache_stats.unchanged++;
+	  }
+	  p_request->records &= ~(1 << record);
+      }
+  }
+  //every record is in the segment the compaction wrote, so it can be put in use.
+  if (p_request->compacting){
+      p_request->step = stepPageHeader;
+      return true;
+  }
+  return false;
 }
 /**
  * \callgraph
- * \brief Start the timer before calling into pstorage asking for a flash event.
+ * \brief Ask pstorage for the next operation of the request at the front of the queue.
  */
-void start_timer() {
-  SEGGER_RTT_WriteString (0, "--> in start_timer\n");
-  uint32_t err_code;
-  static const uint32_t wait_time_for_flash_event_to_complete_ms = 5000; ///< Wait 5 seconds before timing out from waiting for a flash event to complete
-  static const uint32_t app_timer_prescaler = 0; ///< Counter overflows after 512s when prescaler = 0
-  uint32_t timer_ticks = APP_TIMER_TICKS(wait_time_for_flash_event_to_complete_ms, app_timer_prescaler);
-  // Start application timers.
-  err_code = app_timer_start(m_timer_id, timer_ticks, NULL);
-  APP_ERROR_CHECK(err_code);
+static void issue_operation(void) {
+  flash_request_t *p_request = &m_requests[m_first_request];
+  uint16_t offset;
+  pstorage_size_t num_bytes;
+  switch (p_request->step) {
+    case stepErase:
+      offset = log_offset(((m_log_segment + 1) % FLASH_LOG_SEGMENTS) * LOG_SEGMENT_SIZE + p_request->done_bytes * FLASH_PAGE_SIZE);
+      num_bytes = FLASH_PAGE_SIZE;
+      p_request->op_code = PSTORAGE_CLEAR_OP_CODE;
+      break;
+    case stepPageHeader:
+      offset = log_offset(m_log_segment * LOG_SEGMENT_SIZE);
+      num_bytes = sizeof(log_page_header_t);
+      ((log_page_header_t *)m_staging)->magic = LOG_PAGE_MAGIC;
+      ((log_page_header_t *)m_staging)->sequence = m_log_sequence;
+      p_request->op_code = PSTORAGE_STORE_OP_CODE;
+      break;
+    case stepEntryHeader:
+      //the CRCs are left erased.
+      offset = p_request->entry_offset;
+      num_bytes = offsetof(log_entry_header_t,crc);
+      ((log_entry_header_t *)m_staging)->record = p_request->entry_record | (p_request->entry_version << 4);
+      ((log_entry_header_t *)m_staging)->tag = LOG_ENTRY_TAG;
+      ((log_entry_header_t *)m_staging)->num_bytes = p_request->entry_bytes;
+      ((log_entry_header_t *)m_staging)->sequence = m_entry_sequence++;
+      p_request->crc = CRC32_INITIAL;
+      p_request->op_code = PSTORAGE_STORE_OP_CODE;
+      break;
+    case stepEntryCRC:
+      //entry_offset is where the bytes start, or the word programmed over.
+      offset = p_request->in_place ? log_offset(m_log_index[p_request->entry_record]) + offsetof(log_entry_header_t,crc_in_place) :
+	  p_request->entry_offset - sizeof(log_entry_header_t) + offsetof(log_entry_header_t,crc);
+      num_bytes = sizeof(uint32_t);
+      m_staging[0] = p_request->crc;
+      p_request->op_code = PSTORAGE_STORE_OP_CODE;
+      break;
+    default:	//stepLoad, stepEntryData
+      offset = p_request->entry_offset + p_request->done_bytes;
+      num_bytes = p_request->entry_bytes - p_request->done_bytes;
+      num_bytes = num_bytes > BLOCK_SIZE ? BLOCK_SIZE : num_bytes;
+      if (offset % FLASH_PAGE_SIZE + num_bytes > FLASH_PAGE_SIZE){
+	  num_bytes = FLASH_PAGE_SIZE - offset % FLASH_PAGE_SIZE;
+      }
+      p_request->chunk_bytes = num_bytes;
+      if (p_request->step == stepEntryData){
+	  memset(m_staging,0xFF,sizeof(m_staging));
+	  memcpy(m_staging,p_request->p_source + p_request->done_bytes,num_bytes);
+	  if (!p_request->in_place){
+	      p_request->crc = ladybug_crc32(p_request->crc,(uint8_t *)m_staging,num_bytes);
+	  }
+	  p_request->op_code = PSTORAGE_STORE_OP_CODE;
+      }else {
+	  p_request->op_code = PSTORAGE_LOAD_OP_CODE;
+      }
+      //pstorage works in words.  The entries are padded to a word and the legacy blocks are word aligned.
+      num_bytes = (num_bytes + 3) & ~3;
+      break;
+  }
+  pstorage_handle_t handle;
+  uint32_t err_code = pstorage_block_identifier_get(&m_base_store_handle,offset / FLASH_PAGE_SIZE,&handle);
+  if (err_code == NRF_SUCCESS){
+      p_request->block_id = handle.block_id;
+      if (p_request->op_code == PSTORAGE_CLEAR_OP_CODE){
+	  //clearing the pstorage/flash sets the bytes to 0xFF.  A whole page is erased without pstorage's swap page.
+	  m_cache_stats.erases++;
+	  m_cache_stats.log_page_erases[offset / FLASH_PAGE_SIZE - FIRST_LOG_PAGE]++;
+	  err_code = pstorage_clear(&handle,num_bytes);
+      }else if (p_request->op_code == PSTORAGE_STORE_OP_CODE){
+	  m_cache_stats.stores++;
+	  err_code = pstorage_store(&handle,(uint8_t *)m_staging,num_bytes,offset % FLASH_PAGE_SIZE);
+      }else {
+	  err_code = pstorage_load((uint8_t *)m_staging,&handle,num_bytes,offset % FLASH_PAGE_SIZE);
+      }
+  }
+  if (err_code != NRF_SUCCESS){
+      finish_request(p_request->id,err_code);
+  }
 }
 /**
  * \callgraph
- * \brief Called to stop the timer from firing.
+ * \brief Start the request at the front of the queue.  There is a chance the Flash activity doesn't happen so a timer is started for the
+ * request to prevent waiting forever.
  */
-void stop_timer() {
-  SEGGER_RTT_WriteString (0, "--> in stop_timer\n");
-  uint32_t err_code = app_timer_stop(m_timer_id);
+static void start_request(void) {
+  static const uint32_t wait_time_for_flash_request_to_complete_ms = 5000; ///< Wait 5 seconds before timing out from waiting for a flash request to complete
+  static const uint32_t app_timer_prescaler = 0; ///< Counter overflows after 512s when prescaler = 0
+  flash_request_t *p_request = &m_requests[m_first_request];
+  SEGGER_RTT_printf(0,"--> in start_request.  id: %d, record: %d, write: %d\n",p_request->id,p_request->record,p_request->is_write);
+  uint32_t err_code = app_timer_start(m_timer_id,APP_TIMER_TICKS(wait_time_for_flash_request_to_complete_ms, app_timer_prescaler),
+				      (void *)(uintptr_t)p_request->id);
   APP_ERROR_CHECK(err_code);
+  p_request->done_bytes = 0;
+  p_request->compacting = false;
+  if (!p_request->is_write){
+      //a record that is shorter in flash than asked for (e.g. written before the record grew) reads as erased flash past its end.
+      memset(p_request->p_bytes,0xFF,p_request->num_bytes);
+      p_request->step = stepLoad;
+      p_request->entry_record = p_request->record;
+      if (m_log_index[p_request->record] != NO_LOG_ENTRY){
+	  log_entry_header_t const *p_entry = (log_entry_header_t const *)flash_address(log_offset(m_log_index[p_request->record]));
+	  p_request->entry_offset = log_offset(m_log_index[p_request->record]) + sizeof(log_entry_header_t);
+	  p_request->entry_bytes = p_entry->num_bytes < p_request->num_bytes ? p_entry->num_bytes : p_request->num_bytes;
+      }else {
+	  p_request->entry_offset = LEGACY_PAGE * FLASH_PAGE_SIZE + m_flash_records[p_request->record].first_block * BLOCK_SIZE;
+	  p_request->entry_bytes = p_request->num_bytes;
+      }
+      issue_operation();
+      return;
+  }
+  //the write's records go in the segment in use if they fit.  Otherwise the next segment gets the newest version of every record.
+  uint16_t log_free = m_log_free;
+  for (uint8_t record = 0;record < NUM_FLASH_RECORDS;record++){
+      uint8_t const *p_source;
+      pstorage_size_t num_bytes;
+      uint8_t version;
+      pstorage_size_t word;
+      if ((p_request->records & (1 << record)) && entry_source(p_request,record,&p_source,&num_bytes,&version) &&
+	  entry_change(record,p_source,num_bytes,version,&word) == entryAppend){
+	  log_free = entry_start(log_free) + LOG_ENTRY_SIZE(num_bytes);
+      }
+  }
+  if (log_free > LOG_SEGMENT_SIZE){
+      start_compaction(p_request);
+      issue_operation();
+  }else if (next_entry(p_request)){
+      issue_operation();
+  }else {
+      finish_request(p_request->id,NRF_SUCCESS);
+  }
 }
-
 /**
  * \callgraph
  * \brief This is the callback function that pstorage calls back to when a Flash event has completed for the block handle
- * 	  a request was made for.  The callback function is set in ladybug_flash_init() in the pstorage_param.cb parameter
+ * 	  a request was made for.  The callback function is set in ladybug_flash_init() in the pstorage_param.cb parameter.
+ * 	  The request pstorage is working on moves to its next operation, or finishes.
  * \sa	  ladybug_flash_init()
  * @param handle
  * @param op_code
@@ -89,13 +607,6 @@ void ladybug_flash_handler(pstorage_handle_t  * handle,
 			   uint32_t             data_len)
 {
   SEGGER_RTT_WriteString(0,"---> in flash_handler\n");
-  //check if there is an error.  If so, the code will go to the error handler
-  APP_ERROR_CHECK(result);
-  //now that the error has been checked, set the waiting flag to "off" since
-  //this is a way to let the code that made the flash action request that the
-  //request is finished.
-  //since i am using only one block, i don't need to associate with a block id...
-  m_mypstorage_wait_flag = 0;
   //for testing purposes, see what op code was being handled...
   switch (op_code) {
     case PSTORAGE_LOAD_OP_CODE:
@@ -115,10 +626,119 @@ void ladybug_flash_handler(pstorage_handle_t  * handle,
     default:
       break;
   }
+  if (m_num_requests == 0 || m_requests[m_first_request].op_code != op_code || m_requests[m_first_request].block_id != handle->block_id){
+      //left over from a request that timed out.
+      return;
+  }
+  flash_request_t *p_request = &m_requests[m_first_request];
+  if (result != NRF_SUCCESS){
+      finish_request(p_request->id,result);
+      return;
+  }
+  switch (p_request->step) {
+    case stepLoad:
+      memcpy(p_request->p_bytes + p_request->done_bytes,m_staging,p_request->chunk_bytes);
+      p_request->done_bytes += p_request->chunk_bytes;
+      if (p_request->done_bytes == p_request->entry_bytes){
+	  finish_request(p_request->id,m_log_index[p_request->record] == NO_LOG_ENTRY ? LADYBUG_ERROR_FLASH_LEGACY_RECORD : NRF_SUCCESS);
+	  return;
+      }
+      break;
+    case stepErase:
+      p_request->done_bytes++;
+      if (p_request->done_bytes < FLASH_LOG_SEGMENT_PAGES){
+	  break;
+      }
+      //the page header is left erased until every record is in the segment.
+      m_log_segment = (m_log_segment + 1) % FLASH_LOG_SEGMENTS;
+      m_log_free = sizeof(log_page_header_t);
+      m_log_sequence++;
+      next_entry(p_request);
+      break;
+    case stepPageHeader:
+      finish_request(p_request->id,NRF_SUCCESS);
+      return;
+    case stepEntryHeader:
+      p_request->entry_offset += sizeof(log_entry_header_t);
+      p_request->done_bytes = 0;
+      p_request->step = stepEntryData;
+      break;
+    case stepEntryData:
+      p_request->done_bytes += p_request->chunk_bytes;
+      if (p_request->done_bytes < p_request->entry_bytes){
+	  break;
+      }
+      if (!p_request->in_place){
+	  p_request->step = stepEntryCRC;
+	  break;
+      }
+      p_request->records &= ~(1 << p_request->entry_record);
+      if (!next_entry(p_request)){
+	  finish_request(p_request->id,NRF_SUCCESS);
+	  return;
+      }
+      break;
+    case stepEntryCRC:
+      //a record programmed over has its CRC stored before its bytes.
+      if (p_request->in_place){
+	  p_request->step = stepEntryData;
+	  break;
+      }
+      //the version before is left as it is.  This one has a higher sequence.
+      m_log_free = entry_start(m_log_free);
+      m_log_index[p_request->entry_record] = m_log_segment * LOG_SEGMENT_SIZE + m_log_free;
+      m_log_free += LOG_ENTRY_SIZE(p_request->entry_bytes);
+      p_request->records &= ~(1 << p_request->entry_record);
+      if (!next_entry(p_request)){
+	  finish_request(p_request->id,NRF_SUCCESS);
+	  return;
+      }
+      break;
+    default:
+      break;
+  }
+  issue_operation();
+}
+/**
+ * \callgraph
+ * \brief call back for the cache's writes.
+ * @param request	the id of the write
+ * @param err_code	0 if successful
+ */
+static void did_flush(flash_request_id_t request, uint32_t err_code) {
+  if (err_code == 0) {
+      SEGGER_RTT_printf(0,"...Flash flush %d SUCCESS!\n",request);
+  }
+  else {
+      APP_ERROR_HANDLER(err_code);
+  }
 }
 /**
  * \callgraph
- *\brief 	Initialize the blocks of flash memory used for reading/writing.
+ * \brief The debounce timer went off.  If a record was marked dirty less than FLASH_CACHE_DEBOUNCE_MS ago, wait for the rest of the debounce
+ * time (unless the first record was marked dirty FLASH_CACHE_MAX_DELAY_MS ago).  Otherwise write the dirty records.
+ * \note The timer is only started when the first record is marked dirty, so marking records doesn't fill up the app timer's operation queue.
+ * @param p_context
+ */
+static void debounce_timeout_handler(void * p_context) {
+  static const uint32_t app_timer_prescaler = 0;
+  uint32_t now_ticks, since_last_ticks, since_first_ticks;
+  uint32_t err_code = app_timer_cnt_get(&now_ticks);
+  APP_ERROR_CHECK(err_code);
+  app_timer_cnt_diff_compute(now_ticks,m_last_mark_ticks,&since_last_ticks);
+  app_timer_cnt_diff_compute(now_ticks,m_first_mark_ticks,&since_first_ticks);
+  uint32_t debounce_ticks = APP_TIMER_TICKS(FLASH_CACHE_DEBOUNCE_MS,app_timer_prescaler);
+  if (since_last_ticks < debounce_ticks && since_first_ticks < APP_TIMER_TICKS(FLASH_CACHE_MAX_DELAY_MS,app_timer_prescaler)){
+      uint32_t remaining_ticks = debounce_ticks - since_last_ticks;
+      err_code = app_timer_start(m_debounce_timer_id,remaining_ticks < APP_TIMER_MIN_TIMEOUT_TICKS ? APP_TIMER_MIN_TIMEOUT_TICKS : remaining_ticks,NULL);
+      APP_ERROR_CHECK(err_code);
+      return;
+  }
+  ladybug_flash_cache_flush();
+}
+/**
+ * \callgraph
+ *\brief 	Initialize the pages of flash memory used for reading/writing and find the records in the log.
  *\details	Uses Nordic's pstorage software abstraction/API to cleanly access flash when the SoftDevice (for BLE)
  *		is also running.
  */
@@ -126,123 +746,312 @@ void ladybug_flash_init() {
   SEGGER_RTT_WriteString(0,"==> IN ladybug_flash_init\n");
   pstorage_module_param_t pstorage_param;   //Used when registering with pstorage
   pstorage_handle_t	  handle;	    //used to access the chunk-o-flash requested when registering
-  //First thing is to initialize pstorage
-  uint32_t err_code = pstorage_init();
-  //if initialization was not successful, the error routine will be called and the code won't proceed.
+  // Create the timers first, so marking a record dirty works even if the log can't be mounted.  The request timer is started for each
+  // request so a Flash activity that doesn't happen doesn't hang the queue.
+  uint32_t err_code = app_timer_create(&m_timer_id,APP_TIMER_MODE_SINGLE_SHOT, timeout_handler);
+  APP_ERROR_CHECK(err_code);
+  err_code = app_timer_create(&m_debounce_timer_id,APP_TIMER_MODE_SINGLE_SHOT, debounce_timeout_handler);
   APP_ERROR_CHECK(err_code);
-  //Next is to register amount of flash needed.  The smallest amount that can be requested is 16 bytes.  I'm requesting
-  //32 bytes because this is the number of bytes needed for plant_info. Two blocks are used...one for plant info and one for hydro values.  I must make a
-  //block request for the larger amount of bytes
-  pstorage_param.block_size = BLOCK_SIZE;
-  //request three blocks - one will be for pH, one for plant_info, and one for device name
-  pstorage_param.block_count = 3;
+  //The records have to fit in LEGACY_PAGE, where they were kept before the log.  Then a compaction also fits in a segment.  Only the
+  //sensor calibrations grow, with the sensors in the registry (LADYBUG_SENSORS).
+  if (NUM_FLASH_BLOCKS * BLOCK_SIZE > FLASH_PAGE_SIZE){
+      SEGGER_RTT_printf(0,"...the calibrations of %d sensors don't fit in flash\n",NUM_SENSORS);
+      APP_ERROR_HANDLER(LADYBUG_ERROR_SENSOR_REGISTRY);
+      return;
+  }
+  //First thing is to initialize pstorage
+  err_code = pstorage_init();
+  if (err_code != NRF_SUCCESS){
+      APP_ERROR_HANDLER(err_code);
+      return;
+  }
+  //Next is to register amount of flash needed.  Whole pages are registered so a page can be erased without pstorage's swap page.  The
+  //blocks of a registration are consecutive and pstorage hands them out up to the page below its swap page.  The records were kept in
+  //that page before the log, so the log pages come first and it is the last page.
+  pstorage_param.block_size = FLASH_PAGE_SIZE;
+  pstorage_param.block_count = FLASH_LOG_PAGES + 1;
   //assign a callback so know when a command has finished.
   pstorage_param.cb = ladybug_flash_handler;
   err_code = pstorage_register(&pstorage_param, &handle);
-  APP_ERROR_CHECK(err_code);
-  //Then get the handles to the blocks of flash
-  pstorage_block_identifier_get(&handle, 0, &m_block_calibration_store_handle);
-  pstorage_block_identifier_get(&handle,1,&m_block_plantInfo_store_handle);
-  pstorage_block_identifier_get(&handle,2,&m_block_device_name_store_handle);
-  // Create the timer.  This will be called before a Flash activity is requested to avoid forever hanging.
-  create_timer();
-
+  //without the pages there is nothing to mount.  The records read as erased and aren't written.
+  if (err_code != NRF_SUCCESS){
+      APP_ERROR_HANDLER(err_code);
+      return;
+  }
+  //pstorage only erases a page without its swap page if the clear starts on the page and is the whole page.
+  if (handle.block_id % PSTORAGE_FLASH_PAGE_SIZE != 0 || PSTORAGE_FLASH_PAGE_SIZE != FLASH_PAGE_SIZE ||
+      handle.block_id + LEGACY_PAGE * FLASH_PAGE_SIZE != PSTORAGE_SWAP_ADDR - PSTORAGE_FLASH_PAGE_SIZE){
+      APP_ERROR_HANDLER(LADYBUG_ERROR_FLASH_LAYOUT);
+      return;
+  }
+  //The handles to the pages of flash are figured out from the base handle when a record is read or written.
+  m_base_store_handle = handle;
+  mount_log();
+  m_mounted = true;
+}
+/**
+ * \callgraph
+ * \brief Check a request and put it on the queue.  pstorage starts on it right away if the queue was empty.
+ * @param record	the record, or FLASH_NO_RECORD for the cache's flush of the records in records.
+ * @return the request's id, or FLASH_NO_REQUEST if the request is bad or the queue is full.
+ */
+static flash_request_id_t queue_request(uint8_t record, bool is_write, uint16_t records, uint8_t *p_bytes, pstorage_size_t num_bytes,
+					flash_done_t did_flash_action) {
+  if (record != FLASH_NO_RECORD){
+      if (p_bytes == NULL){
+	  APP_ERROR_HANDLER(LADYBUG_ERROR_NULL_POINTER);
+	  return FLASH_NO_REQUEST;
+      }
+      if (num_bytes <= 0){
+	  APP_ERROR_HANDLER(LADYBUG_ERROR_NUM_BYTES_TO_WRITE);
+	  return FLASH_NO_REQUEST;
+      }
+      if (record >= NUM_FLASH_RECORDS || m_flash_records[record].num_blocks == 0){
+	  //this is an error case.  The function doesn't know what to read or write.
+	  APP_ERROR_HANDLER(is_write ? LADYBUG_ERROR_INVALID_COMMAND : LADYBUG_ERROR_FLASH_UNSURE_WHAT_DATA_TO_READ);
+	  return FLASH_NO_REQUEST;
+      }
+      if (num_bytes > m_flash_records[record].num_blocks * BLOCK_SIZE){
+	  APP_ERROR_HANDLER(LADYBUG_ERROR_NUM_BYTES_TO_WRITE);
+	  return FLASH_NO_REQUEST;
+      }
+      records = is_write ? 1 << record : 0;
+  }
+  flash_request_id_t id = FLASH_NO_REQUEST;
+  bool start_now = false;
+  CRITICAL_REGION_ENTER();
+  //a write of the same bytes (or a flush) that hasn't started yet will store what the bytes are when it gets to them, so this write is
+  //folded into it.
+  for (uint8_t i = 1; i < m_num_requests && is_write; i++){
+      flash_request_t *p_waiting = &m_requests[(m_first_request + i) % FLASH_QUEUE_DEPTH];
+      if (p_waiting->is_write && p_waiting->record == record && p_waiting->p_bytes == p_bytes &&
+	  p_waiting->num_bytes == num_bytes && p_waiting->did_flash_action == did_flash_action){
+	  p_waiting->records |= records;
+	  id = p_waiting->id;
+	  break;
+      }
+  }
+  if (id == FLASH_NO_REQUEST && m_num_requests < FLASH_QUEUE_DEPTH){
+      id = m_next_request_id++;
+      if (m_next_request_id == FLASH_NO_REQUEST){
+	  m_next_request_id++;
+      }
+      flash_request_t *p_request = &m_requests[(m_first_request + m_num_requests) % FLASH_QUEUE_DEPTH];
+      p_request->id = id;
+      p_request->record = record;
+      p_request->is_write = is_write;
+      p_request->records = records;
+      p_request->op_code = 0;
+      p_request->p_bytes = p_bytes;
+      p_request->num_bytes = num_bytes;
+      p_request->did_flash_action = did_flash_action;
+      m_num_requests++;
+      start_now = (m_num_requests == 1);
+  }
+  CRITICAL_REGION_EXIT();
+  if (id == FLASH_NO_REQUEST){
+      APP_ERROR_HANDLER(LADYBUG_ERROR_FLASH_QUEUE_FULL);
+      return FLASH_NO_REQUEST;
+  }
+  if (start_now){
+      start_request();
+  }
+  return id;
 }
-
 /***
  * The Ladybug stores info that is maintained across restarts of the device.  This info includes the device name, plant info (type of plant and growth stage), as well as
- * calibration values.  This function figures out what block handle has been initialized based on what info has been requested to read, reads the info from flash, then writes
- * the info to the p_bytes_to_read memory buffer.
+ * calibration values.  This function queues a read of the record asked for into the p_bytes_to_read memory buffer and returns right away.
  * @param data_to_read  		let the function know what type of data to read
- * @param p_bytes_to_read	give the function a buffer to write the data after reading from flash
+ * @param p_bytes_to_read	give the function a buffer to write the data after reading from flash.  Must stay around until the read is done.
+ * @param num_bytes_to_read	the number of bytes to read.  Must fit in the blocks set aside for the record and be no bigger than the buffer p_bytes_to_read points to.
+ * @param did_flash_action	called with the request's id once the read is done (or failed).  Can be NULL.
+ * @return			the request's id to match with the callback or to pass to ladybug_flash_wait().  FLASH_NO_REQUEST if the request wasn't queued.
  * @sa	LADYBUG_ERROR_UNSURE_WHAT_DATA_TO_READ
  */
-void ladybug_flash_read(flash_rw_t data_to_read,uint8_t *p_bytes_to_read,void(*did_flash_action)(uint32_t err_code)){
+flash_request_id_t ladybug_flash_read(flash_rw_t data_to_read,uint8_t *p_bytes_to_read,pstorage_size_t num_bytes_to_read,flash_done_t did_flash_action){
   SEGGER_RTT_WriteString(0,"==> IN ladybug_flash_read\n");
-  pstorage_handle_t * p_handle;
-  m_flash_return = did_flash_action;
-  //set the block handle to the block of flash set aside in flash_init for the data type to read
-  //point the bytes to the location holding the bytes in memory.
-  switch (data_to_read) {
-    case plantInfo:
-      p_handle = &m_block_plantInfo_store_handle;
-      break;
-    case calibrationValues:
-      p_handle = &m_block_calibration_store_handle;
-      break;
-    case deviceName:
-      p_handle = &m_block_device_name_store_handle;
-      break;
-    default:
-      //this is an error case.  The function doesn't know what to read.
-      APP_ERROR_CHECK(LADYBUG_ERROR_FLASH_UNSURE_WHAT_DATA_TO_READ);
-      break;
-  }
-  // There is a chance the Flash activity doesn't happen so we use a timer to prevent waiting forever.
-  m_mypstorage_wait_flag = 1;
-  start_timer();
-  uint32_t err_code = pstorage_load(p_bytes_to_read, p_handle, BLOCK_SIZE, 0);
-  while(m_mypstorage_wait_flag) { }
-  APP_ERROR_CHECK(err_code);
-  // Flash activity completed so stop timer.
-  stop_timer();
+  return queue_request(data_to_read,false,0,p_bytes_to_read,num_bytes_to_read,did_flash_action);
 }
 /**
  * \callgraph
- * \brief	When the Ladybug needs to store info, it calls the flash_write routine.
- * \details	This routine assumes the flash storage to be used has been initialized by a call to flash_init.  Match the handle to
- * 		flash storage to the info the caller wants to write.
- * \note		As directed by the nRF51822 documentation, the flash storage is first cleared before a write to flash happens.
+ * \brief	When the Ladybug needs to store info, it calls the flash_write routine.  The write is queued and the function returns right away.
+ * \details	This routine assumes the flash storage to be used has been initialized by a call to flash_init.  A new version of the record is
+ * 		appended to the log.
  * @param what_data_to_write	Whether to write out plant info, calibration values, or the device name.
- * @param p_bytes_to_write	A pointer to the bytes to be written to flash.
+ * @param p_bytes_to_write	A pointer to the bytes to be written to flash.  They are read as pstorage gets to them, so they must stay around until the write is done.
  * @param num_bytes_to_write	The number of bytes to write to flash
- * @param did_flash_action	Function caller passes in to be informed of the outcome of the Flash request.  The pointer to the function must be valid.
+ * @param did_flash_action	called with the request's id once the write is done (or failed).  Can be NULL.
+ * @return			the request's id.  FLASH_NO_REQUEST if the request wasn't queued.
  */
-void ladybug_flash_write(flash_rw_t what_data_to_write, uint8_t *p_bytes_to_write,pstorage_size_t num_bytes_to_write,void(*did_flash_action)(uint32_t err_code)){
+flash_request_id_t ladybug_flash_write(flash_rw_t what_data_to_write, uint8_t *p_bytes_to_write,pstorage_size_t num_bytes_to_write,flash_done_t did_flash_action){
   SEGGER_RTT_WriteString(0,"==> IN ladybug_flash_write\n");
-  // Check parameters.  The what_data_to_write param is checked below in the switch statement.
-  if (p_bytes_to_write == NULL || (did_flash_action == NULL)){
+  return queue_request(what_data_to_write,true,0,p_bytes_to_write,num_bytes_to_write,did_flash_action);
+}
+/**
+ * \callgraph
+ * \brief Where a record's newest good version is in flash.  The flash is memory mapped, so the record can be read through the pointer
+ * 	  right away - no pstorage load, no timer, no waiting.
+ * \note	The version's CRC was checked when the log was mounted (or it was written since).  The pointer is good until the record is
+ * 		written again: a write appends a new version, and a compaction later erases the segment the old one is in.  Copy the bytes out
+ * 		to keep them.
+ * @param record
+ * @param p_bytes	set to the record's bytes in flash
+ * @param p_num_bytes	set to how many bytes the version has.  Bytes past these (up to the record's size) are erased flash.
+ * @param p_version	set to the version of the record's layout the bytes are in.  It can be older than the code's (see Ladybug_Hydro.h).
+ * @return		NRF_SUCCESS if the record is in the log.  LADYBUG_ERROR_FLASH_LEGACY_RECORD if it is in the block it was kept in before
+ * 			the log.  NRF_ERROR_INVALID_STATE if the flash couldn't be registered (there is nothing to read).
+ */
+uint32_t ladybug_flash_map(flash_rw_t record, uint8_t const **p_bytes, pstorage_size_t *p_num_bytes, uint8_t *p_version) {
+  if (p_bytes == NULL || p_num_bytes == NULL || p_version == NULL){
       APP_ERROR_HANDLER(LADYBUG_ERROR_NULL_POINTER);
+      return LADYBUG_ERROR_NULL_POINTER;
   }
-  if (num_bytes_to_write <= 0){
-      APP_ERROR_HANDLER(LADYBUG_ERROR_NUM_BYTES_TO_WRITE);
+  if (record >= NUM_FLASH_RECORDS || m_flash_records[record].num_blocks == 0){
+      APP_ERROR_HANDLER(LADYBUG_ERROR_FLASH_UNSURE_WHAT_DATA_TO_READ);
+      return LADYBUG_ERROR_FLASH_UNSURE_WHAT_DATA_TO_READ;
   }
-  // Set the static variable used to hold the location of the callback function to the pointer passed in by the caller.
-  m_flash_return = did_flash_action;
-  // Must clear the Flash block before write (or get unpredictable results).
-
-  pstorage_handle_t *p_handle;
-  switch (what_data_to_write) {
-    case plantInfo:
-      p_handle = &m_block_plantInfo_store_handle;
-      break;
-    case calibrationValues:
-      p_handle = &m_block_calibration_store_handle;
-      break;
-    case deviceName:
-      p_handle = &m_block_device_name_store_handle;
-      break;
-    default:
+  //ladybug_flash_init() has already reported why there is no log.
+  if (!m_mounted){
+      return NRF_ERROR_INVALID_STATE;
+  }
+  uint16_t log_position;
+  //the index changes in ladybug_flash_handler() when a write finishes.
+  CRITICAL_REGION_ENTER();
+  log_position = m_log_index[record];
+  CRITICAL_REGION_EXIT();
+  if (log_position == NO_LOG_ENTRY){
+      *p_bytes = flash_address(LEGACY_PAGE * FLASH_PAGE_SIZE + m_flash_records[record].first_block * BLOCK_SIZE);
+      *p_num_bytes = m_flash_records[record].num_blocks * BLOCK_SIZE;
+      *p_version = 0;
+      return LADYBUG_ERROR_FLASH_LEGACY_RECORD;
+  }
+  log_entry_header_t const *p_entry = (log_entry_header_t const *)flash_address(log_offset(log_position));
+  *p_bytes = (uint8_t const *)(p_entry + 1);
+  *p_num_bytes = p_entry->num_bytes;
+  *p_version = LOG_ENTRY_VERSION(p_entry);
+  return NRF_SUCCESS;
+}
+/**
+ * \callgraph
+ * \brief Wait for a request to finish.  Used at start up, where the records are needed before going on.
+ * \note	Only call from the main context (not from an interrupt or event handler).  The request finishes in the SoftDevice's event
+ * 		interrupt, which can't happen while that interrupt (or a higher priority one) waits.
+ * @param request	the id ladybug_flash_read() or ladybug_flash_write() returned.
+ * @return		the request's err_code.  0 if successful.
+ */
+uint32_t ladybug_flash_wait(flash_request_id_t request) {
+  if (request == FLASH_NO_REQUEST){
+      return LADYBUG_ERROR_INVALID_COMMAND;
+  }
+  if (__get_IPSR() != 0){
+      APP_ERROR_HANDLER(LADYBUG_ERROR_FLASH_WAIT_IN_INTERRUPT);
+      return LADYBUG_ERROR_FLASH_WAIT_IN_INTERRUPT;
+  }
+  //requests finish in order, so the request is done once the last one to finish is it or a later one.
+  while ((int8_t)(m_last_finished_id - request) < 0) { }
+  return m_results[request % FLASH_QUEUE_DEPTH];
+}
+/**
+ * \callgraph
+ * \brief Register the RAM copy of a record with the write-back cache.  Call once the record has been read.  The RAM copy is what gets
+ * written when the record is dirty (and when the log is compacted), so it must stay around.
+ * @param record	the record
+ * @param p_bytes	the RAM copy
+ * @param num_bytes	how many bytes of the RAM copy are written.  Must fit in the blocks set aside for the record.
+ */
+void ladybug_flash_cache_record(flash_rw_t record, uint8_t *p_bytes, pstorage_size_t num_bytes) {
+  if (p_bytes == NULL){
+      APP_ERROR_HANDLER(LADYBUG_ERROR_NULL_POINTER);
+      return;
+  }
+  if (record >= NUM_FLASH_RECORDS || m_flash_records[record].num_blocks == 0){
       APP_ERROR_HANDLER(LADYBUG_ERROR_INVALID_COMMAND);
-      break;
+      return;
+  }
+  if (num_bytes <= 0 || num_bytes > m_flash_records[record].num_blocks * BLOCK_SIZE){
+      APP_ERROR_HANDLER(LADYBUG_ERROR_NUM_BYTES_TO_WRITE);
+      return;
   }
-  //clearing the pstorage/flash sets the bytes to 0xFF
-  // m_mypstorage_wait_flag is set to 0 within ladybug_flash_handler().  This way the system lets us know the Flash activity happened.
-  m_mypstorage_wait_flag = 1;
-  // There is a chance the Flash activity doesn't happen so we use a timer to prevent waiting forever.
-  start_timer();
-  uint32_t err_code = pstorage_clear(p_handle, BLOCK_SIZE);
-  while(m_mypstorage_wait_flag) {  }
+  CRITICAL_REGION_ENTER();
+  m_cache[record].p_bytes = p_bytes;
+  m_cache[record].num_bytes = num_bytes;
+  CRITICAL_REGION_EXIT();
+}
+/**
+ * \callgraph
+ * \brief The RAM copy of a record has changed.  The record is written with the other dirty records once the changes stop for
+ * FLASH_CACHE_DEBOUNCE_MS.
+ * \note Can be called from any context.
+ * @param record	a record registered with ladybug_flash_cache_record()
+ */
+void ladybug_flash_mark_dirty(flash_rw_t record) {
+  if (record >= NUM_FLASH_RECORDS || m_cache[record].p_bytes == NULL){
+      APP_ERROR_HANDLER(LADYBUG_ERROR_FLASH_NOT_CACHED);
+      return;
+  }
+  uint32_t now_ticks;
+  uint32_t err_code = app_timer_cnt_get(&now_ticks);
   APP_ERROR_CHECK(err_code);
-  // The flash action happened, so turn off the timer before it goes off.
-  stop_timer();
-  // Start the timer up again to timeout if writing to flash doesn't happen
-  start_timer();
-  m_mypstorage_wait_flag = 1;
-  err_code = pstorage_store(p_handle, p_bytes_to_write, num_bytes_to_write, 0);
-  while(m_mypstorage_wait_flag) {  }
+  bool was_clean;
+  CRITICAL_REGION_ENTER();
+  was_clean = (m_dirty_records == 0);
+  m_dirty_records |= 1 << record;
+  m_marks_since_flush++;
+  m_cache_stats.marks++;
+  m_last_mark_ticks = now_ticks;
+  if (was_clean){
+      m_first_mark_ticks = now_ticks;
+  }
+  CRITICAL_REGION_EXIT();
+  if (was_clean){
+      static const uint32_t app_timer_prescaler = 0;
+      err_code = app_timer_start(m_debounce_timer_id,APP_TIMER_TICKS(FLASH_CACHE_DEBOUNCE_MS,app_timer_prescaler),NULL);
+      APP_ERROR_CHECK(err_code);
+  }
+}
+/**
+ * \callgraph
+ * \brief Write the dirty records now.  They are appended to the log in one request, so there is at most one compaction (if the segment fills up).
+ */
+void ladybug_flash_cache_flush(void) {
+  uint16_t dirty_records;
+  uint16_t marks;
+  //stopped before the dirty records are taken so a record marked after that starts the timer again.
+  uint32_t err_code = app_timer_stop(m_debounce_timer_id);
   APP_ERROR_CHECK(err_code);
-  stop_timer();
+  CRITICAL_REGION_ENTER();
+  dirty_records = m_dirty_records;
+  marks = m_marks_since_flush;
+  m_dirty_records = 0;
+  m_marks_since_flush = 0;
+  CRITICAL_REGION_EXIT();
+  //without the log the changes can't be kept.
+  if (dirty_records == 0 || !m_mounted){
+      return;
+  }
+  if (queue_request(FLASH_NO_RECORD,true,dirty_records,NULL,0,did_flush) == FLASH_NO_REQUEST){
+      //the queue is full.  The records are still dirty and are written on the next flush.
+      restore_dirty(dirty_records,marks);
+      return;
+  }
+  m_cache_stats.flushes++;
+  flashCacheStats_t stats;
+  ladybug_flash_cache_stats(&stats);
+  SEGGER_RTT_printf(0,"...flash flush.  dirty records: 0x%x, marks: %d.  Erases so far: %d (%d saved) and stores: %d for %d marks.  Unchanged: %d, in place: %d\n",
+		    dirty_records,marks,stats.erases,stats.erases_saved,stats.stores,stats.marks,stats.unchanged,stats.in_place);
+  SEGGER_RTT_WriteString(0,"...erases of each log page:");
+  for (uint8_t page = 0;page < FLASH_LOG_PAGES;page++){
+      SEGGER_RTT_printf(0," %d",stats.log_page_erases[page]);
+  }
+  SEGGER_RTT_WriteString(0,"\n");
+}
+/**
+ * \brief How well the cache and the log are saving erases since start up.
+ */
+void ladybug_flash_cache_stats(flashCacheStats_t *p_stats) {
+  CRITICAL_REGION_ENTER();
+  *p_stats = m_cache_stats;
+  CRITICAL_REGION_EXIT();
+  //each mark used to be a clear and a store of its record.
+  p_stats->erases_saved = p_stats->marks > p_stats->erases ? p_stats->marks - p_stats->erases : 0;
 }
-
-
@@ -0,0 +1,85 @@
+/**
+ * \file		Ladybug_Forecast.c
+ * \brief	The sliding window least squares slope and the time to threshold.
+ * \details	With n readings y[0..n-1] at places 0..n-1, slope = (n * sum_iy - sum_i * sum_y) / (n * sum_ii - sum_i * sum_i).  When the
+ * 		window is full and a reading is added, every reading moves down a place, so sum_iy loses sum_y (less the oldest reading,
+ * 		which was at place 0) and gains (n-1) * the new reading.
+ * \sa		Ladybug_Forecast.h
+ */
+#include <stddef.h>
+#include "Ladybug_Forecast.h"
+#include "Ladybug_Fixed.h"
+
+void ladybug_forecast_reset(forecast_t *p_forecast) {
+  p_forecast->count = 0;
+  p_forecast->oldest = 0;
+  p_forecast->sum_y = 0;
+  p_forecast->sum_iy = 0;
+}
+
+void ladybug_forecast_add(forecast_t *p_forecast, uint16_t reading) {
+  if (p_forecast->count < FORECAST_WINDOW) {
+      p_forecast->sum_iy += (int32_t)p_forecast->count * reading;
+      p_forecast->sum_y += reading;
+      p_forecast->readings[(p_forecast->oldest + p_forecast->count) % FORECAST_WINDOW] = reading;
+      p_forecast->count++;
+      return;
+  }
+  uint16_t oldest = p_forecast->readings[p_forecast->oldest];
+  p_forecast->sum_iy += (int32_t)(FORECAST_WINDOW - 1) * reading - (p_forecast->sum_y - oldest);
+  p_forecast->sum_y += (int32_t)reading - oldest;
+  p_forecast->readings[p_forecast->oldest] = reading;
+  p_forecast->oldest = (p_forecast->oldest + 1) % FORECAST_WINDOW;
+}
+/**
+ * \callgraph
+ * @return the slope in Q8 (reading units * 256) per reading.  0 if there aren't FORECAST_MIN_READINGS readings.
+ */
+int32_t ladybug_forecast_slope_q8(forecast_t const *p_forecast) {
+  int32_t n = p_forecast->count;
+  if (n < FORECAST_MIN_READINGS) {
+      return 0;
+  }
+  int32_t sum_i = n * (n - 1) / 2;
+  int32_t sum_ii = (n - 1) * n * (2 * n - 1) / 6;
+  int64_t numerator = (int64_t)n * p_forecast->sum_iy - (int64_t)sum_i * p_forecast->sum_y;
+  int32_t denominator = n * sum_ii - sum_i * sum_i;
+  return (int32_t)((numerator << 8) / denominator);
+}
+/**
+ * \callgraph
+ * \brief How many more readings until the fitted line crosses the low or the high threshold.
+ * @param p_forecast	the window
+ * @param low		the low threshold.  0 is off.
+ * @param high		the high threshold.  0 is off.
+ * @param p_readings	the number of readings.  0 if the fitted line is already beyond the threshold.  FORECAST_UNKNOWN when heading nowhere.
+ * @return		which threshold the reading is heading for
+ */
+forecast_heading_t ladybug_forecast_readings_to_threshold(forecast_t const *p_forecast, uint16_t low, uint16_t high, uint16_t *p_readings) {
+  *p_readings = FORECAST_UNKNOWN;
+  int32_t slope_q8 = ladybug_forecast_slope_q8(p_forecast);
+  if (slope_q8 == 0) {
+      return headingNowhere;
+  }
+  //the fitted line at the newest reading: the mean plus the slope times the distance from the middle place, (n-1)/2.
+  int32_t n = p_forecast->count;
+  int32_t newest_q8 = ladybug_fixed_div_small(p_forecast->sum_y << 8,n) + slope_q8 * (n - 1) / 2;
+  int32_t threshold;
+  forecast_heading_t heading;
+  if (slope_q8 < 0) {
+      if (low == 0) {
+	  return headingNowhere;
+      }
+      threshold = low;
+      heading = headingLow;
+  } else {
+      if (high == 0) {
+	  return headingNowhere;
+      }
+      threshold = high;
+      heading = headingHigh;
+  }
+  int32_t readings = ((threshold << 8) - newest_q8) / slope_q8;
+  *p_readings = readings <= 0 ? 0 : (readings >= FORECAST_UNKNOWN ? FORECAST_UNKNOWN - 1 : readings);
+  return heading;
+}
@@ -4,7 +4,6 @@
  * \author	Margaret Johnson
  * \version	1.0
  * \brief	Handles pH and EC mV readings from the AIN and to/from Flash as needed by the client.
- * \todo		Take multiple measurements (e.g.: 2 mins) when reading calibration measurements, until readings converge.
  */
 #define	DEBUG	///< Used in app_error.h to give line / function name input.
 #include "string.h"
@@ -14,120 +13,520 @@
 #include "softdevice_handler.h"
 #include "ble_advertising.h"
 #include "app_error.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
 #include "Ladybug_Error.h"
 #include "Ladybug_Flash.h"
 #include "Ladybug_ADC.h"
 #include "Ladybug_Hydro.h"
+#include "Ladybug_Stats.h"
+#include "Ladybug_Time.h"
+#include "Ladybug_Plants.h"
+#include "Ladybug_Sensors.h"
+#include "Ladybug_Fixed.h"
 
 #include "SEGGER_RTT.h"
 
 
-extern ADC_interface adc;
-static uint8_t			 m_write_calibration_values = false; ///<flag to let main know to write the hydro structure to flash because calibration values have been updated.
-static uint8_t			 m_write_plantInfo_values = false;
-static uint8_t			 m_write_device_name = false;
-static storePlantInfo_t		 m_storePlantInfo;
-static storeCalibrationValues_t	 m_storeCalibrationValues;
-static measurements_t		 m_measurements;
-static char 			 m_device_name[DEVNAME_MAX_LEN]; ///<The length of the device name cannot be greater than BLE_GAP_DEVNAME_MAX_LEN.  See [this blog post](https://devzone.nordicsemi.com/question/24669/feedback-ble_gap_devname_max_len-is-too-short/)
-
 /**
- * \brief mapping the FET pins to the schematic
+ * \brief Everything the Ladybug keeps in flash.  It is loaded and checked in one pass at boot (load_persistent_state()) and the other
+ * modules query it through the ladybug_get_... functions.  Each store is also the record's RAM copy in the flash's write-back cache.
+ */
+static struct {
+  storePlantInfo_t		storePlantInfo;
+  storeCalibrationValues_t	storeCalibrationValues;
+  storeSamplingConfig_t		storeSamplingConfig;
+  storeECcalibrationTable_t	storeECcalibrationTable;
+  storeCalibrationHistory_t	storeCalibrationHistory;
+  storeAlarmConfig_t		storeAlarmConfig;
+  storeSensorCalibrations_t	storeSensorCalibrations;
+  storeProbeHealthTrend_t	storeProbeHealthTrend;
+  char				device_name[DEVNAME_MAX_LEN]; ///<The length of the device name cannot be greater than BLE_GAP_DEVNAME_MAX_LEN.  See [this blog post](https://devzone.nordicsemi.com/question/24669/feedback-ble_gap_devname_max_len-is-too-short/)
+}m_persistent;
+static volatile uint8_t		 m_alarms;
+static plantTarget_t const * volatile m_p_plant_target; ///<the targets of the plant in plantInfo.  NULL if the plant isn't known.
+static volatile uint8_t		 m_take_scheduled_measurement = false; ///<set by the sampling timer, cleared by the main loop when it takes the measurement.
+static volatile uint8_t		 m_take_requested_measurement = false; ///<set when the client sends updatePHandEC.
+static measurements_t		 m_last_notified_measurements;  ///<what the client was last told.  Used to decide if a scheduled measurement is worth a notification.
+static app_timer_id_t		 m_sampling_timer_id;
+static app_timer_id_t		 m_settling_timer_id;
+static settling_t		 m_settling;
+/**
+ * \brief The pH line fitted through the pH calibration points, kept as the sums a measurement needs.  num_points is 0 when the points
+ * don't give a pH (the mV don't drop as the pH goes up).
+ */
+static struct {
+  int32_t	sum_pH_x100;
+  int32_t	sum_mV;
+  int32_t	Sxx;			///<n * sum(pH_x100^2) - sum(pH_x100)^2
+  int32_t	Sxy;			///<n * sum(pH_x100 * mV) - sum(pH_x100) * sum(mV)
+  int32_t	pH_x100_per_mV_q16;	///<Sxx / Sxy in Q16
+  int16_t	pH7_mV;			///<where the line crosses pH7
+  uint8_t	num_points;
+}m_pH_line;
+static forecast_t		 m_pH_forecast;		///<pH * 100 of the scheduled measurements
+static forecast_t		 m_EC_forecast;		///<EC µS of the scheduled measurements
+static volatile uint8_t		 m_calibration_command;		///<the calibration waiting to be made
+static volatile uint16_t	 m_calibration_solution;
+static volatile uint8_t		 m_calibration_sensor;		///<for calibrateSensor, the sensor and the point being calibrated
+static volatile uint8_t		 m_calibration_point;
+static volatile bool		 m_calibration_waits;		///<true if the calibration waits for the reading to settle
+static volatile bool		 m_calibration_pending = false;
+static volatile bool		 m_take_calibration_step = false;	///<set by the settling timer and by a calibration request.  Polled by main.
+static uint16_t			 m_settling_elapsed_s;
+static uint16_t			 m_sampling_ticks_per_measurement; ///<number of sampling timer ticks between measurements
+static uint16_t			 m_sampling_ticks_remaining;
+/**
+ * \brief The measurements are double buffered.  ladybug_take_measurements() fills the buffer readers are NOT looking at (the back buffer)
+ * and then publishes it by flipping m_front_measurements and bumping m_measurements_sequence.  A reader copies the front buffer and
+ * checks the sequence did not change while it was copying.  This way a client read never gets the pH from one sample and the EC from another,
+ * and interrupts are never disabled while the (slow) ADC readings are taken.
  */
-static uint32_t	m_EC_VIN_FET	=	0;
-static uint32_t m_EC_VOUT_FET	=	7;
+static measurements_t		 m_measurements[2];
+static sensorMeasurements_t	 m_sensor_measurements[2];	///<published along with m_measurements
+static volatile uint8_t		 m_front_measurements = 0; ///<index into m_measurements[] of the most recently published snapshot.
+static volatile uint32_t	 m_measurements_sequence = 0; ///<incremented every time a new snapshot is published.
+/**
+ * \brief Running statistics of each reading since the last time the statistics were reported.
+ */
+static welford_t		 m_pH_statistics;
+static welford_t		 m_EC_VIN_statistics;
+static welford_t		 m_EC_VOUT_statistics;
+
 /**
  * \callgraph
  * \brief used during debugging to find out what the calibration values are
  */
 static void print_out_calibration_values() {
   SEGGER_RTT_WriteString(0,"***** CALIBRATION VALUES *****\n");
-  SEGGER_RTT_printf(0,"size of m_storeCalibrationValues: %d\n",sizeof(m_storeCalibrationValues));
-  SEGGER_RTT_printf(0,"write_check: 0X%x\n",m_storeCalibrationValues.write_check);
+  SEGGER_RTT_printf(0,"size of m_persistent.storeCalibrationValues: %d\n",sizeof(m_persistent.storeCalibrationValues));
+  SEGGER_RTT_printf(0,"write_check: 0X%x\n",m_persistent.storeCalibrationValues.write_check);
 
-  SEGGER_RTT_printf(0,"pH4_mV: %d, pH7_mV: %d\n",m_storeCalibrationValues.calValues.pH4_mV,m_storeCalibrationValues.calValues.pH7_mV);
+  SEGGER_RTT_printf(0,"pH4_mV: %d, pH7_mV: %d\n",m_persistent.storeCalibrationValues.calValues.pH4_mV,m_persistent.storeCalibrationValues.calValues.pH7_mV);
+  SEGGER_RTT_printf(0,"pH10_mV: %d, number of pH points: %d\n",m_persistent.storeCalibrationValues.pHFit.pH10_mV,m_persistent.storeCalibrationValues.pHFit.num_points);
   SEGGER_RTT_printf(0,"EC1_mV[0]: %d, EC1_mV[1]: %d, EC2_mV[0]: %d, EC2[1]\n",
-		    m_storeCalibrationValues.calValues.EC1_mV[0],m_storeCalibrationValues.calValues.EC1_mV[1],
-		    m_storeCalibrationValues.calValues.EC2_mV[0],m_storeCalibrationValues.calValues.EC2_mV[1]);
-  SEGGER_RTT_printf(0,"EC1solution: %d, EC2solution: %d\n", m_storeCalibrationValues.calValues.EC1solution,m_storeCalibrationValues.calValues.EC2solution);
+		    m_persistent.storeCalibrationValues.calValues.EC1_mV[0],m_persistent.storeCalibrationValues.calValues.EC1_mV[1],
+		    m_persistent.storeCalibrationValues.calValues.EC2_mV[0],m_persistent.storeCalibrationValues.calValues.EC2_mV[1]);
+  SEGGER_RTT_printf(0,"EC1solution: %d, EC2solution: %d\n", m_persistent.storeCalibrationValues.calValues.EC1solution,m_persistent.storeCalibrationValues.calValues.EC2solution);
 }
 /**
- * \callgraph
- * \brief call back from Ladybug_Flash.c to let us know if the flash read was successful (or not)
- * @param err_code	0 if successful
+ * \brief Copy a record out of the memory mapped flash.  Bytes the version in flash doesn't have (it was written before the record grew) are
+ * 0xFF, as if read from erased flash.
+ * @param p_version	set to the version of the layout the record was written in
+ * @return the ladybug_flash_map() result
  */
-void did_flash_read(uint32_t err_code) {
-  if (err_code == 0) {
-      SEGGER_RTT_WriteString(0,"...Flash read SUCCESS!");
-  }
-  else {
-      APP_ERROR_HANDLER(err_code);
+static uint32_t copy_record(flash_rw_t record, void *p_store, pstorage_size_t num_bytes, uint8_t *p_version) {
+  uint8_t const *p_flash;
+  pstorage_size_t num_bytes_in_flash;
+  uint32_t err_code = ladybug_flash_map(record,&p_flash,&num_bytes_in_flash,p_version);
+  memset(p_store,0xFF,num_bytes);
+  if (err_code == NRF_SUCCESS || err_code == LADYBUG_ERROR_FLASH_LEGACY_RECORD){
+      memcpy(p_store,p_flash,num_bytes_in_flash < num_bytes ? num_bytes_in_flash : num_bytes);
   }
+  return err_code;
 }
 /**
- * \brief The rectifier circuit for both EC VIN and VOUT have a FET attached to drain the cap as the cap will inevitably discharge causing voltage readings to be higher than they
- * actually are.  This is a standard "thing" for a rectifier circuit.  As I understand it, many rectifiers use a resistor but I felt using a FET would get a better ADC reading.
- * @param which_AIN	Either the AIN assigned to EC_VIN or EC_VOUTa
+ * \callgraph
+ * \brief Bring a record that was written in an older layout up to the layout in Ladybug_Hydro.h (see CALIBRATION_VALUES_VERSION).  Each
+ * step goes up one version, so a record any number of versions old is migrated.  Bytes a shorter layout didn't have are 0xFF.
+ * \note A record that a step leaves the same isn't written.  It keeps its old version in flash until it is written for another reason, so
+ * 	 a new version doesn't cost an erase at boot.
+ * @param version	the version of the layout the record was written in
+ * @return true if the record changed and has to be written.
  */
-static void discharge (uint8_t which_AIN)
-{
-  if (EC_VIN != which_AIN && EC_VOUT != which_AIN) {
-      APP_ERROR_HANDLER(LADYBUG_ERROR_INVALID_COMMAND);
+static bool migrate_record(flash_rw_t record, uint8_t version, void *p_store) {
+  bool changed = false;
+  switch (record){
+    case calibrationValues:
+      if (version < 1){
+	  //calibration values written before there was a pH10 point have erased flash where the fit is.
+	  pHFit_t *p_fit = &((storeCalibrationValues_t *)p_store)->pHFit;
+	  if (p_fit->num_points != 2 && p_fit->num_points != 3){
+	      memset(p_fit,0,sizeof(pHFit_t));
+	      p_fit->num_points = 2;
+	      changed = true;
+	  }
+      }
+      break;
+    default:
+      //the other records are still in their first layout.
+      break;
   }
-  uint32_t pin_number;
-  //set the GPIO based on whether the current ADC reading is for the VIN or VOUT
-  if (EC_VIN == which_AIN) {
-      pin_number = m_EC_VIN_FET;
+  return changed;
+}
+/**
+ * \callgraph
+ * \brief Read a record from flash into its RAM copy and hand the RAM copy to the flash's write-back cache.  A change to the RAM copy is
+ * then written by marking the record dirty (ladybug_flash_mark_dirty()).
+ * \note The RAM copy is kept (rather than reading through the pointer into flash) because it is what the client's writes change and
+ * 	 what the BLE characteristics point to.
+ * @param p_write_check	the record's write_check (in the RAM copy)
+ * @return true if the record was read.  A record in the flash log is checked by its CRC.  A record that hasn't been written since the
+ * 	   log was added only has its write_check to tell if it was ever written.
+ */
+static bool load_record(flash_rw_t record, void *p_store, pstorage_size_t num_bytes, uint32_t const *p_write_check) {
+  uint8_t version;
+  uint32_t err_code = copy_record(record,p_store,num_bytes,&version);
+  ladybug_flash_cache_record(record,(uint8_t *)p_store,num_bytes);
+  if (err_code != NRF_SUCCESS && (err_code != LADYBUG_ERROR_FLASH_LEGACY_RECORD || *p_write_check != WRITE_CHECK)){
+      return false;
   }
-  else {
-      pin_number = m_EC_VOUT_FET;
+  if (migrate_record(record,version,p_store)){
+      ladybug_flash_mark_dirty(record);
   }
-  //configure the GPIO for output
-  nrf_gpio_cfg_output(pin_number);
-  //discharge the cap by setting the GPIO to HIG
-  nrf_gpio_pin_set(pin_number);
-  //open the FET's gate so the ADC picks up an accurate measurement
-  nrf_gpio_pin_clear(pin_number);
+  return true;
+}
+/**
+ * \brief The first pH and EC sensors' quality bits are the QUALITY_PH_... and QUALITY_EC_... bits of measurements_t.
+ */
+static uint8_t pH_quality(uint8_t sensor_quality) {
+  //the QUALITY_PH_ bits are the same as the SENSOR_QUALITY_ bits.
+  return sensor_quality & (QUALITY_PH_RAILED | QUALITY_PH_VGND | QUALITY_PH_NOISY);
+}
+static uint8_t EC_quality(uint8_t sensor_quality) {
+  return ((sensor_quality & SENSOR_QUALITY_RAILED) ? QUALITY_EC_RAILED : 0) | ((sensor_quality & SENSOR_QUALITY_VGND) ? QUALITY_EC_VGND : 0) |
+      ((sensor_quality & SENSOR_QUALITY_OPEN) ? QUALITY_EC_OPEN : 0) | ((sensor_quality & SENSOR_QUALITY_NOISY) ? QUALITY_EC_NOISY : 0);
 }
 /**
  * \callgraph
- * \brief Assumes the pH probe is in a nutrient bath.  Reads the AIN value assigned for the pH probe as well as the VGND
- * used since the power source does not go negative.
+ * \brief Assumes the pH probe is in a nutrient bath.  Reads the first pH sensor in the registry.
+ * @param p_quality	the QUALITY_PH_... bits are added.  Can be NULL.
  * @return	The pH reading in mV.
  */
-static int16_t get_pH_reading() {
-  int16_t VGND = adc.read(pH_VGND);
-  int16_t AIN = adc.read(pH_AIN);
-  int16_t pH = AIN - VGND;
-  SEGGER_RTT_printf(0,"PH_VGND: %d , PH AIN: %d, pH_mV = AIN-VGND = %d\n",VGND,AIN,pH);
-  return (pH);
+static int16_t get_pH_reading(uint8_t *p_quality) {
+  sensorReading_t reading;
+  uint8_t sensor = ladybug_sensors_find(sensorPH);
+  if (sensor == SENSOR_NOT_FOUND) {
+      if (p_quality != NULL) {
+	  *p_quality |= QUALITY_PH_RAILED;
+      }
+      return 0;
+  }
+  ladybug_sensor_acquire(sensor,&reading);
+  if (p_quality != NULL) {
+      *p_quality |= pH_quality(reading.quality);
+  }
+  return reading.mV[0];
 }
 /**
  * \brief It is assumed the EC probe is in some type of water so the EC can be measured.  This might be a calibration solution or a nutrient bath.  This function
- * gets readings from the EC's VGND, VIN, VOUT AINs and returns VIN and VOUT without VGND.  These are requested by the client through a BLE Hydro characteristic
- * read request.  Going from VIN/VOUT measurements to an EC value is handled on the client.
+ * reads the first EC sensor in the registry and returns VIN and VOUT without VGND.
  * The first element of the returned array is VIN. The second is VOUT.
  * @param p_EC		A pointer to two int16_t values.  The first will store the VIN reading.  The second will store the VOUNT reading
+ * @param p_quality	the QUALITY_EC_... bits are added.  Can be NULL.
  */
-static void get_EC_reading(int16_t *p_EC) {
+static void get_EC_reading(int16_t *p_EC, uint8_t *p_quality) {
   if (p_EC == NULL){  //Shouldn't be passing in a null pointer given the EC Vin and Vout values are planned to be stored at this memory location.
       APP_ERROR_HANDLER(LADYBUG_ERROR_NULL_POINTER);
+      return;
+  }
+  sensorReading_t reading;
+  uint8_t sensor = ladybug_sensors_find(sensorEC);
+  if (sensor == SENSOR_NOT_FOUND) {
+      memset(&reading,0,sizeof(reading));
+      reading.quality = SENSOR_QUALITY_RAILED;
+  } else {
+      ladybug_sensor_acquire(sensor,&reading);
+  }
+  p_EC[0] = reading.mV[0];
+  p_EC[1] = reading.mV[1];
+  if (p_quality != NULL) {
+      *p_quality |= EC_quality(reading.quality);
+  }
+}
+/**
+ * \brief Turn the probe's EC response into µS/cm using the EC calibration table.  The segment the ratio falls in is found with a
+ * binary search over the (sorted) points and the EC is linearly interpolated within it.  Ratios beyond the ends of the table are
+ * extrapolated from the first or last segment.  With only one point, the EC is taken to be proportional to the ratio.
+ * @param p_table	the EC calibration table
+ * @param ratio		the probe's EC response in Q12
+ * @return		EC in µS/cm.  0 if the table is empty or there isn't a usable reading.
+ */
+static uint16_t EC_from_ratio(ECcalibrationTable_t const *p_table, uint16_t ratio) {
+  uint8_t num_points = p_table->num_points;
+  if (num_points == 0 || ratio == 0) {
+      return 0;
+  }
+  ECcalibrationPoint_t const *p_points = p_table->points;
+  int32_t EC;
+  if (num_points == 1) {
+      EC = (int32_t)p_points[0].solution * ratio / p_points[0].ratio;
+  } else {
+      //find the segment [lo,hi] holding ratio.  lo stays within [0,num_points-2] so the ends extrapolate.
+      uint8_t lo = 0;
+      uint8_t hi = num_points - 1;
+      while (hi - lo > 1) {
+	  uint8_t mid = (lo + hi) / 2;
+	  if (p_points[mid].ratio <= ratio) {
+	      lo = mid;
+	  } else {
+	      hi = mid;
+	  }
+      }
+      int32_t delta_ratio = (int32_t)p_points[hi].ratio - p_points[lo].ratio;
+      int32_t delta_solution = (int32_t)p_points[hi].solution - p_points[lo].solution;
+      EC = p_points[lo].solution;
+      if (delta_ratio != 0) {
+	  EC += ((int32_t)ratio - p_points[lo].ratio) * delta_solution / delta_ratio;
+      }
+  }
+  if (EC < 0) {
+      return 0;
+  }
+  return EC > UINT16_MAX ? UINT16_MAX : (uint16_t)EC;
+}
+/**
+ * \brief copy the calibration in use for a point into a history entry.
+ */
+static void capture_calibration_point(calibration_point_t point, calibrationHistoryEntry_t *p_entry) {
+  calibrationValues_t *p_calValues = &m_persistent.storeCalibrationValues.calValues;
+  memset(p_entry,0,sizeof(calibrationHistoryEntry_t));
+  p_entry->time = ladybug_time_now();
+  switch (point) {
+    case pH4Point:
+      p_entry->mV[0] = p_calValues->pH4_mV;
+      break;
+    case pH7Point:
+      p_entry->mV[0] = p_calValues->pH7_mV;
+      break;
+    case EC1Point:
+      p_entry->mV[0] = p_calValues->EC1_mV[0];
+      p_entry->mV[1] = p_calValues->EC1_mV[1];
+      p_entry->solution = p_calValues->EC1solution;
+      break;
+    default:
+      p_entry->mV[0] = p_calValues->EC2_mV[0];
+      p_entry->mV[1] = p_calValues->EC2_mV[1];
+      p_entry->solution = p_calValues->EC2solution;
+      break;
+  }
+}
+/**
+ * \brief make a history entry the calibration in use for a point.
+ */
+static void apply_calibration_point(calibration_point_t point, calibrationHistoryEntry_t const *p_entry) {
+  calibrationValues_t *p_calValues = &m_persistent.storeCalibrationValues.calValues;
+  switch (point) {
+    case pH4Point:
+      p_calValues->pH4_mV = p_entry->mV[0];
+      break;
+    case pH7Point:
+      p_calValues->pH7_mV = p_entry->mV[0];
+      break;
+    case EC1Point:
+      p_calValues->EC1_mV[0] = p_entry->mV[0];
+      p_calValues->EC1_mV[1] = p_entry->mV[1];
+      p_calValues->EC1solution = p_entry->solution;
+      break;
+    default:
+      p_calValues->EC2_mV[0] = p_entry->mV[0];
+      p_calValues->EC2_mV[1] = p_entry->mV[1];
+      p_calValues->EC2solution = p_entry->solution;
+      break;
+  }
+}
+/**
+ * \brief index into the ring of the entry steps_back from the newest.
+ */
+static uint8_t history_index(calibrationHistory_t const *p_history, uint8_t steps_back) {
+  return (p_history->newest + CALIBRATION_HISTORY_DEPTH - steps_back) % CALIBRATION_HISTORY_DEPTH;
+}
+/**
+ * \callgraph
+ * \brief The calibration in use for a point has changed.  Remember it in the point's history.  If calibrations had been undone, they can
+ * no longer be redone.
+ */
+static void push_calibration_history(calibration_point_t point) {
+  calibrationHistory_t *p_history = &m_persistent.storeCalibrationHistory.history[point];
+  if (p_history->count > 0) {
+      p_history->newest = history_index(p_history,p_history->undone);
+      p_history->count -= p_history->undone;
+      p_history->newest = (p_history->newest + 1) % CALIBRATION_HISTORY_DEPTH;
+  }
+  p_history->undone = 0;
+  if (p_history->count < CALIBRATION_HISTORY_DEPTH) {
+      p_history->count++;
+  }
+  capture_calibration_point(point,&p_history->entries[p_history->newest]);
+  ladybug_flash_mark_dirty(calibrationHistory);
+}
+/**
+ * \brief the calibration point an undo or redo command is for.
+ */
+static calibration_point_t calibration_point_of(control_enum_t command) {
+  switch (command) {
+    case undoPH4:
+    case redoPH4:
+      return pH4Point;
+    case undoPH7:
+    case redoPH7:
+      return pH7Point;
+    case undoEC1:
+    case redoEC1:
+      return EC1Point;
+    case undoEC2:
+    case redoEC2:
+      return EC2Point;
+    default:
+      APP_ERROR_HANDLER(LADYBUG_ERROR_INVALID_COMMAND);
+      return NUM_CALIBRATION_POINTS;
+  }
+}
+/**
+ * \brief The ideal pH4_mV - pH7_mV at 25°C (3 pH units * 59.16mV).
+ */
+#define PH_IDEAL_SPAN_MV	178
+/**
+ * \brief pH slope percents and offsets beyond which a pH probe is aging or should be replaced.
+ */
+#define PH_SLOPE_GOOD_MIN_PCT		95
+#define PH_SLOPE_GOOD_MAX_PCT		105
+#define PH_SLOPE_REPLACE_MIN_PCT	85
+#define PH_SLOPE_REPLACE_MAX_PCT	115
+#define PH_OFFSET_GOOD_MV		15
+#define PH_OFFSET_REPLACE_MV		30
+#define PH_SLOPE_DRIFT_AGING_PCT	10 ///<a slope that has dropped this much across the trend is aging even if it is still in the good range.
+/**
+ * \brief how far the EC gain can move from the first EC calibration in the trend.
+ */
+#define EC_GAIN_DRIFT_AGING_PCT		20
+#define EC_GAIN_DRIFT_REPLACE_PCT	40
+
+static int32_t clamp(int32_t value, int32_t min, int32_t max) {
+  return value < min ? min : (value > max ? max : value);
+}
+/**
+ * \brief EC1solution per unit of EC_VOUT/EC_VIN.  A fouled cell needs more µS/cm for the same ratio.
+ * @return 0 if EC1 has not been calibrated.
+ */
+static uint16_t EC_gain(calibrationValues_t const *p_calValues) {
+  if (p_calValues->EC1solution == 0 || p_calValues->EC1_mV[1] == 0){
+      return 0;
+  }
+  return clamp((uint32_t)p_calValues->EC1solution * p_calValues->EC1_mV[0] / p_calValues->EC1_mV[1],1,UINT16_MAX);
+}
+/**
+ * \brief the oldest sample in the trend that had an EC gain.
+ * @return 0 if there isn't one.
+ */
+static uint16_t first_EC_gain(void) {
+  probeHealthTrend_t const *p_trend = &m_persistent.storeProbeHealthTrend.probeHealthTrend;
+  for (uint8_t i = p_trend->count;i > 0;i--){
+      uint8_t index = (p_trend->newest + PROBE_HEALTH_TREND_DEPTH + 1 - i) % PROBE_HEALTH_TREND_DEPTH;
+      if (p_trend->samples[index].EC_gain != 0){
+	  return p_trend->samples[index].EC_gain;
+      }
+  }
+  return 0;
+}
+/**
+ * \callgraph
+ * \brief Fit a line (least squares) through the pH calibration points - pH4 and pH7, and pH10 if it has been calibrated.  With two points
+ * the line goes through both, so the pH is what it was before there was a third point.  The fit is only worked out when the calibration
+ * changes.  A measurement then takes one multiply (see pH_from_mV()).
+ */
+static void fit_pH_calibration(void) {
+  calibrationValues_t const *p_calValues = &m_persistent.storeCalibrationValues.calValues;
+  pHFit_t *p_fit = &m_persistent.storeCalibrationValues.pHFit;
+  int32_t const pH_x100[3] = {400,700,1000};
+  int32_t const mV[3] = {p_calValues->pH4_mV,p_calValues->pH7_mV,p_fit->pH10_mV};
+  int32_t n = p_fit->num_points;
+  //num_points comes from flash.  Anything but 2 or 3 would index past mV[] or divide by 0, so the line goes through pH4 and pH7 instead.
+  if (n != 2 && n != 3){
+      SEGGER_RTT_printf(0,"...pH fit has %d points.  Using 2.\n",n);
+      n = 2;
+  }
+  int64_t sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0, sum_yy = 0;
+  for (uint8_t i=0;i<n;i++){
+      sum_x += pH_x100[i];
+      sum_y += mV[i];
+      sum_xx += pH_x100[i] * pH_x100[i];
+      sum_xy += pH_x100[i] * mV[i];
+      sum_yy += mV[i] * mV[i];
+  }
+  int64_t Sxx = n * sum_xx - sum_x * sum_x;
+  int64_t Sxy = n * sum_xy - sum_x * sum_y;
+  int64_t Syy = n * sum_yy - sum_y * sum_y;
+  m_pH_line.sum_pH_x100 = sum_x;
+  m_pH_line.sum_mV = sum_y;
+  m_pH_line.Sxx = Sxx;
+  m_pH_line.Sxy = Sxy;
+  m_pH_line.pH_x100_per_mV_q16 = ladybug_fixed_reciprocal_q16(Sxx,Sxy);
+  m_pH_line.pH7_mV = ladybug_fixed_sat_s16((sum_y * Sxx + Sxy * (700 * n - sum_x)) / (n * Sxx));
+  m_pH_line.num_points = Sxy < 0 ? n : 0;
+  p_fit->slope_x10_mV_per_pH = ladybug_fixed_sat_s16((-1000 * Sxy + Sxx/2) / Sxx);
+  //the residual sum of squares is (Syy * Sxx - Sxy^2) / (n * Sxx).  Its mean is the RMS squared.
+  p_fit->residual_x10_mV = ladybug_fixed_sat_u16(ladybug_fixed_isqrt64((uint64_t)(100 * (Syy * Sxx - Sxy * Sxy) / (n * n * Sxx))));
+  SEGGER_RTT_printf(0,"...pH fit. points: %d, slope: %d (mV * 10 per pH), residual: %d (mV * 10)\n",n,p_fit->slope_x10_mV_per_pH,
+		    p_fit->residual_x10_mV);
+}
+/**
+ * \callgraph
+ * \brief work out the pH fit and the probe health from the calibration values in use and the trend of earlier calibrations.
+ */
+static void update_probe_health(void) {
+  calibrationValues_t *p_calValues = &m_persistent.storeCalibrationValues.calValues;
+  probeHealth_t *p_probeHealth = &p_calValues->probeHealth;
+  probeHealthTrend_t const *p_trend = &m_persistent.storeProbeHealthTrend.probeHealthTrend;
+  fit_pH_calibration();
+  //the fitted span from pH4 to pH7 is -300 * Sxy / Sxx mV.
+  int64_t span_pct_x_Sxx = -(int64_t)m_pH_line.Sxy * 300 * 100;
+  int64_t ideal_x_Sxx = (int64_t)m_pH_line.Sxx * PH_IDEAL_SPAN_MV;
+  p_probeHealth->pH_slope_pct = ladybug_fixed_sat_u8((span_pct_x_Sxx + ideal_x_Sxx/2) / ideal_x_Sxx);
+  p_probeHealth->pH_offset_mV = clamp(m_pH_line.pH7_mV,INT8_MIN,INT8_MAX);
+  uint8_t pH_health = probeGood;
+  int32_t offset_mV = m_pH_line.pH7_mV < 0 ? -m_pH_line.pH7_mV : m_pH_line.pH7_mV;
+  if (p_probeHealth->pH_slope_pct < PH_SLOPE_REPLACE_MIN_PCT || p_probeHealth->pH_slope_pct > PH_SLOPE_REPLACE_MAX_PCT ||
+      offset_mV > PH_OFFSET_REPLACE_MV){
+      pH_health = probeReplace;
+  }else if (p_probeHealth->pH_slope_pct < PH_SLOPE_GOOD_MIN_PCT || p_probeHealth->pH_slope_pct > PH_SLOPE_GOOD_MAX_PCT ||
+      offset_mV > PH_OFFSET_GOOD_MV){
+      pH_health = probeAging;
+  }else if (p_trend->count > 0){
+      uint8_t oldest = (p_trend->newest + PROBE_HEALTH_TREND_DEPTH + 1 - p_trend->count) % PROBE_HEALTH_TREND_DEPTH;
+      if (p_trend->samples[oldest].pH_slope_pct - p_probeHealth->pH_slope_pct >= PH_SLOPE_DRIFT_AGING_PCT){
+	  pH_health = probeAging;
+      }
+  }
+  uint8_t EC_health = probeUnknown;
+  uint16_t gain = EC_gain(p_calValues);
+  uint16_t first_gain = first_EC_gain();
+  p_probeHealth->EC_gain_pct = 100;
+  if (gain != 0){
+      EC_health = probeGood;
+      if (first_gain != 0){
+	  p_probeHealth->EC_gain_pct = ladybug_fixed_sat_u8(((uint32_t)gain * 100 + first_gain/2) / first_gain);
+	  int32_t drift_pct = p_probeHealth->EC_gain_pct - 100;
+	  drift_pct = drift_pct < 0 ? -drift_pct : drift_pct;
+	  if (drift_pct >= EC_GAIN_DRIFT_REPLACE_PCT){
+	      EC_health = probeReplace;
+	  }else if (drift_pct >= EC_GAIN_DRIFT_AGING_PCT){
+	      EC_health = probeAging;
+	  }
+      }
+  }
+  p_probeHealth->health = pH_health | EC_health << 4;
+  SEGGER_RTT_printf(0,"...probe health. pH slope: %d%%, pH offset: %dmV, EC gain: %d%%, health: 0x%x\n",p_probeHealth->pH_slope_pct,
+		    p_probeHealth->pH_offset_mV,p_probeHealth->EC_gain_pct,p_probeHealth->health);
+}
+/**
+ * \callgraph
+ * \brief A calibration was made.  Add the probe's condition to the trend so later calibrations can be compared against it.
+ */
+static void add_probe_health_sample(void) {
+  probeHealthTrend_t *p_trend = &m_persistent.storeProbeHealthTrend.probeHealthTrend;
+  if (p_trend->count > 0){
+      p_trend->newest = (p_trend->newest + 1) % PROBE_HEALTH_TREND_DEPTH;
+  }
+  if (p_trend->count < PROBE_HEALTH_TREND_DEPTH){
+      p_trend->count++;
   }
-  SEGGER_RTT_WriteString(0,"---> IN get_EC_reading\n");
-  int16_t VGND = adc.read(EC_VGND);
-  SEGGER_RTT_printf(0,"EC_VGND: %d  0X%x\n",VGND,VGND);
-  //EC VIN and EC VOUT have a rectifier step in which there is a FET that stabilizes the rectification by discharging the cap to prevent an upward drift..
-  //I wrote some blog posts on this...there are FET pins assigned for both so, I added a discharge() function...
-  discharge(EC_VIN);
-  int16_t AIN = adc.read(EC_VIN);
-  //The first element in the array is EC VIN
-  *p_EC = AIN-VGND;
-  SEGGER_RTT_printf(0,"EC_VIN after subtracting VGND: %d 0X%x\n",*p_EC,*p_EC);
-  discharge(EC_VOUT);
-  AIN = adc.read(EC_VOUT);
-  //the second element is EC VOUT
-  *(p_EC+1) = AIN-VGND;
-  SEGGER_RTT_printf(0,"EC_VOUT after subtracting VGND: %d 0X%x\n", *(p_EC+1),*(p_EC+1));
+  probeHealthSample_t *p_sample = &p_trend->samples[p_trend->newest];
+  p_sample->time = ladybug_time_now();
+  p_sample->EC_gain = EC_gain(&m_persistent.storeCalibrationValues.calValues);
+  p_sample->pH_slope_pct = m_persistent.storeCalibrationValues.calValues.probeHealth.pH_slope_pct;
+  p_sample->pH_offset_mV = m_persistent.storeCalibrationValues.calValues.probeHealth.pH_offset_mV;
+  ladybug_flash_mark_dirty(probeHealthTrend);
 }
 /**
  * \brief the central has requested calibrating either the pH or EC probe.  First decide what calibration solution the probe is in.  This
@@ -137,18 +536,25 @@ static void get_EC_reading(int16_t *p_EC) {
  */
 void ladybug_update_calibration_value(control_enum_t command, int solutionValue){
   SEGGER_RTT_printf(0,"---> in ladybug_update_calibration_value.  command: %d, solution value: %d\n",command,solutionValue);
-  if (command != calibratePH4 && command != calibratepH7 &&  command != calibrateEC1 && command != calibrateEC2){
+  if (command != calibratePH4 && command != calibratepH7 && command != calibratePH10 && command != calibrateEC1 && command != calibrateEC2){
       APP_ERROR_HANDLER(LADYBUG_ERROR_INVALID_COMMAND);
   }
   //pH calibration comes from a simple reading of the pH AIN
-  //there is no additional calibration values that need to be stored since calibration is fixed on using the two points: pH4 and pH7.
-  if (command == calibratePH4 || command == calibratepH7) {
-      int16_t pH_value = get_pH_reading();
+  //the pH line is fitted through pH4, pH7, and (if it has been calibrated) pH10 when the probe health is updated.
+  if (command == calibratePH4 || command == calibratepH7 || command == calibratePH10) {
+      int16_t pH_value = get_pH_reading(NULL);
       if (command == calibratePH4){
-	  m_storeCalibrationValues.calValues.pH4_mV = pH_value;
+	  m_persistent.storeCalibrationValues.calValues.pH4_mV = pH_value;
+	  push_calibration_history(pH4Point);
 	  SEGGER_RTT_WriteString(0,"Calibrated pH4\n");
+      }else if (command == calibratePH10){
+	  //pH10 isn't in the calibration history.  Resetting the pH calibration goes back to two points.
+	  m_persistent.storeCalibrationValues.pHFit.pH10_mV = pH_value;
+	  m_persistent.storeCalibrationValues.pHFit.num_points = 3;
+	  SEGGER_RTT_WriteString(0,"Calibrated pH10\n");
       }else {
-	  m_storeCalibrationValues.calValues.pH7_mV = pH_value;
+	  m_persistent.storeCalibrationValues.calValues.pH7_mV = pH_value;
+	  push_calibration_history(pH7Point);
 	  SEGGER_RTT_WriteString(0,"Calibrated pH7\n");
       }
   }else {
@@ -158,28 +564,36 @@ void ladybug_update_calibration_value(control_enum_t command, int solutionValue)
       // Read the AIN values assigned for the EC Vin and EC Vout values.  Which is read depends on which calibration solution the
       // probe is in.  The user of the client has chosen either EC1 or EC2.  What comes over is the EC 1 or 2 calibration solution
       // value.  This will be stored as well as the probe values that are read from which the EC can be calculated on the client.
-      get_EC_reading(EC_VIN_and_VOUT_mV);  //the first element is VIN, the second is VOUT.  EC calculation happens on the client
+      get_EC_reading(EC_VIN_and_VOUT_mV,NULL);  //the first element is VIN, the second is VOUT.  EC calculation happens on the client
       if (command == calibrateEC1){
 	  SEGGER_RTT_WriteString(0,"...setting EC1 values...\n");
-	  m_storeCalibrationValues.calValues.EC1solution = solutionValue;
+	  m_persistent.storeCalibrationValues.calValues.EC1solution = solutionValue;
 	  for (int i=0;i<2;i++) {
-	      m_storeCalibrationValues.calValues.EC1_mV[i] = EC_VIN_and_VOUT_mV[i];
+	      m_persistent.storeCalibrationValues.calValues.EC1_mV[i] = EC_VIN_and_VOUT_mV[i];
 	  }
+	  push_calibration_history(EC1Point);
       }else {  //calibrate EC2
 	  SEGGER_RTT_WriteString(0,"...setting EC2 values...\n");
-	  m_storeCalibrationValues.calValues.EC2solution = solutionValue;
+	  m_persistent.storeCalibrationValues.calValues.EC2solution = solutionValue;
 	  for (int i=0;i<2;i++) {
-	      m_storeCalibrationValues.calValues.EC2_mV[i] = EC_VIN_and_VOUT_mV[i];
+	      m_persistent.storeCalibrationValues.calValues.EC2_mV[i] = EC_VIN_and_VOUT_mV[i];
 	  }
+	  push_calibration_history(EC2Point);
       }
       print_out_calibration_values();
   }
+  //the health is worked out against the trend before this calibration is added to it.
+  update_probe_health();
+  add_probe_health_sample();
   //write the reading (and the rest that in the hydro data) to flash.
-  m_write_calibration_values = true;
+  ladybug_flash_mark_dirty(calibrationValues);
 }
 /**
  * \callgraph
  * \brief OOps!  The central wants the last value stored for a pH calibration measurement
+ * \note This is what older clients send.  They keep the last values themselves.  Newer clients send a single byte undo command and the
+ * Ladybug uses its calibration history.
+ * \sa ladybug_undo_calibration()
  */
 void ladybug_undo_pH_calibration(control_enum_t command, int16_t pHCalValue) {
   SEGGER_RTT_printf(0,"---> in ladybug_undo_pH_calibration.  pHCalValue: %d\n",pHCalValue);
@@ -187,12 +601,15 @@ void ladybug_undo_pH_calibration(control_enum_t command, int16_t pHCalValue) {
       APP_ERROR_HANDLER(LADYBUG_ERROR_INVALID_COMMAND);
   }
   if (command == undoPH4) {
-      m_storeCalibrationValues.calValues.pH4_mV = pHCalValue;
+      m_persistent.storeCalibrationValues.calValues.pH4_mV = pHCalValue;
+      push_calibration_history(pH4Point);
   } else {
-      m_storeCalibrationValues.calValues.pH7_mV = pHCalValue;
+      m_persistent.storeCalibrationValues.calValues.pH7_mV = pHCalValue;
+      push_calibration_history(pH7Point);
   }
   print_out_calibration_values();
-  m_write_calibration_values = true;
+  update_probe_health();
+  ladybug_flash_mark_dirty(calibrationValues);
 }
   /**
    * \callgraph
@@ -203,14 +620,17 @@ void ladybug_undo_pH_calibration(control_enum_t command, int16_t pHCalValue) {
 	APP_ERROR_HANDLER(LADYBUG_ERROR_INVALID_COMMAND);
     }
     if (command == undoEC1) {
-	m_storeCalibrationValues.calValues.EC1_mV[0] = EC_Vin;
-	m_storeCalibrationValues.calValues.EC1_mV[1] = EC_Vout;
+	m_persistent.storeCalibrationValues.calValues.EC1_mV[0] = EC_Vin;
+	m_persistent.storeCalibrationValues.calValues.EC1_mV[1] = EC_Vout;
+	push_calibration_history(EC1Point);
     }else {
-	m_storeCalibrationValues.calValues.EC2_mV[0] = EC_Vin;
-	m_storeCalibrationValues.calValues.EC2_mV[1] = EC_Vout;
+	m_persistent.storeCalibrationValues.calValues.EC2_mV[0] = EC_Vin;
+	m_persistent.storeCalibrationValues.calValues.EC2_mV[1] = EC_Vout;
+	push_calibration_history(EC2Point);
     }
     print_out_calibration_values();
-    m_write_calibration_values = true;
+    update_probe_health();
+    ladybug_flash_mark_dirty(calibrationValues);
   }
   /**
    * \callgraph
@@ -218,8 +638,10 @@ void ladybug_undo_pH_calibration(control_enum_t command, int16_t pHCalValue) {
    */
   static void reset_pH_calibration_values(){
     SEGGER_RTT_WriteString(0,"...RESETTIING pH Calibration values\n");
-    m_storeCalibrationValues.calValues.pH4_mV = 178;
-    m_storeCalibrationValues.calValues.pH7_mV = 0;
+    m_persistent.storeCalibrationValues.calValues.pH4_mV = 178;
+    m_persistent.storeCalibrationValues.calValues.pH7_mV = 0;
+    m_persistent.storeCalibrationValues.pHFit.pH10_mV = 0;
+    m_persistent.storeCalibrationValues.pHFit.num_points = 2;
   }
   /**
    * \callgraph
@@ -228,21 +650,22 @@ void ladybug_undo_pH_calibration(control_enum_t command, int16_t pHCalValue) {
   static void reset_EC_calibration_values(){
     SEGGER_RTT_WriteString(0,"...RESETTIING EC Calibration values\n");
     for (int i=0;i<2;i++){  //reset the values read from the probe, but not the solution values entered by the user.
-	m_storeCalibrationValues.calValues.EC1_mV[i] = 0;
-	m_storeCalibrationValues.calValues.EC2_mV[i] = 0;
+	m_persistent.storeCalibrationValues.calValues.EC1_mV[i] = 0;
+	m_persistent.storeCalibrationValues.calValues.EC2_mV[i] = 0;
     }
-    m_storeCalibrationValues.calValues.EC1solution = 0;
-    m_storeCalibrationValues.calValues.EC2solution = 0;
+    m_persistent.storeCalibrationValues.calValues.EC1solution = 0;
+    m_persistent.storeCalibrationValues.calValues.EC2solution = 0;
   }
   /**
    * \callgraph
-   * \brief resets all calibration values to "ideal"...this happens when m_storeCalibrationValues.write_check != WRITE_CHECK
+   * \brief resets all calibration values to "ideal"...this happens when the calibration values have never been written (or were lost)
    * i.e.: the flash reserved for storing the calibration values has not yet been written to.
    */
   static void reset_all_calibration_values() {
     reset_pH_calibration_values();
     reset_EC_calibration_values();
-    m_write_calibration_values = true;
+    update_probe_health();
+    ladybug_flash_mark_dirty(calibrationValues);
   }
   /**
    * \callgraph
@@ -252,60 +675,204 @@ void ladybug_undo_pH_calibration(control_enum_t command, int16_t pHCalValue) {
   {
     if (command == resetPHcalValues){
 	reset_pH_calibration_values();
+	push_calibration_history(pH4Point);
+	push_calibration_history(pH7Point);
     }else {
 	reset_EC_calibration_values();
+	push_calibration_history(EC1Point);
+	push_calibration_history(EC2Point);
     }
     //lazy write the calibration values to flash so stuff doesn't get screwed up/freeze...hmmm.....
-    m_write_calibration_values = true;
+    update_probe_health();
+    ladybug_flash_mark_dirty(calibrationValues);
+  }
+  /**
+   * \brief the hash lookup happens here, when the plant info changes, so measurements only compare numbers.
+   */
+  static void find_plant_target(void) {
+    plantInfo_t const *p_plantInfo = &m_persistent.storePlantInfo.plantChar.plantInfo;
+    m_p_plant_target = ladybug_plants_find_target(p_plantInfo->type,sizeof(p_plantInfo->type),p_plantInfo->stage,sizeof(p_plantInfo->stage));
+    //the alarms may have been raised against the old plant's targets.
+    CRITICAL_REGION_ENTER();
+    ladybug_alarms_reset();
+    m_alarms = 0;
+    CRITICAL_REGION_EXIT();
+    SEGGER_RTT_printf(0,"...the plant %s known\n",m_p_plant_target == NULL ? "is not" : "is");
+  }
+  /**
+   * \brief pH * 100 from the pH mV on the line fitted through the pH calibration points (see fit_pH_calibration()).  The line goes
+   * through the mean of the points, so n * pH = sum(pH) + (n * mV - sum(mV)) * Sxx / Sxy.
+   * @return 0 if the calibration can't give a pH.
+   */
+  static uint16_t pH_from_mV(int16_t pH_mV) {
+    uint8_t n = m_pH_line.num_points;
+    if (n == 0){
+	return 0;
+    }
+    //rounded to nearest so a reading at a calibration point gives that point's pH.
+    int32_t offset_x_n = (int32_t)(((int64_t)(n * pH_mV - m_pH_line.sum_mV) * m_pH_line.pH_x100_per_mV_q16 + (1 << 15)) >> 16);
+    int32_t pH_x100 = ladybug_fixed_div_small(m_pH_line.sum_pH_x100 + offset_x_n + n/2,n);
+    return pH_x100 < 1 ? 1 : (pH_x100 > 1400 ? 1400 : pH_x100);
   }
   /**
    * \callgraph
-   * \brief Read the plant type and stage stored in flash.  If a write check has not been written, then set the plant type and stage to
-   * default strings.
-   * \details By using a pointer (p_plantInfo) that points to the address of another pointer (@m_storePlantInfo) i.e.: a pointer to pointer or
+   * \brief The plant type and stage.  They were read from flash (or set to default strings) by ladybug_hydro_init().
+   * \details By using a pointer (p_plantInfo) that points to the address of another pointer (@m_persistent.storePlantInfo) i.e.: a pointer to pointer or
    * a double pointer, passing around a .c global variable between .c files is avoided.
    */
   void ladybug_get_plantInfo(plantInfo_t **p_plantInfo)
   {
     SEGGER_RTT_WriteString(0,"\n***--->>> in ladybug_get_plantInfo_values\n");
-    // Not checking m_storePlantInfo because it has to exist or the compiler would complain.
-    *p_plantInfo = &m_storePlantInfo.plantChar.plantInfo;
-    ladybug_flash_read(plantInfo,m_storePlantInfo.plantChar.bytes,did_flash_read);
-    if (m_storePlantInfo.write_check != WRITE_CHECK){
-        //set plant type and stage to ??
-        SEGGER_RTT_WriteString(0,"...setting plantStore bytes\n");
-        //the flash storage for plant info is 32 bytes - which is the BLOCK_SIZE
-        memset(&m_storePlantInfo, '?', BLOCK_SIZE);
-        m_storePlantInfo.write_check = WRITE_CHECK;
-        m_write_plantInfo_values = true;
+    *p_plantInfo = &m_persistent.storePlantInfo.plantChar.plantInfo;
+  }
+  /**
+   * \callgraph
+   * \brief The client has written the plant info characteristic.  Look up the plant's targets and (lazily) write the plant info to flash.
+   * @param p_bytes	the plant type followed by the growth stage (plantInfo_t)
+   * @param len		the number of bytes written
+   */
+  void ladybug_update_plantInfo(uint8_t const *p_bytes, uint16_t len) {
+    SEGGER_RTT_WriteString(0,"--> IN ladybug_update_plantInfo\n");
+    if (p_bytes == NULL){
+	APP_ERROR_HANDLER(LADYBUG_ERROR_NULL_POINTER);
+	return;
+    }
+    if (len > sizeof(plantInfo_t)){
+	len = sizeof(plantInfo_t);
     }
+    memcpy(m_persistent.storePlantInfo.plantChar.bytes,p_bytes,len);
+    find_plant_target();
+    ladybug_flash_mark_dirty(plantInfo);
   }
   /**
-   * read the calibration measurements for mV for pH4, pH7, EC1[2], and EC2[2], EC1solution, EC2solution from flash
+   * the calibration measurements for mV for pH4, pH7, EC1[2], and EC2[2], EC1solution, EC2solution.  They were read from flash by
+   * ladybug_hydro_init().
    * @param p_calibrationValues
    */
   void ladybug_get_calibrationValues(calibrationValues_t **p_calibrationValues) {
     SEGGER_RTT_WriteString(0,"--> IN ladybug_get_calibrationValues\n");
-    // Not checking m_storeCalibrationValues because it has to exist or the compiler would complain.
-    *p_calibrationValues = &m_storeCalibrationValues.calValues;
-    ladybug_flash_read(calibrationValues,(uint8_t *)&m_storeCalibrationValues.calValues,did_flash_read);
-    if (m_storeCalibrationValues.write_check != WRITE_CHECK){
-	//calibration values have not been stored
-	m_storeCalibrationValues.write_check = WRITE_CHECK;
-	reset_all_calibration_values();
+    *p_calibrationValues = &m_persistent.storeCalibrationValues.calValues;
+  }
+  /**
+   * \callgraph
+   * \brief get pH and EC readings into the back buffer and then publish them as the current snapshot.
+   * \note Only one sampler at a time (the main loop or a BLE event) should call this function.
+   */
+  void ladybug_take_measurements(void) {
+    SEGGER_RTT_WriteString(0,"\n***--->>> in ladybug_take_measurements\n");
+    uint8_t back = m_front_measurements ^ 1;
+    sensorMeasurements_t *p_sensors = &m_sensor_measurements[back];
+    uint8_t pH_sensor = ladybug_sensors_find(sensorPH);
+    uint8_t EC_sensor = ladybug_sensors_find(sensorEC);
+    memset(&m_measurements[back],0,sizeof(measurements_t));
+    m_measurements[back].quality = (pH_sensor == SENSOR_NOT_FOUND ? QUALITY_PH_RAILED : 0) | (EC_sensor == SENSOR_NOT_FOUND ? QUALITY_EC_RAILED : 0);
+    p_sensors->num_sensors = NUM_SENSORS;
+    for (uint8_t sensor = 0; sensor < NUM_SENSORS; sensor++) {
+	sensorReading_t reading;
+	sensorMeasurement_t *p_sensor = &p_sensors->sensors[sensor];
+	ladybug_sensor_acquire(sensor,&reading);
+	p_sensor->type = ladybug_sensor_type(sensor);
+	p_sensor->quality = reading.quality;
+	p_sensor->mV[0] = reading.mV[0];
+	p_sensor->mV[1] = reading.mV[1];
+	if (sensor == pH_sensor) {
+	    m_measurements[back].pH_mV = reading.mV[0];
+	    m_measurements[back].quality |= pH_quality(reading.quality);
+	} else if (sensor == EC_sensor) {
+	    m_measurements[back].EC_mV[0] = reading.mV[0];
+	    m_measurements[back].EC_mV[1] = reading.mV[1];
+	    m_measurements[back].quality |= EC_quality(reading.quality);
+	} else {
+	    int32_t response = ladybug_sensor_response(sensor,&reading);
+	    CRITICAL_REGION_ENTER();
+	    p_sensor->value = ladybug_sensor_value(&m_persistent.storeSensorCalibrations.calibrations[sensor],response);
+	    CRITICAL_REGION_EXIT();
+	}
+    }
+    uint16_t ratio = ladybug_sensors_EC_ratio(m_measurements[back].EC_mV);
+    //the calibrations are changed from BLE events.  The lookups are short so they are done with interrupts off.
+    CRITICAL_REGION_ENTER();
+    m_measurements[back].EC_uS = EC_from_ratio(&m_persistent.storeECcalibrationTable.ECcalibrationTable,ratio);
+    m_measurements[back].pH_x100 = pH_from_mV(m_measurements[back].pH_mV);
+    CRITICAL_REGION_EXIT();
+    if (pH_sensor != SENSOR_NOT_FOUND) {
+	p_sensors->sensors[pH_sensor].value = m_measurements[back].pH_x100;
+    }
+    if (EC_sensor != SENSOR_NOT_FOUND) {
+	p_sensors->sensors[EC_sensor].value = m_measurements[back].EC_uS;
+    }
+    //an unusable reading is passed on as unknown (0) so it is dropped by the range check and the alarms.
+    uint16_t pH_x100 = (m_measurements[back].quality & QUALITY_PH_UNUSABLE) ? 0 : m_measurements[back].pH_x100;
+    uint16_t EC_uS = (m_measurements[back].quality & QUALITY_EC_UNUSABLE) ? 0 : m_measurements[back].EC_uS;
+    m_measurements[back].out_of_range = ladybug_plants_out_of_range(m_p_plant_target,pH_x100,EC_uS);
+    //the alarm configuration is changed from BLE events.
+    CRITICAL_REGION_ENTER();
+    m_alarms = ladybug_alarms_evaluate(&m_persistent.storeAlarmConfig.alarmConfig,m_p_plant_target,pH_x100,EC_uS,ladybug_time_now());
+    CRITICAL_REGION_EXIT();
+    //make sure the back buffer is completely written before it becomes the front buffer.
+    __DMB();
+    m_front_measurements = back;
+    m_measurements_sequence++;
+    __DMB();
+    //The statistics are also read from BLE events.  Updating them is quick so it is done with interrupts off.
+    CRITICAL_REGION_ENTER();
+    ladybug_stats_add(&m_pH_statistics,m_measurements[back].pH_mV);
+    ladybug_stats_add(&m_EC_VIN_statistics,m_measurements[back].EC_mV[0]);
+    ladybug_stats_add(&m_EC_VOUT_statistics,m_measurements[back].EC_mV[1]);
+    CRITICAL_REGION_EXIT();
+  }
+  /**
+   * \callgraph
+   * \brief copy the most recently published snapshot of the measurements.  If a new snapshot was published while copying, the copy
+   * is thrown away and taken again.
+   * @param p_measurements		memory where the coherent copy of the measurements is placed.
+   */
+  void ladybug_get_measurements(measurements_t *p_measurements) {
+    if (p_measurements == NULL){
+	APP_ERROR_HANDLER(LADYBUG_ERROR_NULL_POINTER);
     }
+    uint32_t sequence;
+    do {
+	sequence = m_measurements_sequence;
+	__DMB();
+	*p_measurements = m_measurements[m_front_measurements];
+	__DMB();
+    } while (sequence != m_measurements_sequence);
   }
   /**
    * \callgraph
-   * \brief get pH and EC readings and return a pointer to the variable holding the measurements.
-   * @param p_measurements		used to return a pointer to the variable holding the measurements.
+   * \brief copy the readings of all the sensors from the most recently published snapshot.  Like ladybug_get_measurements(), the copy is
+   * taken again if a new snapshot was published while copying.
+   * @param p_sensorMeasurements	memory where the coherent copy of the readings is placed.
    */
-  void ladybug_get_measurements(measurements_t **p_measurements) {
-    SEGGER_RTT_WriteString(0,"\n***--->>> in ladybug_get_measurements\n");
-    // Not checking m_measurements because it has to exist or the compiler would complain.
-    *p_measurements = &m_measurements;
-    m_measurements.pH_mV = get_pH_reading();
-    get_EC_reading(m_measurements.EC_mV);
+  void ladybug_get_sensor_measurements(sensorMeasurements_t *p_sensorMeasurements) {
+    uint32_t sequence;
+    do {
+	sequence = m_measurements_sequence;
+	__DMB();
+	*p_sensorMeasurements = m_sensor_measurements[m_front_measurements];
+	__DMB();
+    } while (sequence != m_measurements_sequence);
+  }
+  /**
+   * \callgraph
+   * \brief Report the statistics of the measurements taken since the last report and start a new window.
+   * @param p_statistics		memory where the statistics are placed.
+   */
+  void ladybug_report_statistics(statistics_t *p_statistics) {
+    welford_t pH, EC_Vin, EC_Vout;
+    CRITICAL_REGION_ENTER();
+    pH = m_pH_statistics;
+    EC_Vin = m_EC_VIN_statistics;
+    EC_Vout = m_EC_VOUT_statistics;
+    ladybug_stats_reset(&m_pH_statistics);
+    ladybug_stats_reset(&m_EC_VIN_statistics);
+    ladybug_stats_reset(&m_EC_VOUT_statistics);
+    CRITICAL_REGION_EXIT();
+    p_statistics->count = pH.count > UINT16_MAX ? UINT16_MAX : pH.count;
+    ladybug_stats_get(&pH,&p_statistics->pH);
+    ladybug_stats_get(&EC_Vin,&p_statistics->EC_Vin);
+    ladybug_stats_get(&EC_Vout,&p_statistics->EC_Vout);
   }
   /**
    * \callgraph
@@ -314,70 +881,667 @@ void ladybug_undo_pH_calibration(control_enum_t command, int16_t pHCalValue) {
    * @param p_calibrationValues
    */
   void ladybug_get_calibration_values_memory_location(calibrationValues_t **p_calibrationValues) {
-    // Not checking m_storeCalibrationValues because it has to exist or the compiler would complain.
-    *p_calibrationValues = &m_storeCalibrationValues.calValues;
+    // Not checking m_persistent.storeCalibrationValues because it has to exist or the compiler would complain.
+    *p_calibrationValues = &m_persistent.storeCalibrationValues.calValues;
+  }
+  /**
+   * \brief where the pH10 point and the fitted pH line are kept.  The pH fit characteristic reads from here.
+   */
+  void ladybug_get_pH_fit_memory_location(pHFit_t **p_pHFit) {
+    *p_pHFit = &m_persistent.storeCalibrationValues.pHFit;
+  }
+  /**
+   * \brief the device name.  It was read from flash (or set to DEFAULT_DEVICE_NAME) by ladybug_hydro_init().
+   */
+  void ladybug_get_device_name(char **p_deviceName) {
+    SEGGER_RTT_WriteString(0,"---> IN ladybug_get_device_name\n");
+    *p_deviceName = m_persistent.device_name;
   }
-  /***
+  /**
+   * \brief write the device name the client has sent to flash.  This could happen within the ble service code.  For now I'm keeping
+   * flash writes for the Ladybug all within the ladybug code.
+   * @param p_device_name	a pointer to the device name string of characters
+   * @param len		the length of the device name string. The length cannot be greater than the max bytes allowed for the name.
+   */
+  void ladybug_write_device_name(char *p_device_name,uint16_t len){
+    len = len > DEVNAME_MAX_LEN ? DEVNAME_MAX_LEN : len;
+    for (int i=0;i<len;i++){
+	m_persistent.device_name[i] = *(p_device_name+i);
+    }
+    ladybug_flash_mark_dirty(deviceName);
+  }
+  /**
+   * \brief The longest the sampling timer is started for.  app_timer can't run a timer for more than half of the RTC1 counter
+   * (~256s when the prescaler = 0).  Longer sampling periods are counted out in SAMPLING_LONG_TICK_S ticks.
+   */
+#define SAMPLING_MAX_TICK_S	240
+#define SAMPLING_LONG_TICK_S	60
+  /**
    * \callgraph
-   * \brief Masks the global variable flag that requests a flash write of the calibration values
+   * \brief Called by app_timer each sampling tick.  The measurement itself is taken in the main loop, the same way flash writes are lazy,
+   * so the ADC is never read from within an interrupt.
+   * @param p_context	not used.
    */
-  bool ladybug_there_are_calibration_values_to_write(storeCalibrationValues_t **p_storeCalibrationValues){
-    if (true == m_write_calibration_values){
-	m_write_calibration_values = false;
-	*p_storeCalibrationValues = &m_storeCalibrationValues;
+  static void sampling_timeout_handler(void * p_context)
+  {
+    UNUSED_PARAMETER(p_context);
+    if (m_sampling_ticks_remaining > 1){
+	m_sampling_ticks_remaining--;
+	return;
+    }
+    m_sampling_ticks_remaining = m_sampling_ticks_per_measurement;
+    m_take_scheduled_measurement = true;
+  }
+  /**
+   * \brief Called by app_timer every SETTLING_PERIOD_S while a calibration is waiting for the reading to settle.
+   */
+  static void settling_timeout_handler(void * p_context)
+  {
+    UNUSED_PARAMETER(p_context);
+    m_take_calibration_step = true;
+  }
+  /**
+   * \callgraph
+   * \brief (Re)start the sampling timer based on the period in m_persistent.storeSamplingConfig.  A period of 0 stops scheduled sampling.
+   */
+  static void start_sampling_timer() {
+    static const uint32_t app_timer_prescaler = 0;
+    uint32_t err_code = app_timer_stop(m_sampling_timer_id);
+    APP_ERROR_CHECK(err_code);
+    uint16_t period_s = m_persistent.storeSamplingConfig.samplingConfig.period_s;
+    //the forecast assumes its readings are a period apart.
+    CRITICAL_REGION_ENTER();
+    ladybug_forecast_reset(&m_pH_forecast);
+    ladybug_forecast_reset(&m_EC_forecast);
+    CRITICAL_REGION_EXIT();
+    if (period_s == 0){
+	SEGGER_RTT_WriteString(0,"...scheduled sampling is off\n");
+	return;
+    }
+    uint16_t tick_s = period_s;
+    m_sampling_ticks_per_measurement = 1;
+    if (period_s > SAMPLING_MAX_TICK_S){
+	tick_s = SAMPLING_LONG_TICK_S;
+	m_sampling_ticks_per_measurement = (period_s + SAMPLING_LONG_TICK_S - 1) / SAMPLING_LONG_TICK_S;
+    }
+    m_sampling_ticks_remaining = m_sampling_ticks_per_measurement;
+    SEGGER_RTT_printf(0,"...sampling every %d seconds\n",period_s);
+    err_code = app_timer_start(m_sampling_timer_id, APP_TIMER_TICKS(tick_s * 1000, app_timer_prescaler), NULL);
+    APP_ERROR_CHECK(err_code);
+  }
+  /**
+   * \callgraph
+   * \brief Load every record into m_persistent in one pass over the flash.  A record that wasn't read (or doesn't make sense) is set to
+   * its default.  The records were checked against their CRCs by ladybug_flash_init() when it found them in the log, and each is copied
+   * straight out of the memory mapped flash, so there is no waiting on pstorage.
+   * \note The checks that need the plant and sensor registries are made by ladybug_hydro_init() once they are initialized.
+   */
+  static void load_persistent_state(void) {
+    SEGGER_RTT_WriteString(0,"--> IN load_persistent_state\n");
+    if (!load_record(samplingConfig,&m_persistent.storeSamplingConfig,sizeof(storeSamplingConfig_t),&m_persistent.storeSamplingConfig.write_check)){
+	m_persistent.storeSamplingConfig.write_check = WRITE_CHECK;
+	m_persistent.storeSamplingConfig.samplingConfig.period_s = DEFAULT_SAMPLING_PERIOD_S;
+	m_persistent.storeSamplingConfig.samplingConfig.pH_delta_mV = DEFAULT_PH_DELTA_MV;
+	m_persistent.storeSamplingConfig.samplingConfig.EC_delta_mV = DEFAULT_EC_DELTA_MV;
+	m_persistent.storeSamplingConfig.samplingConfig.unused = 0;
+	ladybug_flash_mark_dirty(samplingConfig);
+    }
+    if (!load_record(ECcalibrationTable,&m_persistent.storeECcalibrationTable,sizeof(storeECcalibrationTable_t),&m_persistent.storeECcalibrationTable.write_check) ||
+	m_persistent.storeECcalibrationTable.ECcalibrationTable.num_points > EC_TABLE_MAX_POINTS){
+	memset(&m_persistent.storeECcalibrationTable,0,sizeof(storeECcalibrationTable_t));
+	m_persistent.storeECcalibrationTable.write_check = WRITE_CHECK;
+	ladybug_flash_mark_dirty(ECcalibrationTable);
+    }
+    bool history_is_valid = load_record(calibrationHistory,&m_persistent.storeCalibrationHistory,sizeof(storeCalibrationHistory_t),
+					&m_persistent.storeCalibrationHistory.write_check);
+    for (calibration_point_t point = pH4Point;point < NUM_CALIBRATION_POINTS && history_is_valid;point++){
+	calibrationHistory_t *p_history = &m_persistent.storeCalibrationHistory.history[point];
+	history_is_valid = p_history->newest < CALIBRATION_HISTORY_DEPTH && p_history->count <= CALIBRATION_HISTORY_DEPTH &&
+	    p_history->undone < CALIBRATION_HISTORY_DEPTH && p_history->undone <= p_history->count;
+    }
+    if (!history_is_valid){
+	//the history is started when the calibration values are read.
+	memset(&m_persistent.storeCalibrationHistory,0,sizeof(storeCalibrationHistory_t));
+	m_persistent.storeCalibrationHistory.write_check = WRITE_CHECK;
+    }
+    if (!load_record(probeHealthTrend,&m_persistent.storeProbeHealthTrend,sizeof(storeProbeHealthTrend_t),&m_persistent.storeProbeHealthTrend.write_check) ||
+	m_persistent.storeProbeHealthTrend.probeHealthTrend.newest >= PROBE_HEALTH_TREND_DEPTH ||
+	m_persistent.storeProbeHealthTrend.probeHealthTrend.count > PROBE_HEALTH_TREND_DEPTH){
+	memset(&m_persistent.storeProbeHealthTrend,0,sizeof(storeProbeHealthTrend_t));
+	m_persistent.storeProbeHealthTrend.write_check = WRITE_CHECK;
+    }
+    if (!load_record(sensorCalibrations,&m_persistent.storeSensorCalibrations,sizeof(storeSensorCalibrations_t),&m_persistent.storeSensorCalibrations.write_check)){
+	memset(&m_persistent.storeSensorCalibrations,0,sizeof(storeSensorCalibrations_t));
+	m_persistent.storeSensorCalibrations.write_check = WRITE_CHECK;
+    }
+    if (!load_record(alarmConfig,&m_persistent.storeAlarmConfig,sizeof(storeAlarmConfig_t),&m_persistent.storeAlarmConfig.write_check)){
+	memset(&m_persistent.storeAlarmConfig,0,sizeof(storeAlarmConfig_t));
+	m_persistent.storeAlarmConfig.write_check = WRITE_CHECK;
+	m_persistent.storeAlarmConfig.alarmConfig.pH_hysteresis_x100 = DEFAULT_PH_HYSTERESIS_X100;
+	m_persistent.storeAlarmConfig.alarmConfig.EC_hysteresis_uS = DEFAULT_EC_HYSTERESIS_US;
+	m_persistent.storeAlarmConfig.alarmConfig.dwell_s = DEFAULT_ALARM_DWELL_S;
+	ladybug_flash_mark_dirty(alarmConfig);
+    }
+    if (!load_record(plantInfo,&m_persistent.storePlantInfo,sizeof(storePlantInfo_t),&m_persistent.storePlantInfo.write_check)){
+	//the flash storage for plant info is 32 bytes - which is the BLOCK_SIZE
+	memset(&m_persistent.storePlantInfo, '?', BLOCK_SIZE);
+	m_persistent.storePlantInfo.write_check = WRITE_CHECK;
+	ladybug_flash_mark_dirty(plantInfo);
+    }
+    if (!load_record(calibrationValues,&m_persistent.storeCalibrationValues,sizeof(storeCalibrationValues_t),&m_persistent.storeCalibrationValues.write_check)){
+	//calibration values have not been stored
+	m_persistent.storeCalibrationValues.write_check = WRITE_CHECK;
+	reset_all_calibration_values();
+    }
+    //the name has no write_check.  A name that hasn't been written since the log was added was written if its block isn't erased.
+    char device_name_in_storage_block[BLOCK_SIZE];
+    uint8_t version;
+    uint32_t err_code = copy_record(deviceName,&device_name_in_storage_block,BLOCK_SIZE,&version);
+    bool name_is_valid = err_code == NRF_SUCCESS ||
+	(err_code == LADYBUG_ERROR_FLASH_LEGACY_RECORD && 0xFF != (uint8_t)device_name_in_storage_block[0]);
+    if (!name_is_valid){
+	memcpy(&device_name_in_storage_block,DEFAULT_DEVICE_NAME,sizeof(DEFAULT_DEVICE_NAME));
+    }
+    memcpy(m_persistent.device_name,device_name_in_storage_block,DEVNAME_MAX_LEN);
+    ladybug_flash_cache_record(deviceName,(uint8_t *)m_persistent.device_name,DEVNAME_MAX_LEN);
+    if (!name_is_valid || migrate_record(deviceName,version,m_persistent.device_name)){
+	ladybug_flash_mark_dirty(deviceName);
+    }
+  }
+  /**
+   * \callgraph
+   * \brief Load the persistent state from flash (load_persistent_state()), check it against the plant and sensor registries and start
+   * the sampling timer.
+   * \note Call after ladybug_flash_init().  The sampling timer is an app timer, so timers must be initialized first.
+   */
+  void ladybug_hydro_init(void) {
+    SEGGER_RTT_WriteString(0,"--> IN ladybug_hydro_init\n");
+    load_persistent_state();
+    ladybug_stats_reset(&m_pH_statistics);
+    ladybug_stats_reset(&m_EC_VIN_statistics);
+    ladybug_stats_reset(&m_EC_VOUT_statistics);
+    ladybug_plants_init();
+    ladybug_sensors_init();
+    //a calibration made for a different sensor (the registry changed) is dropped.
+    for (uint8_t sensor = 0; sensor < NUM_SENSORS; sensor++) {
+	sensorCalibration_t *p_calibration = &m_persistent.storeSensorCalibrations.calibrations[sensor];
+	if (p_calibration->type != ladybug_sensor_type(sensor) || p_calibration->num_points > ladybug_sensor_num_calibration_points(sensor)) {
+	    memset(p_calibration,0,sizeof(sensorCalibration_t));
+	    p_calibration->type = ladybug_sensor_type(sensor);
+	}
+    }
+    find_plant_target();
+    //A Ladybug that was calibrated before there was a calibration history starts the history with the calibration in use.
+    for (calibration_point_t point = pH4Point;point < NUM_CALIBRATION_POINTS;point++){
+	if (m_persistent.storeCalibrationHistory.history[point].count == 0){
+	    push_calibration_history(point);
+	}
+    }
+    //calibration values written before there was a probe health have erased flash where the probe health is.
+    update_probe_health();
+    uint32_t err_code = app_timer_create(&m_sampling_timer_id,APP_TIMER_MODE_REPEATED,sampling_timeout_handler);
+    APP_ERROR_CHECK(err_code);
+    err_code = app_timer_create(&m_settling_timer_id,APP_TIMER_MODE_REPEATED,settling_timeout_handler);
+    APP_ERROR_CHECK(err_code);
+    start_sampling_timer();
+  }
+  /**
+   * \callgraph
+   * \brief The client has sent a new sampling config.  The timer is restarted with the new period and the config is (lazily) written to flash.
+   */
+  void ladybug_update_sampling_config(uint16_t period_s, uint16_t pH_delta_mV, uint16_t EC_delta_mV) {
+    SEGGER_RTT_printf(0,"---> in ladybug_update_sampling_config.  period: %d, pH delta: %d, EC delta: %d\n",period_s,pH_delta_mV,EC_delta_mV);
+    m_persistent.storeSamplingConfig.samplingConfig.period_s = period_s;
+    m_persistent.storeSamplingConfig.samplingConfig.pH_delta_mV = pH_delta_mV;
+    m_persistent.storeSamplingConfig.samplingConfig.EC_delta_mV = EC_delta_mV;
+    start_sampling_timer();
+    ladybug_flash_mark_dirty(samplingConfig);
+  }
+  /**
+   * \callgraph
+   * \brief The client has asked for new pH and EC readings.  Like scheduled measurements, the readings are taken in the main loop.
+   */
+  void ladybug_request_measurement(void) {
+    m_take_requested_measurement = true;
+  }
+  /**
+   * \callgraph
+   * \brief Hides the flags set by the sampling timer and by a client request.
+   * @param p_requested_by_client	set to true if the client asked for the measurement (and so should always be notified).
+   * @return	true if a measurement should be taken.
+   */
+  bool ladybug_there_is_a_measurement_to_take(bool *p_requested_by_client) {
+    *p_requested_by_client = false;
+    if (true == m_take_requested_measurement){
+	m_take_requested_measurement = false;
+	m_take_scheduled_measurement = false;
+	*p_requested_by_client = true;
+	return true;
+    }
+    if (true == m_take_scheduled_measurement){
+	m_take_scheduled_measurement = false;
 	return true;
     }
     return false;
   }
-  /***
+  /**
+   * \brief absolute difference between two mV readings
+   */
+  static uint16_t mV_difference(int16_t a, int16_t b) {
+    return (a > b) ? (uint16_t)(a - b) : (uint16_t)(b - a);
+  }
+  /**
    * \callgraph
-   * \brief Masks the global variable flag that requests a flash write of the plant info values
+   * \brief Compare the measurements with what the client was last notified of.
+   * @return true if pH or either EC reading has moved by more than the configured delta.
    */
-  bool ladybug_there_are_plantInfo_values_to_write(storePlantInfo_t **p_storePlantInfo){
-    if (true == m_write_plantInfo_values){
-	m_write_plantInfo_values = false;
-	*p_storePlantInfo = &m_storePlantInfo;
+  bool ladybug_measurements_moved_beyond_delta(measurements_t *p_measurements) {
+    samplingConfig_t *p_config = &m_persistent.storeSamplingConfig.samplingConfig;
+    if (mV_difference(p_measurements->pH_mV, m_last_notified_measurements.pH_mV) > p_config->pH_delta_mV){
 	return true;
     }
+    for (int i=0;i<2;i++){
+	if (mV_difference(p_measurements->EC_mV[i], m_last_notified_measurements.EC_mV[i]) > p_config->EC_delta_mV){
+	    return true;
+	}
+    }
     return false;
   }
   /**
    * \callgraph
-   * \brief Hides a flag that says the device name has been changed by the client and it needs to be stored in Flash.
-   * @return	true if the device name has been  updated over BLE.  Otherwise, false
+   * \brief The client was sent these measurements.  Future deltas are measured from them.
    */
-  bool ladybug_the_device_name_has_been_updated(char ** p_deviceName){
-    if (true == m_write_device_name){
-	m_write_device_name = false;
-	*p_deviceName = m_device_name;
-	return true;
+  void ladybug_measurements_were_notified(measurements_t *p_measurements) {
+    m_last_notified_measurements = *p_measurements;
+  }
+  /**
+   * \brief remove the point at index from the EC calibration table, keeping the rest of the points in order.
+   */
+  static void remove_EC_calibration_point_at(ECcalibrationTable_t *p_table, uint8_t index) {
+    for (uint8_t i=index;i+1<p_table->num_points;i++){
+	p_table->points[i] = p_table->points[i+1];
+    }
+    p_table->num_points--;
+    memset(&p_table->points[p_table->num_points],0,sizeof(ECcalibrationPoint_t));
+  }
+  /**
+   * \callgraph
+   * \brief The EC probe is in a calibration solution.  Read the probe and add a point to the EC calibration table.  A point with the same
+   * solution value (or the same probe reading) is replaced.
+   * @param solution	the calibration solution's value in µS/cm.
+   */
+  void ladybug_add_EC_calibration_point(uint16_t solution) {
+    SEGGER_RTT_printf(0,"---> in ladybug_add_EC_calibration_point.  solution value: %d\n",solution);
+    int16_t EC_VIN_and_VOUT_mV[2];
+    uint8_t quality = 0;
+    get_EC_reading(EC_VIN_and_VOUT_mV,&quality);
+    uint16_t ratio = ladybug_sensors_EC_ratio(EC_VIN_and_VOUT_mV);
+    if (ratio == 0 || solution == 0 || (quality & QUALITY_EC_UNUSABLE)){
+	SEGGER_RTT_WriteString(0,"...the EC reading or the solution value can't be used for calibration\n");
+	return;
+    }
+    ECcalibrationTable_t table = m_persistent.storeECcalibrationTable.ECcalibrationTable;
+    for (uint8_t i=0;i<table.num_points;i++){
+	if (table.points[i].solution == solution || table.points[i].ratio == ratio){
+	    remove_EC_calibration_point_at(&table,i);
+	    break;
+	}
+    }
+    if (table.num_points >= EC_TABLE_MAX_POINTS){
+	SEGGER_RTT_WriteString(0,"...the EC calibration table is full\n");
+	return;
+    }
+    //insert, keeping the points sorted by ratio.
+    uint8_t i = table.num_points;
+    while (i > 0 && table.points[i-1].ratio > ratio){
+	table.points[i] = table.points[i-1];
+	i--;
+    }
+    table.points[i].solution = solution;
+    table.points[i].ratio = ratio;
+    table.num_points++;
+    CRITICAL_REGION_ENTER();
+    m_persistent.storeECcalibrationTable.ECcalibrationTable = table;
+    CRITICAL_REGION_EXIT();
+    ladybug_flash_mark_dirty(ECcalibrationTable);
+  }
+  /**
+   * \callgraph
+   * \brief Remove the point with the solution value from the EC calibration table.
+   * @param solution	the calibration solution's value in µS/cm.
+   */
+  void ladybug_remove_EC_calibration_point(uint16_t solution) {
+    SEGGER_RTT_printf(0,"---> in ladybug_remove_EC_calibration_point.  solution value: %d\n",solution);
+    ECcalibrationTable_t table = m_persistent.storeECcalibrationTable.ECcalibrationTable;
+    for (uint8_t i=0;i<table.num_points;i++){
+	if (table.points[i].solution == solution){
+	    remove_EC_calibration_point_at(&table,i);
+	    CRITICAL_REGION_ENTER();
+	    m_persistent.storeECcalibrationTable.ECcalibrationTable = table;
+	    CRITICAL_REGION_EXIT();
+	    ladybug_flash_mark_dirty(ECcalibrationTable);
+	    return;
+	}
+    }
+    SEGGER_RTT_WriteString(0,"...there is no point with that solution value\n");
+  }
+  /**
+   * \callgraph
+   * \brief copy the EC calibration table.
+   */
+  void ladybug_get_EC_calibration_table(ECcalibrationTable_t *p_ECcalibrationTable) {
+    *p_ECcalibrationTable = m_persistent.storeECcalibrationTable.ECcalibrationTable;
+  }
+  /**
+   * \callgraph
+   * \brief Step a calibration point back to the calibration made before the one in use.  The calibration values are then (lazily) written to flash.
+   * @param command	undoPH4, undoPH7, undoEC1, or undoEC2
+   * @return		false if there is no older calibration in the history.
+   */
+  bool ladybug_undo_calibration(control_enum_t command) {
+    SEGGER_RTT_printf(0,"---> in ladybug_undo_calibration.  command: %d\n",command);
+    calibration_point_t point = calibration_point_of(command);
+    if (point >= NUM_CALIBRATION_POINTS){
+	return false;
+    }
+    calibrationHistory_t *p_history = &m_persistent.storeCalibrationHistory.history[point];
+    if (p_history->undone + 1 >= p_history->count){
+	SEGGER_RTT_WriteString(0,"...nothing to undo\n");
+	return false;
+    }
+    p_history->undone++;
+    apply_calibration_point(point,&p_history->entries[history_index(p_history,p_history->undone)]);
+    print_out_calibration_values();
+    update_probe_health();
+    ladybug_flash_mark_dirty(calibrationValues);
+    ladybug_flash_mark_dirty(calibrationHistory);
+    return true;
+  }
+  /**
+   * \callgraph
+   * \brief Step a calibration point forward to the calibration that was undone.
+   * @param command	redoPH4, redoPH7, redoEC1, or redoEC2
+   * @return		false if nothing has been undone.
+   */
+  bool ladybug_redo_calibration(control_enum_t command) {
+    SEGGER_RTT_printf(0,"---> in ladybug_redo_calibration.  command: %d\n",command);
+    calibration_point_t point = calibration_point_of(command);
+    if (point >= NUM_CALIBRATION_POINTS){
+	return false;
+    }
+    calibrationHistory_t *p_history = &m_persistent.storeCalibrationHistory.history[point];
+    if (p_history->undone == 0){
+	SEGGER_RTT_WriteString(0,"...nothing to redo\n");
+	return false;
+    }
+    p_history->undone--;
+    apply_calibration_point(point,&p_history->entries[history_index(p_history,p_history->undone)]);
+    print_out_calibration_values();
+    update_probe_health();
+    ladybug_flash_mark_dirty(calibrationValues);
+    ladybug_flash_mark_dirty(calibrationHistory);
+    return true;
+  }
+  /**
+   * \callgraph
+   * \brief Function provides the memory location where the calibration history is kept.
+   */
+  void ladybug_get_calibration_history(storeCalibrationHistory_t **p_storeCalibrationHistory) {
+    *p_storeCalibrationHistory = &m_persistent.storeCalibrationHistory;
+  }
+  /**
+   * \callgraph
+   * \brief The client has sent new alarm thresholds.  The alarms start over against the new thresholds.
+   */
+  void ladybug_update_alarm_config(alarmConfig_t const *p_alarmConfig) {
+    SEGGER_RTT_printf(0,"---> in ladybug_update_alarm_config.  pH: %d - %d, EC: %d - %d, dwell: %ds\n",p_alarmConfig->pH_low_x100,
+		      p_alarmConfig->pH_high_x100,p_alarmConfig->EC_low_uS,p_alarmConfig->EC_high_uS,p_alarmConfig->dwell_s);
+    CRITICAL_REGION_ENTER();
+    m_persistent.storeAlarmConfig.alarmConfig = *p_alarmConfig;
+    m_persistent.storeAlarmConfig.alarmConfig.unused = 0;
+    ladybug_alarms_reset();
+    m_alarms = 0;
+    CRITICAL_REGION_EXIT();
+    ladybug_flash_mark_dirty(alarmConfig);
+  }
+  /**
+   * @return the ALARM_PH_LOW, ALARM_PH_HIGH, ALARM_EC_LOW, and ALARM_EC_HIGH alarms raised by the last measurement.
+   */
+  uint8_t ladybug_get_alarms(void) {
+    return m_alarms;
+  }
+  /**
+   * \brief one channel of the forecast.
+   * @param p_forecast		the channel's window
+   * @param low			the low threshold (0 is off)
+   * @param high			the high threshold (0 is off)
+   * @param period_s		the time between readings
+   * @param p_slope_per_hour	how fast the reading is moving
+   * @param p_minutes		the minutes to the threshold, FORECAST_UNKNOWN if heading nowhere
+   * @return			the threshold the reading is heading for
+   */
+  static forecast_heading_t forecast_channel(forecast_t const *p_forecast, uint16_t low, uint16_t high, uint16_t period_s,
+					     int16_t *p_slope_per_hour, uint16_t *p_minutes) {
+    int32_t slope_per_hour = (int32_t)(((int64_t)ladybug_forecast_slope_q8(p_forecast) * 3600 / period_s) >> 8);
+    *p_slope_per_hour = ladybug_fixed_sat_s16(slope_per_hour);
+    uint16_t readings;
+    forecast_heading_t heading = ladybug_forecast_readings_to_threshold(p_forecast,low,high,&readings);
+    *p_minutes = readings;
+    if (readings != FORECAST_UNKNOWN) {
+	*p_minutes = clamp((uint32_t)readings * period_s / 60,0,FORECAST_UNKNOWN - 1);
+    }
+    return heading;
+  }
+  /**
+   * \callgraph
+   * \brief Add the last measurement to the forecast and work out when the pH and EC will cross the alarm thresholds.
+   * \note Call only after a scheduled measurement - the forecast's readings must be a sampling period apart.  An unusable reading is left out.
+   * @param p_report	the forecast
+   */
+  void ladybug_update_forecast(forecastReport_t *p_report) {
+    SEGGER_RTT_WriteString(0,"---> in ladybug_update_forecast\n");
+    measurements_t measurements;
+    ladybug_get_measurements(&measurements);
+    plantTarget_t thresholds;
+    uint16_t period_s = m_persistent.storeSamplingConfig.samplingConfig.period_s;
+    memset(p_report,0,sizeof(forecastReport_t));
+    CRITICAL_REGION_ENTER();
+    if (!(measurements.quality & QUALITY_PH_UNUSABLE)) {
+	ladybug_forecast_add(&m_pH_forecast,measurements.pH_x100);
+    }
+    if (!(measurements.quality & QUALITY_EC_UNUSABLE)) {
+	ladybug_forecast_add(&m_EC_forecast,measurements.EC_uS);
+    }
+    ladybug_alarms_thresholds(&m_persistent.storeAlarmConfig.alarmConfig,m_p_plant_target,&thresholds);
+    if (period_s != 0) {
+	static const uint8_t pH_heading[] = {[headingNowhere] = 0,[headingLow] = ALARM_PH_LOW,[headingHigh] = ALARM_PH_HIGH};
+	static const uint8_t EC_heading[] = {[headingNowhere] = 0,[headingLow] = ALARM_EC_LOW,[headingHigh] = ALARM_EC_HIGH};
+	p_report->heading = pH_heading[forecast_channel(&m_pH_forecast,thresholds.pH_min_x100,thresholds.pH_max_x100,period_s,
+						       &p_report->pH_slope_x100_per_hour,&p_report->pH_minutes_to_threshold)];
+	p_report->heading |= EC_heading[forecast_channel(&m_EC_forecast,thresholds.EC_min_uS,thresholds.EC_max_uS,period_s,
+							&p_report->EC_slope_uS_per_hour,&p_report->EC_minutes_to_threshold)];
+    }
+    p_report->readings = m_pH_forecast.count > m_EC_forecast.count ? m_pH_forecast.count : m_EC_forecast.count;
+    CRITICAL_REGION_EXIT();
+  }
+  /**
+   * \callgraph
+   * \brief The client has asked for a calibration (or to check whether the reading has settled).  The ADC is only used from the main loop,
+   * so the calibration is made there.  A calibration that waits takes a reading every SETTLING_PERIOD_S and is made once the reading is
+   * stable.  A new request replaces one that is waiting.
+   * @param command		calibratePH4, calibratepH7, calibratePH10, calibrateEC1, calibrateEC2, addECcalibrationPoint, checkPHsettling, or
+   * 				checkECsettling.
+   * 				calibrateSensor comes through ladybug_request_sensor_calibration().
+   * @param solution		the calibration solution's value in µS/cm for the EC calibrations (the reference for calibrateSensor).
+   * @param wait_until_stable	false calibrates right away (what older clients expect).
+   */
+  void ladybug_request_calibration(control_enum_t command, uint16_t solution, bool wait_until_stable) {
+    SEGGER_RTT_printf(0,"---> in ladybug_request_calibration.  command: %d, solution: %d, wait: %d\n",command,solution,wait_until_stable);
+    static const uint32_t app_timer_prescaler = 0;
+    uint32_t err_code = app_timer_stop(m_settling_timer_id);
+    APP_ERROR_CHECK(err_code);
+    CRITICAL_REGION_ENTER();
+    m_calibration_command = command;
+    m_calibration_solution = solution;
+    m_calibration_waits = wait_until_stable || command == checkPHsettling || command == checkECsettling;
+    m_calibration_pending = true;
+    m_settling_elapsed_s = 0;
+    ladybug_settling_reset(&m_settling);
+    CRITICAL_REGION_EXIT();
+    if (m_calibration_waits){
+	err_code = app_timer_start(m_settling_timer_id, APP_TIMER_TICKS(SETTLING_PERIOD_S * 1000, app_timer_prescaler), NULL);
+	APP_ERROR_CHECK(err_code);
+    }
+    //the first reading (or the calibration) happens right away.
+    m_take_calibration_step = true;
+  }
+  /**
+   * \callgraph
+   * \brief The client has asked to calibrate one of the sensors in the registry other than the first pH and EC sensors.  The calibration is
+   * made in the main loop like the pH and EC calibrations.
+   * @param sensor		index into the registry
+   * @param point		which calibration point.  The points are calibrated in order.
+   * @param reference		the calibration solution's value in the sensor's units.
+   * @param wait_until_stable	false calibrates right away.
+   */
+  void ladybug_request_sensor_calibration(uint8_t sensor, uint8_t point, int16_t reference, bool wait_until_stable) {
+    SEGGER_RTT_printf(0,"---> in ladybug_request_sensor_calibration.  sensor: %d, point: %d, reference: %d\n",sensor,point,reference);
+    if (sensor >= NUM_SENSORS || sensor == ladybug_sensors_find(sensorPH) || sensor == ladybug_sensors_find(sensorEC) ||
+	point >= ladybug_sensor_num_calibration_points(sensor) || point > m_persistent.storeSensorCalibrations.calibrations[sensor].num_points) {
+	SEGGER_RTT_WriteString(0,"...the sensor can't be calibrated at this point\n");
+	return;
+    }
+    CRITICAL_REGION_ENTER();
+    m_calibration_sensor = sensor;
+    m_calibration_point = point;
+    CRITICAL_REGION_EXIT();
+    ladybug_request_calibration(calibrateSensor,(uint16_t)reference,wait_until_stable);
+  }
+  /**
+   * \callgraph
+   * \brief Forget a sensor's calibration.
+   */
+  void ladybug_reset_sensor_calibration(uint8_t sensor) {
+    SEGGER_RTT_printf(0,"---> in ladybug_reset_sensor_calibration.  sensor: %d\n",sensor);
+    if (sensor >= NUM_SENSORS) {
+	return;
+    }
+    CRITICAL_REGION_ENTER();
+    memset(&m_persistent.storeSensorCalibrations.calibrations[sensor],0,sizeof(sensorCalibration_t));
+    m_persistent.storeSensorCalibrations.calibrations[sensor].type = ladybug_sensor_type(sensor);
+    CRITICAL_REGION_EXIT();
+    ladybug_flash_mark_dirty(sensorCalibrations);
+  }
+  void ladybug_get_sensor_calibrations(storeSensorCalibrations_t **p_storeSensorCalibrations) {
+    *p_storeSensorCalibrations = &m_persistent.storeSensorCalibrations;
+  }
+  /**
+   * \callgraph
+   * \brief Hides the flag set by the settling timer and by a calibration request.
+   */
+  bool ladybug_there_is_a_calibration_step(void) {
+    if (true == m_take_calibration_step){
+	m_take_calibration_step = false;
+	return m_calibration_pending;
     }
     return false;
   }
-  void ladybug_get_device_name(char **p_deviceName) {
-    SEGGER_RTT_WriteString(0,"---> IN ladybug_get_device_name\n");
-    char device_name_in_storage_block[BLOCK_SIZE];
-    memset(&device_name_in_storage_block, 0, BLOCK_SIZE);
-    ladybug_flash_read(deviceName,(uint8_t *)&device_name_in_storage_block,did_flash_read);
-    uint8_t first_char_of_device_name = device_name_in_storage_block[0];
-    if (0xFF == first_char_of_device_name){
-	memcpy(&device_name_in_storage_block,DEFAULT_DEVICE_NAME,sizeof(DEFAULT_DEVICE_NAME));
-	m_write_device_name = true;
+  /**
+   * \brief make the calibration the client asked for.
+   */
+  static void calibrate_sensor(uint8_t sensor, uint8_t point, int16_t reference) {
+    sensorReading_t reading;
+    ladybug_sensor_acquire(sensor,&reading);
+    int32_t response = ladybug_sensor_response(sensor,&reading);
+    SEGGER_RTT_printf(0,"...sensor %d point %d: reference %d, response %d\n",sensor,point,reference,response);
+    sensorCalibration_t *p_calibration = &m_persistent.storeSensorCalibrations.calibrations[sensor];
+    CRITICAL_REGION_ENTER();
+    p_calibration->reference[point] = reference;
+    p_calibration->response[point] = response;
+    if (point == p_calibration->num_points) {
+	p_calibration->num_points++;
+    }
+    CRITICAL_REGION_EXIT();
+    ladybug_flash_mark_dirty(sensorCalibrations);
+  }
+  static void calibrate(control_enum_t command, uint16_t solution, uint8_t sensor, uint8_t point) {
+    switch (command) {
+      case calibratePH4:
+      case calibratepH7:
+      case calibratePH10:
+      case calibrateEC1:
+      case calibrateEC2:
+	ladybug_update_calibration_value(command,solution);
+	break;
+      case addECcalibrationPoint:
+	ladybug_add_EC_calibration_point(solution);
+	break;
+      case calibrateSensor:
+	calibrate_sensor(sensor,point,(int16_t)solution);
+	break;
+      default:  //checkPHsettling and checkECsettling only report on the reading.
+	break;
     }
-    *p_deviceName = m_device_name;
-    SEGGER_RTT_printf(0,"maximum length for the device name: %d\n",DEVNAME_MAX_LEN);
-    memcpy(m_device_name,device_name_in_storage_block,DEVNAME_MAX_LEN);
   }
   /**
-   * \brief write the device name the client has sent to flash.  This could happen within the ble service code.  For now I'm keeping
-   * flash writes for the Ladybug all within the ladybug code.
-   * @param p_device_name	a pointer to the device name string of characters
-   * @param len		the length of the device name string. The length cannot be greater than the max bytes allowed for the name.
+   * \callgraph
+   * \brief Take a reading for the calibration that is waiting and make the calibration once the reading is stable.
+   * \note called from the main loop.
+   * @param p_status	filled in with the state of the reading.
+   * @return		true if the calibration is finished - it was made, or the reading didn't settle in SETTLING_TIMEOUT_S.
    */
-  void ladybug_write_device_name(char *p_device_name,uint16_t len){
-    len > DEVNAME_MAX_LEN ? DEVNAME_MAX_LEN : len;
-    for (int i=0;i<len;i++){
-	m_device_name[i] = *(p_device_name+i);
+  bool ladybug_calibration_step(settlingStatus_t *p_status) {
+    SEGGER_RTT_WriteString(0,"---> in ladybug_calibration_step\n");
+    control_enum_t command;
+    uint16_t solution;
+    uint8_t sensor, point;
+    bool waits;
+    CRITICAL_REGION_ENTER();
+    command = m_calibration_command;
+    solution = m_calibration_solution;
+    sensor = m_calibration_sensor;
+    point = m_calibration_point;
+    waits = m_calibration_waits;
+    CRITICAL_REGION_EXIT();
+    memset(p_status,0,sizeof(settlingStatus_t));
+    p_status->command = command;
+    if (!waits){
+	calibrate(command,solution,sensor,point);
+	m_calibration_pending = false;
+	p_status->state = settlingIdle;
+	return true;
+    }
+    bool is_pH = (command == calibratePH4 || command == calibratepH7 || command == calibratePH10 || command == checkPHsettling);
+    if (command == calibrateSensor){
+	sensorReading_t reading;
+	ladybug_sensor_acquire(sensor,&reading);
+	p_status->reading_mV = reading.mV[ladybug_sensor_num_AINs(sensor) - 1];
+	//the probes read as an AIN less VGND settle like the pH probe.
+	is_pH = (ladybug_sensor_type(sensor) != sensorEC);
+    }else if (is_pH){
+	p_status->reading_mV = get_pH_reading(NULL);
+    }else {
+	int16_t EC_VIN_and_VOUT_mV[2];
+	get_EC_reading(EC_VIN_and_VOUT_mV,NULL);
+	p_status->reading_mV = EC_VIN_and_VOUT_mV[1];
+    }
+    ladybug_settling_add(&m_settling,p_status->reading_mV);
+    p_status->elapsed_s = m_settling_elapsed_s;
+    p_status->state = ladybug_settling_check(&m_settling,SETTLING_PERIOD_S,is_pH ? PH_STABLE_SLOPE_MV_PER_MIN : EC_STABLE_SLOPE_MV_PER_MIN,
+					     &p_status->slope_per_min,&p_status->time_to_stable_s);
+    m_settling_elapsed_s += SETTLING_PERIOD_S;
+    if (p_status->state == settlingInProgress && p_status->elapsed_s < SETTLING_TIMEOUT_S){
+	return false;
+    }
+    uint32_t err_code = app_timer_stop(m_settling_timer_id);
+    APP_ERROR_CHECK(err_code);
+    m_calibration_pending = false;
+    if (p_status->state == settlingStable){
+	SEGGER_RTT_printf(0,"...the reading is stable after %ds\n",p_status->elapsed_s);
+	calibrate(command,solution,sensor,point);
+    }else {
+	SEGGER_RTT_WriteString(0,"...the reading didn't settle.  Nothing was calibrated.\n");
+	p_status->state = settlingTimedOut;
     }
-    m_write_device_name =true;
+    return true;
   }
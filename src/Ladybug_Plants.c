@@ -0,0 +1,167 @@
+/**
+ * \file		Ladybug_Plants.c
+ * \brief	The plant target table and its perfect hash.
+ * \details	The key of a plant is the FNV-1a hash of its lower case type, a 0 byte, and its lower case stage.  The slot of a key is
+ * 		(key * PLANT_HASH_MULTIPLIER) >> (32 - PLANT_HASH_BITS).  PLANT_HASH_MULTIPLIER is picked (by trying odd multipliers) so
+ * 		that no two plants in m_plant_targets share a slot.  The tables are generated by tools/plant_hash.py from its list of plants:
+ * 		add a plant there, run it and paste its output here.  tools/plant_hash.py --check checks this file against the list, and
+ * 		ladybug_plants_init() checks the two tables agree.
+ * \sa		Ladybug_Plants.h
+ */
+#define	DEBUG	///< Used in app_error.h to give line / function name input.
+
+#include <stdbool.h>
+#include "Ladybug_Plants.h"
+#include "Ladybug_Error.h"
+#include "app_error.h"
+#include "SEGGER_RTT.h"
+
+#define PLANT_HASH_BITS		6
+#define PLANT_HASH_SLOTS	(1 << PLANT_HASH_BITS)
+#define PLANT_HASH_MULTIPLIER	0xabb01fb9
+#define FNV_OFFSET_BASIS	2166136261u
+#define FNV_PRIME		16777619u
+
+typedef struct {
+  uint32_t	key;
+  plantTarget_t	target;
+}plantTargetEntry_t;
+/**
+ * \brief pH and EC targets for hydroponic growing.
+ */
+static plantTargetEntry_t const m_plant_targets[] = {
+    {0x2778b23e,{550,650, 400, 800}}, ///<lettuce seedling
+    {0xd888c3f2,{550,650, 800,1200}}, ///<lettuce youth
+    {0xdbbfdb17,{550,650,1000,1400}}, ///<lettuce mature
+    {0x9d5e341c,{550,650, 800,1200}}, ///<tomato seedling
+    {0x067a9144,{550,650,1500,2500}}, ///<tomato youth
+    {0xa1284915,{550,650,2000,3500}}, ///<tomato mature
+    {0x2bc1e192,{550,600, 800,1200}}, ///<cucumber seedling
+    {0xa5d5cd26,{550,600,1500,2000}}, ///<cucumber youth
+    {0x88b15fbb,{550,600,1700,2500}}, ///<cucumber mature
+    {0x01d4fa9d,{550,650, 500, 800}}, ///<basil seedling
+    {0x68ff2edf,{550,650,1000,1400}}, ///<basil youth
+    {0x9ea49de0,{550,650,1000,1600}}, ///<basil mature
+    {0x31ed0a61,{550,620, 600,1000}}, ///<strawberry seedling
+    {0xfac14913,{550,620,1000,1400}}, ///<strawberry youth
+    {0xe2620644,{550,620,1400,1800}}, ///<strawberry mature
+    {0x9e97c672,{580,630, 800,1200}}, ///<pepper seedling
+    {0x790f8086,{580,630,1400,2000}}, ///<pepper youth
+    {0xc5d3d99b,{580,630,1800,2800}}, ///<pepper mature
+    {0xc9804374,{600,700, 600,1000}}, ///<spinach seedling
+    {0xb8b42e6c,{600,700,1400,1800}}, ///<spinach youth
+    {0x1727c52d,{600,700,1800,2300}}, ///<spinach mature
+    {0xaedf4873,{550,650, 600,1000}}, ///<kale seedling
+    {0x9823f779,{550,650,1200,1600}}, ///<kale youth
+    {0xabf9bc16,{550,650,1250,1500}}, ///<kale mature
+};
+/**
+ * \brief m_plant_slots[slot] is 1 + the index into m_plant_targets of the plant in the slot.  0 means the slot is empty.
+ */
+static uint8_t const m_plant_slots[PLANT_HASH_SLOTS] = {
+    [6] = 1,
+    [25] = 2,
+    [1] = 3,
+    [42] = 4,
+    [52] = 5,
+    [39] = 6,
+    [44] = 7,
+    [9] = 8,
+    [63] = 9,
+    [18] = 10,
+    [61] = 11,
+    [47] = 12,
+    [45] = 13,
+    [34] = 14,
+    [12] = 15,
+    [36] = 16,
+    [14] = 17,
+    [48] = 18,
+    [0] = 19,
+    [22] = 20,
+    [10] = 21,
+    [2] = 22,
+    [16] = 23,
+    [33] = 24,
+};
+
+static char lower_case(char c) {
+  return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+/**
+ * \brief add a string (which stops at a 0 byte or at len) to an FNV-1a hash.
+ */
+static uint32_t fnv1a(uint32_t hash, char const *p_string, size_t len) {
+  for (size_t i = 0; i < len && p_string[i] != 0; i++) {
+      hash ^= (uint8_t)lower_case(p_string[i]);
+      hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+static uint8_t slot_of(uint32_t key) {
+  return (uint32_t)(key * PLANT_HASH_MULTIPLIER) >> (32 - PLANT_HASH_BITS);
+}
+/**
+ * \callgraph
+ * \brief Check every plant in m_plant_targets is in the slot its key hashes to.
+ */
+void ladybug_plants_init(void) {
+  SEGGER_RTT_WriteString(0,"--> IN ladybug_plants_init\n");
+  for (uint8_t i = 0; i < sizeof(m_plant_targets)/sizeof(m_plant_targets[0]); i++) {
+      if (m_plant_slots[slot_of(m_plant_targets[i].key)] != i + 1) {
+	  SEGGER_RTT_printf(0,"...plant %d is not in its slot\n",i);
+	  APP_ERROR_HANDLER(LADYBUG_ERROR_PLANT_TABLE);
+	  return;
+      }
+  }
+}
+/**
+ * \callgraph
+ * \brief find the pH and EC targets of a plant.  This is called when the plant info changes, not when measuring.
+ * @param type		the plant type (e.g.: Tomato).  Doesn't need to be 0 terminated.
+ * @param type_len	the most characters type can have
+ * @param stage		the growth stage (e.g.: Seedling)
+ * @param stage_len	the most characters stage can have
+ * @return		NULL if the Ladybug doesn't know the plant
+ */
+plantTarget_t const *ladybug_plants_find_target(char const *type, size_t type_len, char const *stage, size_t stage_len) {
+  uint32_t key = fnv1a(FNV_OFFSET_BASIS,type,type_len);
+  key = (key ^ 0) * FNV_PRIME;  //the 0 byte between the type and the stage
+  key = fnv1a(key,stage,stage_len);
+  uint8_t entry = m_plant_slots[slot_of(key)];
+  //a plant that isn't in the table hashes to some slot, so the key is checked
+  if (entry == 0 || m_plant_targets[entry - 1].key != key) {
+      return NULL;
+  }
+  return &m_plant_targets[entry - 1].target;
+}
+/**
+ * \callgraph
+ * \brief check readings against a plant's targets.
+ * @param p_target	the plant's targets.  NULL if the plant isn't known.
+ * @param pH_x100	0 if the pH isn't known (the probe hasn't been calibrated)
+ * @param EC_uS		0 if the EC isn't known (the EC calibration table is empty)
+ * @return		PLANT_PH_LOW, PLANT_PH_HIGH, PLANT_EC_LOW, and/or PLANT_EC_HIGH.  0 if the readings are in range or can't be checked.
+ */
+uint8_t ladybug_plants_out_of_range(plantTarget_t const *p_target, uint16_t pH_x100, uint16_t EC_uS) {
+  uint8_t out_of_range = 0;
+  if (p_target == NULL) {
+      return 0;
+  }
+  if (pH_x100 != 0) {
+      if (pH_x100 < p_target->pH_min_x100) {
+	  out_of_range |= PLANT_PH_LOW;
+      } else if (pH_x100 > p_target->pH_max_x100) {
+	  out_of_range |= PLANT_PH_HIGH;
+      }
+  }
+  if (EC_uS != 0) {
+      if (EC_uS < p_target->EC_min_uS) {
+	  out_of_range |= PLANT_EC_LOW;
+      } else if (EC_uS > p_target->EC_max_uS) {
+	  out_of_range |= PLANT_EC_HIGH;
+      }
+  }
+  return out_of_range;
+}
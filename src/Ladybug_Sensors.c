@@ -0,0 +1,334 @@
+/**
+ * \file		Ladybug_Sensors.c
+ * \brief	Takes the readings of the sensors in the registry and turns a calibrated response into the sensor's units.
+ * \details	The pH, ORP, and DO probes are read the same way - an AIN less the probe's virtual ground.  The EC probe reads the
+ * 		rectified EC_VIN and EC_VOUT, discharging each rectifier's cap before each sample.
+ * \sa		Ladybug_Sensors.h
+ */
+#define	DEBUG	///< Used in app_error.h to give line / function name input.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "nrf_gpio.h"
+#include "app_error.h"
+#include "Ladybug_Error.h"
+#include "Ladybug_Sensors.h"
+#include "Ladybug_Fixed.h"
+#include "SEGGER_RTT.h"
+
+extern ADC_interface adc;
+/**
+ * \brief How each AIN is sampled and judged for a reading's quality.
+ */
+#define RAIL_MARGIN_MV		20	///<a reading this close to ground or the supply is railed.
+#define VGND_SPREAD_MAX_MV	10
+#define EC_OPEN_VIN_MIN_MV	50	///<VIN must be at least this for a missing VOUT to mean the probe is open.
+#define EC_OPEN_VOUT_MAX_MV	5
+
+typedef struct {
+  uint8_t	type;	///<sensor_type_t
+  uint8_t	VGND;
+  uint8_t	AIN[SENSOR_MAX_AINS];
+}sensor_t;
+typedef struct {
+  int16_t	mV;		///<what the pipeline made of the samples
+  int16_t	spread_mV;	///<the highest sample - the lowest
+}AIN_reading_t;
+/**
+ * \brief What is passed along the AIN pipeline.
+ */
+typedef struct {
+  uint8_t	AIN;
+  uint8_t	num_samples;
+  int16_t	samples[PIPELINE_MAX_SAMPLES];
+  AIN_reading_t	reading;
+}AIN_pipeline_t;
+/**
+ * \brief What each sensor type declares.
+ */
+typedef struct {
+  uint8_t	num_AINs;
+  uint8_t	num_calibration_points;
+  bool		through_zero;		///<with one calibration point the value is proportional to the response (rather than offset from it).
+  int16_t	spread_max_mV;		///<samples spread by more than this make the reading NOISY
+  void		(*acquire)(sensor_t const *p_sensor, int16_t spread_max_mV, sensorReading_t *p_reading);
+  int32_t	(*response)(sensorReading_t const *p_reading);
+}sensorSchema_t;
+
+static void acquire_differential(sensor_t const *p_sensor, int16_t spread_max_mV, sensorReading_t *p_reading);
+static void acquire_EC(sensor_t const *p_sensor, int16_t spread_max_mV, sensorReading_t *p_reading);
+static int32_t mV_response(sensorReading_t const *p_reading);
+static int32_t EC_response(sensorReading_t const *p_reading);
+
+static sensorSchema_t const m_schemas[NUM_SENSOR_TYPES] = {
+    [sensorPH]  = {1,2,false,10,acquire_differential,mV_response},	///<10mV is about 0.17 pH
+    [sensorEC]  = {2,2,true, 30,acquire_EC,EC_response},
+    [sensorORP] = {1,1,false,10,acquire_differential,mV_response},
+    [sensorDO]  = {1,2,true, 10,acquire_differential,mV_response},
+};
+#define SENSOR_ENTRY(type, VGND, AIN0, AIN1)	{type, VGND, {AIN0, AIN1}},
+static sensor_t const m_sensors[NUM_SENSORS] = {
+    LADYBUG_SENSORS(SENSOR_ENTRY)
+};
+/**
+ * \brief mapping the FET pins to the schematic
+ */
+static uint32_t	m_EC_VIN_FET	=	0;
+static uint32_t m_EC_VOUT_FET	=	7;
+
+/**
+ * \callgraph
+ * \brief Check the registry.  Called once at startup.
+ */
+void ladybug_sensors_init(void) {
+  SEGGER_RTT_printf(0,"--> IN ladybug_sensors_init.  %d sensors\n",NUM_SENSORS);
+  for (uint8_t i = 0; i < NUM_SENSORS; i++) {
+      if (m_sensors[i].type >= NUM_SENSOR_TYPES ||
+	  (m_sensors[i].type == sensorEC && (m_sensors[i].AIN[0] != EC_VIN || m_sensors[i].AIN[1] != EC_VOUT))) {
+	  SEGGER_RTT_printf(0,"...sensor %d is not a sensor this board can read\n",i);
+	  APP_ERROR_HANDLER(LADYBUG_ERROR_SENSOR_REGISTRY);
+	  return;
+      }
+  }
+}
+/**
+ * @return the index of the first sensor of the type.  SENSOR_NOT_FOUND if there isn't one.
+ */
+uint8_t ladybug_sensors_find(sensor_type_t type) {
+  for (uint8_t i = 0; i < NUM_SENSORS; i++) {
+      if (m_sensors[i].type == type) {
+	  return i;
+      }
+  }
+  return SENSOR_NOT_FOUND;
+}
+sensor_type_t ladybug_sensor_type(uint8_t sensor) {
+  return (sensor_type_t)m_sensors[sensor].type;
+}
+uint8_t ladybug_sensor_num_AINs(uint8_t sensor) {
+  return m_schemas[m_sensors[sensor].type].num_AINs;
+}
+uint8_t ladybug_sensor_num_calibration_points(uint8_t sensor) {
+  return m_schemas[m_sensors[sensor].type].num_calibration_points;
+}
+/**
+ * \brief The rectifier circuit for both EC VIN and VOUT have a FET attached to drain the cap as the cap will inevitably discharge causing voltage readings to be higher than they
+ * actually are.  This is a standard "thing" for a rectifier circuit.  As I understand it, many rectifiers use a resistor but I felt using a FET would get a better ADC reading.
+ * @param which_AIN	Either the AIN assigned to EC_VIN or EC_VOUTa
+ */
+static void discharge (uint8_t which_AIN)
+{
+  if (EC_VIN != which_AIN && EC_VOUT != which_AIN) {
+      APP_ERROR_HANDLER(LADYBUG_ERROR_INVALID_COMMAND);
+  }
+  uint32_t pin_number;
+  //set the GPIO based on whether the current ADC reading is for the VIN or VOUT
+  if (EC_VIN == which_AIN) {
+      pin_number = m_EC_VIN_FET;
+  }
+  else {
+      pin_number = m_EC_VOUT_FET;
+  }
+  //configure the GPIO for output
+  nrf_gpio_cfg_output(pin_number);
+  //discharge the cap by setting the GPIO to HIG
+  nrf_gpio_pin_set(pin_number);
+  //open the FET's gate so the ADC picks up an accurate measurement
+  nrf_gpio_pin_clear(pin_number);
+}
+/**
+ * \brief The AIN pipeline's stages.  They are put together at compile time by LADYBUG_AIN_PIPELINE, so each is inlined into read_AIN()
+ * and a stage that isn't in the pipeline isn't compiled in.
+ */
+static inline void stage_acquire(AIN_pipeline_t *p_pipeline, uint8_t num_samples) {
+  p_pipeline->num_samples = num_samples > PIPELINE_MAX_SAMPLES ? PIPELINE_MAX_SAMPLES : num_samples;
+  for (uint8_t i = 0; i < p_pipeline->num_samples; i++) {
+      if (EC_VIN == p_pipeline->AIN || EC_VOUT == p_pipeline->AIN) {
+	  discharge(p_pipeline->AIN);
+      }
+      p_pipeline->samples[i] = adc.read(p_pipeline->AIN);
+  }
+}
+static inline void stage_median(AIN_pipeline_t *p_pipeline, uint8_t window) {
+  if (window < 3 || window > p_pipeline->num_samples) {
+      return;
+  }
+  //a run starts at i, so once its median is worked out samples[i] isn't needed again and can hold it.
+  for (uint8_t i = 0; i + window <= p_pipeline->num_samples; i++) {
+      int16_t run[PIPELINE_MAX_SAMPLES];
+      for (uint8_t j = 0; j < window; j++) {
+	  int16_t sample = p_pipeline->samples[i + j];
+	  uint8_t k = j;
+	  for (; k > 0 && run[k - 1] > sample; k--) {
+	      run[k] = run[k - 1];
+	  }
+	  run[k] = sample;
+      }
+      p_pipeline->samples[i] = run[window / 2];
+  }
+  p_pipeline->num_samples -= window - 1;
+}
+static inline void stage_spread(AIN_pipeline_t *p_pipeline, uint8_t unused) {
+  int16_t min_mV = INT16_MAX;
+  int16_t max_mV = INT16_MIN;
+  for (uint8_t i = 0; i < p_pipeline->num_samples; i++) {
+      min_mV = p_pipeline->samples[i] < min_mV ? p_pipeline->samples[i] : min_mV;
+      max_mV = p_pipeline->samples[i] > max_mV ? p_pipeline->samples[i] : max_mV;
+  }
+  p_pipeline->reading.spread_mV = p_pipeline->num_samples == 0 ? 0 : max_mV - min_mV;
+}
+static inline void stage_mean(AIN_pipeline_t *p_pipeline, uint8_t unused) {
+  int32_t sum_mV = 0;
+  for (uint8_t i = 0; i < p_pipeline->num_samples; i++) {
+      sum_mV += p_pipeline->samples[i];
+  }
+  p_pipeline->reading.mV = ladybug_fixed_div_small(sum_mV,p_pipeline->num_samples);
+}
+#define RUN_STAGE(stage, argument)	stage_##stage(p_pipeline, (argument));
+/**
+ * \callgraph
+ * \brief read an AIN through the stages of LADYBUG_AIN_PIPELINE.
+ */
+static void read_AIN(uint8_t which_AIN, AIN_reading_t *p_reading) {
+  AIN_pipeline_t pipeline;
+  AIN_pipeline_t * const p_pipeline = &pipeline;
+  pipeline.AIN = which_AIN;
+  pipeline.num_samples = 0;
+  pipeline.reading.mV = 0;
+  pipeline.reading.spread_mV = 0;
+  LADYBUG_AIN_PIPELINE(RUN_STAGE)
+  *p_reading = pipeline.reading;
+}
+/**
+ * \brief The AINs can't go above the supply.  The battery AIN is used as the supply rail (the ADC's full scale if it reads oddly).
+ */
+static int16_t supply_mV(void) {
+  int32_t battery_mV = adc.read(battery_level_AIN);
+  return (battery_mV <= RAIL_MARGIN_MV * 2 || battery_mV > ADC_FULL_SCALE_MV) ? ADC_FULL_SCALE_MV : battery_mV;
+}
+static bool is_railed(AIN_reading_t const *p_reading, int16_t rail_mV) {
+  return p_reading->mV <= RAIL_MARGIN_MV || p_reading->mV >= rail_mV - RAIL_MARGIN_MV;
+}
+static bool is_bad_VGND(AIN_reading_t const *p_VGND, int16_t rail_mV) {
+  return is_railed(p_VGND,rail_mV) || p_VGND->spread_mV > VGND_SPREAD_MAX_MV;
+}
+/**
+ * \callgraph
+ * \brief Reads the sensor's AIN as well as the VGND used since the power source does not go negative.
+ */
+static void acquire_differential(sensor_t const *p_sensor, int16_t spread_max_mV, sensorReading_t *p_reading) {
+  AIN_reading_t VGND, AIN;
+  int16_t rail_mV = supply_mV();
+  read_AIN(p_sensor->VGND,&VGND);
+  read_AIN(p_sensor->AIN[0],&AIN);
+  p_reading->mV[0] = AIN.mV - VGND.mV;
+  SEGGER_RTT_printf(0,"VGND: %d , AIN: %d, mV = AIN-VGND = %d\n",VGND.mV,AIN.mV,p_reading->mV[0]);
+  if (is_railed(&AIN,rail_mV)) {
+      p_reading->quality |= SENSOR_QUALITY_RAILED;
+  }
+  if (is_bad_VGND(&VGND,rail_mV)) {
+      p_reading->quality |= SENSOR_QUALITY_VGND;
+  }
+  if (AIN.spread_mV > spread_max_mV) {
+      p_reading->quality |= SENSOR_QUALITY_NOISY;
+  }
+}
+/**
+ * \callgraph
+ * \brief It is assumed the EC probe is in some type of water so the EC can be measured.  This might be a calibration solution or a nutrient bath.
+ * Gets readings from the EC's VGND, VIN, VOUT AINs.  mV[0] is VIN and mV[1] is VOUT, without VGND.
+ */
+static void acquire_EC(sensor_t const *p_sensor, int16_t spread_max_mV, sensorReading_t *p_reading) {
+  SEGGER_RTT_WriteString(0,"---> IN acquire_EC\n");
+  AIN_reading_t VGND, VIN, VOUT;
+  int16_t rail_mV = supply_mV();
+  read_AIN(p_sensor->VGND,&VGND);
+  SEGGER_RTT_printf(0,"EC_VGND: %d  0X%x\n",VGND.mV,VGND.mV);
+  //EC VIN and EC VOUT have a rectifier step in which there is a FET that stabilizes the rectification by discharging the cap to prevent an upward drift..
+  //I wrote some blog posts on this...there are FET pins assigned for both so, read_AIN() discharges before each sample.
+  read_AIN(p_sensor->AIN[0],&VIN);
+  p_reading->mV[0] = VIN.mV-VGND.mV;
+  SEGGER_RTT_printf(0,"EC_VIN after subtracting VGND: %d 0X%x\n",p_reading->mV[0],p_reading->mV[0]);
+  read_AIN(p_sensor->AIN[1],&VOUT);
+  p_reading->mV[1] = VOUT.mV-VGND.mV;
+  SEGGER_RTT_printf(0,"EC_VOUT after subtracting VGND: %d 0X%x\n",p_reading->mV[1],p_reading->mV[1]);
+  if (VIN.mV >= rail_mV - RAIL_MARGIN_MV || VOUT.mV >= rail_mV - RAIL_MARGIN_MV) {
+      p_reading->quality |= SENSOR_QUALITY_RAILED;
+  }
+  if (is_bad_VGND(&VGND,rail_mV)) {
+      p_reading->quality |= SENSOR_QUALITY_VGND;
+  }
+  //VOUT at ground is what an open probe reads, so it is told apart from a railed VIN.
+  if (p_reading->mV[0] >= EC_OPEN_VIN_MIN_MV && p_reading->mV[1] <= EC_OPEN_VOUT_MAX_MV) {
+      p_reading->quality |= SENSOR_QUALITY_OPEN;
+  } else if (VIN.mV <= RAIL_MARGIN_MV) {
+      p_reading->quality |= SENSOR_QUALITY_RAILED;
+  }
+  if (VIN.spread_mV > spread_max_mV || VOUT.spread_mV > spread_max_mV) {
+      p_reading->quality |= SENSOR_QUALITY_NOISY;
+  }
+}
+/**
+ * \callgraph
+ * \brief take a reading of one of the sensors in the registry.
+ * @param sensor	index into the registry
+ * @param p_reading	the reading and its quality
+ */
+void ladybug_sensor_acquire(uint8_t sensor, sensorReading_t *p_reading) {
+  if (p_reading == NULL) {
+      APP_ERROR_HANDLER(LADYBUG_ERROR_NULL_POINTER);
+      return;
+  }
+  sensor_t const *p_sensor = &m_sensors[sensor];
+  sensorSchema_t const *p_schema = &m_schemas[p_sensor->type];
+  p_reading->mV[0] = 0;
+  p_reading->mV[1] = 0;
+  p_reading->quality = 0;
+  p_schema->acquire(p_sensor,p_schema->spread_max_mV,p_reading);
+}
+static int32_t mV_response(sensorReading_t const *p_reading) {
+  return p_reading->mV[0];
+}
+/**
+ * \brief The probe's EC response: EC_VOUT / EC_VIN in Q12.
+ * @param p_EC		EC VIN and EC VOUT mV
+ * @return		the ratio in Q12.  0 if there isn't a usable reading (e.g.: the probe is not in solution).
+ */
+uint16_t ladybug_sensors_EC_ratio(int16_t const *p_EC) {
+  if (p_EC[0] <= 0 || p_EC[1] <= 0) {
+      return 0;
+  }
+  uint32_t ratio = ((uint32_t)p_EC[1] << 12) / (uint32_t)p_EC[0];
+  return ratio > UINT16_MAX ? UINT16_MAX : (uint16_t)ratio;
+}
+static int32_t EC_response(sensorReading_t const *p_reading) {
+  return ladybug_sensors_EC_ratio(p_reading->mV);
+}
+/**
+ * @return what the sensor's calibration is made against - mV, or EC_VOUT/EC_VIN in Q12 for EC.
+ */
+int32_t ladybug_sensor_response(uint8_t sensor, sensorReading_t const *p_reading) {
+  return m_schemas[m_sensors[sensor].type].response(p_reading);
+}
+/**
+ * \callgraph
+ * \brief Turn a response into the sensor's units.  Two points give a line through both.  One point gives an offset (or, for a sensor that
+ * reads 0 at 0, a gain).
+ * @param p_calibration	the sensor's calibration
+ * @param response	from ladybug_sensor_response()
+ * @return		the value in the sensor's units.  0 if the sensor has not been calibrated.
+ */
+int32_t ladybug_sensor_value(sensorCalibration_t const *p_calibration, int32_t response) {
+  int32_t const *p_response = p_calibration->response;
+  int16_t const *p_reference = p_calibration->reference;
+  if (p_calibration->num_points == 0 || p_calibration->type >= NUM_SENSOR_TYPES) {
+      return 0;
+  }
+  if (p_calibration->num_points == 1 || p_response[1] == p_response[0]) {
+      if (m_schemas[p_calibration->type].through_zero) {
+	  return p_response[0] == 0 ? 0 : (int32_t)((int64_t)p_reference[0] * response / p_response[0]);
+      }
+      return p_reference[0] + (response - p_response[0]);
+  }
+  return p_reference[0] + (int32_t)((int64_t)(response - p_response[0]) * (p_reference[1] - p_reference[0]) / (p_response[1] - p_response[0]));
+}
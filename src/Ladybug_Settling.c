@@ -0,0 +1,92 @@
+/**
+ * \file		Ladybug_Settling.c
+ * \brief	The settling detector.
+ * \details	The readings are taken period_s apart, so the least squares slope over n readings is sum(k * reading) / sum(k * k) per
+ * 		reading, where k is the (doubled, so it is an integer) distance of a reading from the middle of the window.
+ * \sa		Ladybug_Settling.h
+ */
+#include <stddef.h>
+#include "Ladybug_Settling.h"
+#include "Ladybug_Fixed.h"
+
+#define HALF_WINDOW	(SETTLING_WINDOW / 2)
+
+void ladybug_settling_reset(settling_t *p_settling) {
+  p_settling->count = 0;
+  p_settling->newest = 0;
+}
+
+void ladybug_settling_add(settling_t *p_settling, int16_t reading) {
+  if (p_settling->count > 0) {
+      p_settling->newest = (p_settling->newest + 1) % SETTLING_WINDOW;
+  }
+  if (p_settling->count < SETTLING_WINDOW) {
+      p_settling->count++;
+  }
+  p_settling->readings[p_settling->newest] = reading;
+}
+/**
+ * \brief the reading i places after the oldest.
+ */
+static int16_t reading(settling_t const *p_settling, uint8_t i) {
+  return p_settling->readings[(p_settling->newest + 1 + i) % SETTLING_WINDOW];
+}
+/**
+ * \brief the least squares slope over n readings starting at first, in units per minute.
+ */
+static int32_t slope_per_min(settling_t const *p_settling, uint8_t first, uint8_t n, uint16_t period_s) {
+  int32_t sum_ky = 0;
+  int32_t sum_kk = 0;
+  for (uint8_t i = 0; i < n; i++) {
+      int32_t k = 2 * i - (n - 1);
+      sum_ky += k * reading(p_settling,first + i);
+      sum_kk += k * k;
+  }
+  //slope per reading = 2 * sum_ky / sum_kk because k is doubled
+  return 2 * sum_ky * 60 / (sum_kk * period_s);
+}
+
+static int32_t absolute(int32_t value) {
+  return value < 0 ? -value : value;
+}
+/**
+ * \callgraph
+ * \brief Is the reading stable yet?
+ * @param p_settling		the readings
+ * @param period_s		the seconds between readings
+ * @param stable_slope_per_min	the reading is stable when it moves less than this per minute
+ * @param p_slope_per_min	the slope over the window.  0 until the window is full.
+ * @param p_time_to_stable_s	the estimated seconds until the reading is stable.  0 if it is.  SETTLING_UNKNOWN_TIME if it can't be
+ * 				estimated (the window isn't full, or the reading isn't settling down).
+ * @return			settlingInProgress or settlingStable
+ */
+settling_state_t ladybug_settling_check(settling_t const *p_settling, uint16_t period_s, int16_t stable_slope_per_min,
+					int16_t *p_slope_per_min, uint16_t *p_time_to_stable_s) {
+  *p_slope_per_min = 0;
+  *p_time_to_stable_s = SETTLING_UNKNOWN_TIME;
+  if (p_settling->count < SETTLING_WINDOW || period_s == 0) {
+      return settlingInProgress;
+  }
+  int32_t slope = slope_per_min(p_settling,0,SETTLING_WINDOW,period_s);
+  *p_slope_per_min = ladybug_fixed_sat_s16(slope);
+  if (absolute(slope) <= stable_slope_per_min) {
+      *p_time_to_stable_s = 0;
+      return settlingStable;
+  }
+  //a settling probe's slope shrinks about exponentially.  If it shrank by older/newer over half a window, it shrinks by newer/stable
+  //in half a window * log(newer/stable) / log(older/newer).
+  int32_t older = absolute(slope_per_min(p_settling,0,HALF_WINDOW,period_s));
+  int32_t newer = absolute(slope_per_min(p_settling,HALF_WINDOW,HALF_WINDOW,period_s));
+  if (stable_slope_per_min <= 0) {
+      stable_slope_per_min = 1;
+  }
+  if (newer <= stable_slope_per_min) {
+      //the newest readings have settled, the window just hasn't caught up
+      *p_time_to_stable_s = HALF_WINDOW * period_s;
+  } else if (newer < older) {
+      int32_t time_s = HALF_WINDOW * period_s * (ladybug_fixed_log2_q8(newer) - ladybug_fixed_log2_q8(stable_slope_per_min)) /
+	  (ladybug_fixed_log2_q8(older) - ladybug_fixed_log2_q8(newer));
+      *p_time_to_stable_s = time_s < 0 ? 0 : (time_s >= SETTLING_UNKNOWN_TIME ? SETTLING_UNKNOWN_TIME - 1 : time_s);
+  }
+  return settlingInProgress;
+}
@@ -0,0 +1,67 @@
+/**
+ * \file		Ladybug_Stats.c
+ * \brief	Welford's online algorithm for the mean and variance of the mV readings.
+ * \details	For each reading x: count++, delta = x - mean, mean += delta/count, M2 += delta * (x - mean).  The variance is then
+ * 		M2/(count-1).  Unlike keeping a sum and a sum of squares, this doesn't lose precision when the readings sit on a large offset.
+ * \sa		Ladybug_Stats.h
+ */
+#include <stddef.h>
+#include "Ladybug_Stats.h"
+#include "Ladybug_Fixed.h"
+
+/**
+ * \brief start a new window.
+ */
+void ladybug_stats_reset(welford_t *p_welford) {
+  p_welford->count = 0;
+  p_welford->mean_q8 = 0;
+  p_welford->m2_q16 = 0;
+  p_welford->min = INT16_MAX;
+  p_welford->max = INT16_MIN;
+}
+/**
+ * \brief add a reading to the window.
+ * @param p_welford	the channel's running state.
+ * @param reading_mV	the reading.
+ */
+void ladybug_stats_add(welford_t *p_welford, int16_t reading_mV) {
+  int32_t x_q8 = (int32_t)reading_mV << 8;
+  p_welford->count++;
+  int32_t delta = x_q8 - p_welford->mean_q8;
+  p_welford->mean_q8 += delta / (int32_t)p_welford->count;
+  int32_t delta2 = x_q8 - p_welford->mean_q8;
+  // delta and delta2 have the same sign.  Rounding in the divide can make a tiny product come out negative.
+  int64_t product = (int64_t)delta * delta2;
+  if (product > 0) {
+      p_welford->m2_q16 += (uint64_t)product;
+  }
+  if (reading_mV < p_welford->min) {
+      p_welford->min = reading_mV;
+  }
+  if (reading_mV > p_welford->max) {
+      p_welford->max = reading_mV;
+  }
+}
+/**
+ * \brief turn the running state into the min, max, mean and standard deviation of the window.  An empty window reports all 0's.
+ */
+void ladybug_stats_get(welford_t const *p_welford, channelStatistics_t *p_statistics) {
+  if (p_welford->count == 0) {
+      p_statistics->min = 0;
+      p_statistics->max = 0;
+      p_statistics->mean = 0;
+      p_statistics->std_dev = 0;
+      return;
+  }
+  p_statistics->min = p_welford->min;
+  p_statistics->max = p_welford->max;
+  // round the Q8 mean to the nearest mV
+  int32_t mean_q8 = p_welford->mean_q8;
+  p_statistics->mean = (int16_t)((mean_q8 >= 0 ? mean_q8 + 128 : mean_q8 - 128) / 256);
+  p_statistics->std_dev = 0;
+  if (p_welford->count > 1) {
+      // the variance is Q16, so its square root is Q8.
+      uint32_t std_dev_q8 = ladybug_fixed_isqrt64(p_welford->m2_q16 / (p_welford->count - 1));
+      p_statistics->std_dev = (uint16_t)((std_dev_q8 + 128) >> 8);
+  }
+}
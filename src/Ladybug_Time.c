@@ -0,0 +1,76 @@
+/**
+ * \file		Ladybug_Time.c
+ * \brief	Keeps the seconds clock using an app timer.
+ * \details	The RTC1 counter app_timer runs on is 24 bits and overflows every 512s (prescaler = 0).  A repeated app timer fires every
+ * 		CLOCK_TICK_S seconds to carry the seconds forward.  Between ticks the seconds are worked out from the RTC1 counter.
+ * \sa		Ladybug_Time.h
+ */
+#define	DEBUG	///< Used in app_error.h to give line / function name input.
+
+#include <stdbool.h>
+#include "Ladybug_Time.h"
+#include "app_timer.h"
+#include "app_error.h"
+#include "app_util_platform.h"
+#include "SEGGER_RTT.h"
+
+#define CLOCK_TICK_S		60
+#define RTC_TICKS_PER_SECOND	32768 ///<the app timer prescaler is 0
+#define RTC_COUNTER_MASK	0x00FFFFFF
+
+static app_timer_id_t		m_clock_timer_id;
+static uint32_t			m_seconds_at_tick;   ///<the time when the clock timer last fired
+static uint32_t			m_rtc_ticks_at_tick; ///<the RTC1 counter when the clock timer last fired
+/**
+ * \callgraph
+ * \brief Called by app_timer every CLOCK_TICK_S.  The RTC1 counter is moved forward by exactly the tick so lateness in calling the
+ * handler doesn't add up.
+ */
+static void clock_timeout_handler(void * p_context)
+{
+  UNUSED_PARAMETER(p_context);
+  m_seconds_at_tick += CLOCK_TICK_S;
+  m_rtc_ticks_at_tick = (m_rtc_ticks_at_tick + CLOCK_TICK_S * RTC_TICKS_PER_SECOND) & RTC_COUNTER_MASK;
+}
+/**
+ * \callgraph
+ * \brief Start the clock at 0.
+ * \note App timers must be initialized first.
+ */
+void ladybug_time_init(void) {
+  SEGGER_RTT_WriteString(0,"--> IN ladybug_time_init\n");
+  static const uint32_t app_timer_prescaler = 0;
+  uint32_t err_code = app_timer_create(&m_clock_timer_id,APP_TIMER_MODE_REPEATED,clock_timeout_handler);
+  APP_ERROR_CHECK(err_code);
+  m_seconds_at_tick = 0;
+  err_code = app_timer_cnt_get(&m_rtc_ticks_at_tick);
+  APP_ERROR_CHECK(err_code);
+  err_code = app_timer_start(m_clock_timer_id,APP_TIMER_TICKS(CLOCK_TICK_S * 1000,app_timer_prescaler),NULL);
+  APP_ERROR_CHECK(err_code);
+}
+/**
+ * \callgraph
+ * @return	the seconds since the clock was set (or since the Ladybug started if the clock hasn't been set).
+ */
+uint32_t ladybug_time_now(void) {
+  uint32_t seconds, rtc_ticks_at_tick, rtc_ticks_now, rtc_ticks_since_tick;
+  CRITICAL_REGION_ENTER();
+  seconds = m_seconds_at_tick;
+  rtc_ticks_at_tick = m_rtc_ticks_at_tick;
+  CRITICAL_REGION_EXIT();
+  app_timer_cnt_get(&rtc_ticks_now);
+  app_timer_cnt_diff_compute(rtc_ticks_now,rtc_ticks_at_tick,&rtc_ticks_since_tick);
+  return seconds + rtc_ticks_since_tick / RTC_TICKS_PER_SECOND;
+}
+/**
+ * \callgraph
+ * \brief The client has sent the time.
+ * @param seconds	the time, in whatever seconds the client uses (e.g.: since 1970).
+ */
+void ladybug_time_set(uint32_t seconds) {
+  SEGGER_RTT_printf(0,"---> in ladybug_time_set.  seconds: %u\n",seconds);
+  uint32_t seconds_since_tick = ladybug_time_now() - m_seconds_at_tick;
+  CRITICAL_REGION_ENTER();
+  m_seconds_at_tick = seconds - seconds_since_tick;
+  CRITICAL_REGION_EXIT();
+}
@@ -27,6 +27,9 @@
 #include "Ladybug_BLE.h"
 #include "Ladybug_Flash.h"
 #include "Ladybug_Hydro.h"
+#include "Ladybug_Time.h"
+#include "Ladybug_Fixed.h"
+#include "Ladybug_CRC.h"
 #include "SEGGER_RTT.h"
 
 /**
@@ -53,7 +56,7 @@ static uint32_t const 			m_app_adv_timeout_in_seconds = 0;
 static uint32_t const			m_app_timer_prescaler = 0; 		   /**< Value of the RTC1 PRESCALER register. */
 // I would have preferred to use a static const instead of #define however the SDK requires a precompiled value since it is used
 // within a #define within the SDK.
-#define	APP_TIMER_MAX_TIMERS		4  					   /**< BLE uses at least two timers... I set it to 4 (arbitrary) to give room...Bummer that all app timers need to be initialized here...A bit of a black art */
+#define	APP_TIMER_MAX_TIMERS		6  					   /**< BLE uses at least two timers... conn params, flash, flash debounce, sampling, clock, and settling...Bummer that all app timers need to be initialized here...A bit of a black art */
 #define APP_TIMER_OP_QUEUE_SIZE         4                                           /**< Size of timer operation queues. (copied from SDK examples) */
 static ble_gap_sec_params_t             m_sec_params;                               /**< Security requirements for this application. (copied from SDK examples)*/
 static uint16_t                         m_conn_handle = BLE_CONN_HANDLE_INVALID;    /**< Handle of the current connection. (copied from SDK examples)*/
@@ -68,19 +71,6 @@ static ble_lbl_t                        m_lbl;					    /**< Instance of the BLE
 
 #define DEAD_BEEF                       0xDEADBEEF                                  /**< Value used as error code on stack dump, can be used to identify stack location on stack unwind. */
 
-/**
- * \callgraph
- * \brief call back from Ladybug_Flash.c to let us know if the flash write was successful (or not)
- * @param err_code	0 if successful
- */
-void did_flash_write(uint32_t err_code) {
-  if (err_code == 0) {
-      SEGGER_RTT_WriteString(0,"...Flash write SUCCESS!");
-  }
-  else {
-      APP_ERROR_HANDLER(err_code);
-  }
-}
 /**@brief Callback function for asserts in the SoftDevice.
  *
  * @details This function will be called in case of an assert in the SoftDevice.
@@ -239,21 +229,15 @@ void advertising_init(void)
 {
   uint32_t      err_code;
   ble_advdata_t advdata;
-  ble_uuid_t adv_uuids[] = {{LBL_UUID_SERVICE,m_lbl.uuid_type}};
+  ble_advdata_t scanrsp;
   // Build and set advertising data
-  memset(&advdata, 0, sizeof(advdata));
-
-  advdata.name_type               = BLE_ADVDATA_FULL_NAME;
-  advdata.include_appearance      = false; //samples typically set this to true.  I don't see why adv bytes should be wasted on this...
-  advdata.flags                   = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
-  advdata.uuids_complete.uuid_cnt = sizeof(adv_uuids)/sizeof(adv_uuids[0]);
-  advdata.uuids_complete.p_uuids  = adv_uuids;
+  ladybug_BLE_advertising_data(&m_lbl,&advdata,&scanrsp);
   //I'm setting these to the same as in the ble_app_template example
   ble_adv_modes_config_t options = {0};
   options.ble_adv_fast_enabled  = BLE_ADV_FAST_ENABLED;
   options.ble_adv_fast_interval = APP_ADV_INTERVAL;
   options.ble_adv_fast_timeout  = m_app_adv_timeout_in_seconds;
-  err_code = ble_advertising_init(&advdata, NULL, &options, on_adv_evt, NULL);
+  err_code = ble_advertising_init(&advdata, &scanrsp, &options, on_adv_evt, NULL);
   APP_ERROR_CHECK(err_code);
 }
 /**@brief Function for the GAP initialization.
@@ -472,6 +456,13 @@ void display_bytes(uint8_t *dest_bytes,int num_bytes){
  */
 int main(void)
 {
+#ifdef LADYBUG_BENCHMARK
+  // Time the fixed point math and the CRC kernels before the SoftDevice's interrupts are running.
+  ladybug_fixed_benchmark();
+  ladybug_crc_benchmark();
+  // Time boot to the first advertisement.  The timer counts at 16MHz, so a count / 16 is in µs.
+  ladybug_fixed_benchmark_start();
+#endif
   //call flash_init() before initializing service.. the ble_lbl_service uses flash to access pH4 and 7 calibration info.... (wow - too many dependencies!)
   //initialize pstorage() - the way i'll read/write from flash.  POR is to use flash to store the calibration info for pH 4 and pH 7..
   //Note in the S110 Softdevice documentation for pstorage, there is a note:
@@ -481,9 +472,19 @@ int main(void)
   ble_stack_init();
   // The app timers rely on the BLE stack being initialized.  This means app timer initialization must happen after BLE initialization.
   timers_init();
+  // The clock stamps the calibration history.  It counts from 0 until the client sends the time.
+  ladybug_time_init();
   // (pstorage api access to) flash and the app timer used within the read/write flash functions require BLE and timers init first.
+#ifdef LADYBUG_BENCHMARK
+  uint32_t load_start = ladybug_fixed_benchmark_now();
+#endif
   ladybug_flash_init();
-  // The device name is needed as a GAP parameter.  This is the first time a flash action (flash read) happens which means BLE and app timer init must happen first.
+  // Everything stored in flash is loaded here in one pass.  The sampling schedule uses an app timer.
+  ladybug_hydro_init();
+#ifdef LADYBUG_BENCHMARK
+  SEGGER_RTT_printf(0,"flash init and loading the persistent state: %d us\n",(ladybug_fixed_benchmark_now() - load_start) / 16);
+#endif
+  // The device name is needed as a GAP parameter.  It was loaded by ladybug_hydro_init().
   char *p_deviceName;
   ladybug_get_device_name(&p_deviceName);
   SEGGER_RTT_printf(0,"Device name: %s \n",p_deviceName);
@@ -495,25 +496,22 @@ int main(void)
   conn_params_init();
   sec_params_init();
   advertising_start();
+#ifdef LADYBUG_BENCHMARK
+  SEGGER_RTT_printf(0,"boot to first advertisement: %d us\n",ladybug_fixed_benchmark_now() / 16);
+  ladybug_fixed_benchmark_stop();
+#endif
   // Enter main loop
   for (;;)
     {
-      //Lazy write of values stored in flash
-      //writing can get messed up if it is done inline with other BLE/sensing activity, and there is no rush.
-      storeCalibrationValues_t *p_storeCalibrationValues;
-      if (true == ladybug_there_are_calibration_values_to_write(&p_storeCalibrationValues)){
-	  SEGGER_RTT_printf(0,"Writing calibration values to flash.  Number of bytes: %d\n",sizeof(storeCalibrationValues_t));
-	  ladybug_flash_write(calibrationValues,(uint8_t *)p_storeCalibrationValues,sizeof(storeCalibrationValues_t),did_flash_write);
-      }
-      storePlantInfo_t *p_storePlantInfo;
-      if (true == ladybug_there_are_plantInfo_values_to_write(&p_storePlantInfo)){
-	  SEGGER_RTT_WriteString(0,"...Writing plantInfo values to flash\n");
-	  ladybug_flash_write(plantInfo,(uint8_t *)p_storePlantInfo,sizeof(storePlantInfo_t),did_flash_write);
+      //Values stored in flash are written by the flash's write-back cache (see ladybug_flash_mark_dirty()) once they stop changing.
+      //Measurements - on the sampling schedule or asked for by the client - are taken here so the ADC is only used from one place.
+      bool requested_by_client;
+      if (true == ladybug_there_is_a_measurement_to_take(&requested_by_client)){
+	  ladybug_BLE_update_measurement(&m_lbl,requested_by_client);
       }
-      char *p_deviceName;
-      if (true == ladybug_the_device_name_has_been_updated(&p_deviceName)){
-	  SEGGER_RTT_WriteString(0,"Writing device name to flash\n");
-	  ladybug_flash_write(deviceName,(uint8_t *)p_deviceName,DEVNAME_MAX_LEN,did_flash_write);
+      //Calibrations use the ADC too, so they are made here (once the reading has settled if the client asked to wait).
+      if (true == ladybug_there_is_a_calibration_step()){
+	  ladybug_BLE_calibration_step(&m_lbl);
       }
       power_manage();
     }
@@ -0,0 +1,101 @@
+/**
+ * \file		bench_boot.c
+ * \brief	Times the part of the boot that reads the persistent state, on the simulated flash (sim_flash.c): ladybug_flash_init(),
+ * 		ladybug_hydro_init(), and the ladybug_get_...() calls main.c and the BLE service make before the first advertisement.
+ * \details	The rest of the boot to the first advertisement (the SoftDevice, GAP, the service's characteristics, advertising) doesn't
+ * 		read flash.  The times are the host's, so they compare one way of loading against another.  They are not the nRF51822's -
+ * 		build with LADYBUG_BENCHMARK on the board for those.
+ * 		The log holds every record, as it does once the Ladybug has been running.  Each boot is a forked process, so the modules'
+ * 		statics start over like they do on the board.
+ */
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "host.h"
+#include "sim_flash.h"
+#include "app_error.h"
+#include "Ladybug_Flash.h"
+#include "Ladybug_ADC.h"
+#include "Ladybug_Hydro.h"
+
+#define BOOTS	200
+
+ADC_interface adc;	///<the sensors aren't read
+uint32_t ladybug_time_now(void) {
+  return 0;
+}
+/**
+ * \brief What a boot passes back.
+ */
+typedef struct {
+  uint64_t	elapsed_ns;
+  uint32_t	operations;	///<flash operations the boot started
+}boot_result_t;
+static boot_result_t	*m_result;
+
+static void boot(void) {
+  char *p_device_name;
+  plantInfo_t *p_plant_info;
+  calibrationValues_t *p_calibration_values;
+  storeCalibrationHistory_t *p_history;
+  storeSensorCalibrations_t *p_sensor_calibrations;
+  ECcalibrationTable_t EC_table;
+  ladybug_flash_init();
+  ladybug_hydro_init();
+  ladybug_get_device_name(&p_device_name);
+  ladybug_get_plantInfo(&p_plant_info);
+  ladybug_get_calibrationValues(&p_calibration_values);
+  ladybug_get_calibration_history(&p_history);
+  ladybug_get_sensor_calibrations(&p_sensor_calibrations);
+  ladybug_get_EC_calibration_table(&EC_table);
+  m_sink = p_device_name[0] + p_plant_info->type[0] + p_calibration_values->pH4_mV + p_history->history[0].count +
+      p_sensor_calibrations->calibrations[0].num_points + EC_table.num_points;
+}
+/**
+ * \brief The boot of a Ladybug with nothing in the log yet writes the defaults.  Flushing them leaves every record in the log.
+ */
+static void first_boot(void) {
+  boot();
+  ladybug_flash_cache_flush();
+  sim_flash_run();
+}
+static void timed_boot(void) {
+  uint32_t operations = g_sim_flash->operations;
+  uint64_t start_ns = host_now_ns();
+  boot();
+  m_result->elapsed_ns = host_now_ns() - start_ns;
+  m_result->operations = g_sim_flash->operations - operations;
+}
+static void run_boot(void (*p_boot)(void)) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+      p_boot();
+      fflush(stdout);
+      _exit(m_failures != 0 || g_app_errors != 0);
+  }
+  int status;
+  waitpid(pid,&status,0);
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+int main(void) {
+  sim_flash_init();
+  m_result = mmap(NULL,sizeof(boot_result_t),PROT_READ | PROT_WRITE,MAP_SHARED | MAP_ANONYMOUS,-1,0);
+  CHECK(m_result != MAP_FAILED);
+  sim_flash_erase_all();
+  run_boot(first_boot);
+  uint64_t total_ns = 0, fewest_ns = UINT64_MAX;
+  uint32_t operations = 0;
+  for (uint32_t i = 0; i < BOOTS; i++) {
+      run_boot(timed_boot);
+      total_ns += m_result->elapsed_ns;
+      fewest_ns = m_result->elapsed_ns < fewest_ns ? m_result->elapsed_ns : fewest_ns;
+      operations += m_result->operations;
+  }
+  printf("  %-32s %8.1f us (fastest %.1f us), %u flash operations\n","loading the persistent state",
+	 (double)total_ns / BOOTS / 1000,(double)fewest_ns / 1000,(unsigned)(operations / BOOTS));
+  //a boot only reads.
+  CHECK(operations == 0);
+  return host_result("bench_boot");
+}
@@ -0,0 +1,70 @@
+/**
+ * \file		bench_crc.c
+ * \brief	Checks the three CRC-32 kernels of Ladybug_CRC.c against each other and the standard check value, and times them.
+ * \details	Ladybug_CRC.c is included with LADYBUG_BENCHMARK so all three static kernels are built.  The byte table is typed out, so
+ * 		each of its entries is checked against the bitwise kernel.  ladybug_crc_benchmark() runs on the host clock (in ns, not
+ * 		cycles) and prints with LADYBUG_TEST_VERBOSE.
+ */
+#define LADYBUG_BENCHMARK
+//Ladybug_CRC.c's benchmark has an m_sink of its own.
+#define m_sink	m_crc_sink
+#include "../src/Ladybug_CRC.c"
+#undef m_sink
+#include "host.h"
+
+#define ITERATIONS	20000
+#define RECORD_BYTES	224	///<the biggest record
+
+static uint64_t m_benchmark_start_ns;
+void ladybug_fixed_benchmark_start(void) {
+  m_benchmark_start_ns = host_now_ns();
+}
+uint32_t ladybug_fixed_benchmark_now(void) {
+  return (uint32_t)(host_now_ns() - m_benchmark_start_ns);
+}
+void ladybug_fixed_benchmark_stop(void) {
+}
+static void check_kernels(void) {
+  static uint8_t const check[] = "123456789";
+  CHECK(ladybug_crc32(CRC32_INITIAL,check,9) == 0xCBF43926);
+  CHECK(~crc32_bitwise(0xFFFFFFFF,check,9) == 0xCBF43926);
+  CHECK(~crc32_nibble(0xFFFFFFFF,check,9) == 0xCBF43926);
+  CHECK(~crc32_byte(0xFFFFFFFF,check,9) == 0xCBF43926);
+  uint32_t wrong_entries = 0;
+  for (uint32_t value = 0; value < 256; value++) {
+      uint8_t byte = value;
+      wrong_entries += m_byte_table[value] != crc32_bitwise(0,&byte,1);
+  }
+  CHECK(wrong_entries == 0);
+  uint8_t bytes[RECORD_BYTES];
+  uint32_t state = 1;
+  uint32_t wrong = 0;
+  for (uint32_t i = 0; i < 2000; i++) {
+      uint32_t num_bytes = i % (RECORD_BYTES + 1);
+      for (uint32_t b = 0; b < num_bytes; b++) {
+	  state = state * 1103515245u + 12345u;
+	  bytes[b] = state >> 16;
+      }
+      uint32_t crc = crc32_bitwise(0xFFFFFFFF,bytes,num_bytes);
+      wrong += crc32_nibble(0xFFFFFFFF,bytes,num_bytes) != crc;
+      wrong += crc32_byte(0xFFFFFFFF,bytes,num_bytes) != crc;
+      //carried on over two calls, like a record stored a chunk at a time.
+      uint32_t split = num_bytes / 3;
+      wrong += ladybug_crc32(ladybug_crc32(CRC32_INITIAL,bytes,split),bytes + split,num_bytes - split) != ~crc;
+  }
+  printf("  %-32s %8u wrong\n","kernels vs bitwise",(unsigned)(wrong + wrong_entries));
+  CHECK(wrong == 0);
+}
+int main(void) {
+  check_kernels();
+  uint8_t bytes[RECORD_BYTES];
+  for (uint32_t i = 0; i < RECORD_BYTES; i++) {
+      bytes[i] = i * 7;
+  }
+  printf("  a %d byte record:\n",RECORD_BYTES);
+  HOST_TIME("bitwise",ITERATIONS,m_sink = crc32_bitwise(0xFFFFFFFF,bytes,RECORD_BYTES));
+  HOST_TIME("nibble table (64 bytes)",ITERATIONS,m_sink = crc32_nibble(0xFFFFFFFF,bytes,RECORD_BYTES));
+  HOST_TIME("byte table (1KB)",ITERATIONS,m_sink = crc32_byte(0xFFFFFFFF,bytes,RECORD_BYTES));
+  ladybug_crc_benchmark();
+  return host_result("bench_crc");
+}
@@ -0,0 +1,130 @@
+/**
+ * \file		bench_fixed.c
+ * \brief	Checks the Ladybug_Fixed ops against double precision and times each against the divide or float it replaces.
+ * \details	Each op's error is the most it is off from the double result, in the op's least significant bit.  div_small and isqrt64
+ * 		are exact.  The multiplies and reciprocal_q16 truncate, so they are off by under 1.  log2_q8's straight line between
+ * 		powers of two is off by at most 0.086, and its fraction is truncated to Q8, so it is off by up to 0.09 (just over 23 in Q8).
+ */
+#include <math.h>
+#include <stdlib.h>
+#include "Ladybug_Fixed.h"
+#include "host.h"
+
+#define ITERATIONS	1000000
+#define LOG2_Q8_ERROR_MAX	24
+
+static uint64_t m_random = 88172645463325252ull;
+/**
+ * \brief xorshift64, so each run checks the same values.
+ */
+static uint64_t random64(void) {
+  m_random ^= m_random << 13;
+  m_random ^= m_random >> 7;
+  m_random ^= m_random << 17;
+  return m_random;
+}
+static void check_div_small(void) {
+  uint32_t wrong = 0;
+  for (uint8_t divisor = 0; divisor <= FIXED_SMALL_DIVISOR_MAX + 2; divisor++) {
+      for (int32_t value = -70000; value <= 70000; value++) {
+	  int32_t expected = divisor == 0 ? 0 : value / divisor;
+	  wrong += ladybug_fixed_div_small(value,divisor) != expected;
+      }
+      for (uint32_t i = 0; i < 100000; i++) {
+	  int32_t value = (int32_t)(random64() % (1u << 29)) - (1 << 28) + 1;
+	  int32_t expected = divisor == 0 ? 0 : value / divisor;
+	  wrong += ladybug_fixed_div_small(value,divisor) != expected;
+      }
+  }
+  printf("  %-32s %8u wrong\n","div_small vs /",(unsigned)wrong);
+  CHECK(wrong == 0);
+}
+static void check_mul(void) {
+  double q15_error = 0, q16_error = 0;
+  for (uint32_t i = 0; i < 1000000; i++) {
+      int16_t a = (int16_t)random64();
+      int16_t b = (int16_t)random64();
+      double expected = (double)a * b / 32768.0;
+      expected = expected > INT16_MAX ? INT16_MAX : expected;
+      q15_error = fmax(q15_error,fabs(ladybug_fixed_q15_mul(a,b) - expected));
+      int32_t c = (int32_t)(random64() % 20000001) - 10000000;
+      int32_t d_q16 = (int32_t)(random64() % (200u << 16)) - (100 << 16);
+      q16_error = fmax(q16_error,fabs(ladybug_fixed_q16_mul(c,d_q16) - (double)c * d_q16 / 65536.0));
+  }
+  printf("  %-32s %8.3f LSB\n","q15_mul vs double",q15_error);
+  printf("  %-32s %8.3f LSB\n","q16_mul vs double",q16_error);
+  CHECK(q15_error < 1.0);
+  CHECK(q16_error < 1.0);
+  CHECK(ladybug_fixed_q15_mul(INT16_MIN,INT16_MIN) == INT16_MAX);
+}
+static void check_reciprocal(void) {
+  double error = 0;
+  for (uint32_t i = 0; i < 1000000; i++) {
+      int32_t numerator = (int32_t)(random64() % 20001) - 10000;
+      int32_t divisor = (int32_t)(random64() % 200001) - 100000;
+      if (divisor == 0) {
+	  continue;
+      }
+      error = fmax(error,fabs(ladybug_fixed_reciprocal_q16(numerator,divisor) - (double)numerator * 65536.0 / divisor));
+  }
+  printf("  %-32s %8.3f LSB\n","reciprocal_q16 vs double",error);
+  CHECK(error < 1.0);
+  CHECK(ladybug_fixed_reciprocal_q16(1,0) == 0);
+  CHECK(ladybug_fixed_reciprocal_q16(INT32_MAX,1) == INT32_MAX);
+  CHECK(ladybug_fixed_reciprocal_q16(INT32_MIN,1) == INT32_MIN);
+}
+static void check_isqrt64(void) {
+  uint32_t wrong = 0;
+  for (uint32_t i = 0; i < 1000000; i++) {
+      uint64_t value = random64() >> (i % 64);
+      unsigned __int128 root = ladybug_fixed_isqrt64(value);
+      wrong += !(root * root <= value && (root + 1) * (root + 1) > value);
+  }
+  wrong += ladybug_fixed_isqrt64(UINT64_MAX) != UINT32_MAX;
+  wrong += ladybug_fixed_isqrt64(0) != 0;
+  printf("  %-32s %8u wrong\n","isqrt64 vs floor(sqrt)",(unsigned)wrong);
+  CHECK(wrong == 0);
+}
+static void check_log2(void) {
+  double error = 0;
+  for (uint32_t value = 1; value < 1000000; value++) {
+      error = fmax(error,fabs(ladybug_fixed_log2_q8(value) - log2(value) * 256.0));
+  }
+  for (uint32_t i = 0; i < 1000000; i++) {
+      uint32_t value = (uint32_t)random64() | 1;
+      error = fmax(error,fabs(ladybug_fixed_log2_q8(value) - log2(value) * 256.0));
+  }
+  printf("  %-32s %8.3f LSB (%.4f)\n","log2_q8 vs double",error,error / 256.0);
+  CHECK(error <= LOG2_Q8_ERROR_MAX);
+}
+/**
+ * \brief the inputs come from here so the compiler can't fold them into constants.
+ */
+static volatile int32_t m_input = 12345;
+
+static void time_ops(void) {
+  int32_t input = m_input;
+  double input_f = m_input;
+  printf("per op, each next to what it replaces:\n");
+  HOST_TIME("the loop",ITERATIONS,m_sink = input + iteration);
+  HOST_TIME("int32 /",ITERATIONS,m_sink = (input + iteration) / ((iteration & 15) + 1));
+  HOST_TIME("div_small",ITERATIONS,m_sink = ladybug_fixed_div_small(input + iteration,(iteration & 15) + 1));
+  HOST_TIME("double *",ITERATIONS,m_sink = (int32_t)((input_f + iteration) * input_f / 32768.0));
+  HOST_TIME("q15_mul",ITERATIONS,m_sink = ladybug_fixed_q15_mul(input + iteration,input));
+  HOST_TIME("q16_mul",ITERATIONS,m_sink = ladybug_fixed_q16_mul(input + iteration,input));
+  HOST_TIME("reciprocal_q16",ITERATIONS,m_sink = ladybug_fixed_reciprocal_q16(300,input + iteration));
+  HOST_TIME("sqrt (double)",ITERATIONS,m_sink = (int32_t)sqrt((double)(input + iteration) * input));
+  HOST_TIME("isqrt64",ITERATIONS,m_sink = ladybug_fixed_isqrt64((uint64_t)(input + iteration) * input));
+  HOST_TIME("log2 (double)",ITERATIONS,m_sink = (int32_t)(log2(input + iteration) * 256.0));
+  HOST_TIME("log2_q8",ITERATIONS,m_sink = ladybug_fixed_log2_q8(input + iteration));
+}
+int main(void) {
+  printf("accuracy:\n");
+  check_div_small();
+  check_mul();
+  check_reciprocal();
+  check_isqrt64();
+  check_log2();
+  time_ops();
+  return host_result("bench_fixed");
+}
@@ -0,0 +1,132 @@
+/**
+ * \file		bench_flash_ops.c
+ * \brief	Counts the flash operations an update of a record takes on the simulated flash (sim_flash.c), before and after the log.
+ * \details	- Before: the records were three BLOCK_SIZE blocks registered with pstorage in one page.  An update was a pstorage_clear()
+ * 		  of the record's block and a pstorage_store().  Clearing a block that shares its page goes through pstorage's swap page:
+ * 		  the swap page is erased, the page is copied to it, the page is erased, and the blocks around the cleared one are copied
+ * 		  back.
+ * 		- After: the record is cached, marked dirty, and flushed to the log (src/Ladybug_Flash.c).  A compaction erases whole log
+ * 		  pages, so pstorage never uses its swap page.
+ * 		Both run on nRF51/pstorage.c as it is built for the board.  Each is a forked process so pstorage's statics start over.
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "host.h"
+#include "sim_flash.h"
+#include "app_error.h"
+#include "Ladybug_Flash.h"
+
+#define UPDATES			1000
+#define RECORD_BYTES_MAX	224
+#define LEGACY_ADDRESS		((SIM_FLASH_PAGES - 2) * SIM_FLASH_PAGE_SIZE)	///<the page below pstorage's swap page
+#define SWAP_ADDRESS		(LEGACY_ADDRESS + SIM_FLASH_PAGE_SIZE)
+
+static uint32_t		m_record[RECORD_BYTES_MAX / sizeof(uint32_t)];	///<word aligned, as pstorage_store() wants it
+static bool		m_pstorage_busy;
+/**
+ * \brief An update changes a few bytes, setting bits as well as clearing them.
+ */
+static void change_record(uint16_t num_bytes, uint32_t update) {
+  uint8_t *p_bytes = (uint8_t *)m_record;
+  for (uint8_t k = 0; k < 4; k++) {
+      p_bytes[(update * 7 + k * 5) % num_bytes] ^= (uint8_t)(update * 31 + k) | 1;
+  }
+}
+static void before_handler(pstorage_handle_t *p_handle, uint8_t op_code, uint32_t result, uint8_t *p_data, uint32_t data_len) {
+  CHECK(result == NRF_SUCCESS);
+  m_pstorage_busy = false;
+}
+static void pstorage_wait(uint32_t err_code) {
+  CHECK(err_code == NRF_SUCCESS);
+  m_pstorage_busy = true;
+  sim_flash_run();
+  CHECK(!m_pstorage_busy);
+}
+/**
+ * \brief The records as they were kept before the log.  FLASH_LOG_PAGES pages are registered first so the blocks land in the page
+ * they were in (the SDK's PSTORAGE_NUM_OF_PAGES was 1).
+ */
+static void run_before(void) {
+  pstorage_module_param_t param = {.cb = before_handler};
+  pstorage_handle_t log_pages, blocks, block;
+  CHECK(pstorage_init() == NRF_SUCCESS);
+  param.block_size = FLASH_PAGE_SIZE;
+  param.block_count = FLASH_LOG_PAGES;
+  CHECK(pstorage_register(&param,&log_pages) == NRF_SUCCESS);
+  param.block_size = BLOCK_SIZE;
+  param.block_count = 3;
+  CHECK(pstorage_register(&param,&blocks) == NRF_SUCCESS);
+  CHECK(blocks.block_id == LEGACY_ADDRESS);
+  pstorage_block_identifier_get(&blocks,1,&block);
+  for (uint32_t update = 0; update < UPDATES; update++) {
+      change_record(BLOCK_SIZE,update);
+      pstorage_wait(pstorage_clear(&block,BLOCK_SIZE));
+      pstorage_wait(pstorage_store(&block,(uint8_t *)m_record,BLOCK_SIZE,0));
+  }
+  CHECK(memcmp((void *)(uintptr_t)block.block_id,m_record,BLOCK_SIZE) == 0);
+}
+static flash_rw_t	m_after_record;
+static uint16_t		m_after_bytes;
+static void run_after(void) {
+  ladybug_flash_init();
+  ladybug_flash_cache_record(m_after_record,(uint8_t *)m_record,m_after_bytes);
+  for (uint32_t update = 0; update < UPDATES; update++) {
+      change_record(m_after_bytes,update);
+      ladybug_flash_mark_dirty(m_after_record);
+      ladybug_flash_cache_flush();
+      sim_flash_run();
+  }
+  uint8_t const *p_bytes;
+  pstorage_size_t num_bytes;
+  uint8_t version;
+  CHECK(ladybug_flash_map(m_after_record,&p_bytes,&num_bytes,&version) == NRF_SUCCESS);
+  CHECK(num_bytes == m_after_bytes && memcmp(p_bytes,m_record,m_after_bytes) == 0);
+}
+/**
+ * \brief Run one of them in a process of its own on erased flash, and print its counts for each update.
+ * @return the erases of each update, in hundredths
+ */
+static uint32_t count(char const *p_label, void (*p_run)(void)) {
+  sim_flash_erase_all();
+  memset(m_record,0xA5,sizeof(m_record));
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+      m_failures = 0;
+      p_run();
+      fflush(stdout);
+      _exit(m_failures != 0 || g_app_errors != 0 || g_sim_flash->overprogrammed != 0);
+  }
+  int status;
+  waitpid(pid,&status,0);
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  printf("  %-32s %6.2f writes %6.2f erases (%.2f of the swap page) per update\n",p_label,
+	 (double)g_sim_flash->writes / UPDATES,(double)g_sim_flash->erases / UPDATES,
+	 (double)sim_flash_page_erases(SWAP_ADDRESS) / UPDATES);
+  return g_sim_flash->erases * 100 / UPDATES;
+}
+int main(void) {
+  static const struct {
+    char const	*p_label;
+    flash_rw_t	record;
+    uint16_t	num_bytes;
+  }after[] = {
+      {"after: 32 byte record",calibrationValues,32},
+      {"after: 64 byte record",ECcalibrationTable,64},
+      {"after: 200 byte record",calibrationHistory,200},
+  };
+  sim_flash_init();
+  uint32_t before_erases = count("before: 32 byte block",run_before);
+  CHECK(sim_flash_page_erases(SWAP_ADDRESS) == UPDATES);
+  for (uint8_t i = 0; i < sizeof(after) / sizeof(after[0]); i++) {
+      m_after_record = after[i].record;
+      m_after_bytes = after[i].num_bytes;
+      uint32_t after_erases = count(after[i].p_label,run_after);
+      CHECK(sim_flash_page_erases(SWAP_ADDRESS) == 0 && sim_flash_page_erases(LEGACY_ADDRESS) == 0);
+      CHECK(after_erases < before_erases);
+  }
+  return host_result("bench_flash_ops");
+}
@@ -0,0 +1,126 @@
+/**
+ * \file		bench_sensors.c
+ * \brief	Runs the AIN pipeline of Ladybug_Sensors.c against a stubbed adc.read(), checks what each stage makes of the samples,
+ * 		and times each stage.
+ * \details	Ladybug_Sensors.c is included so its static stages can be called one at a time.  The RAM is what the pipeline puts on the
+ * 		stack (the pipeline and the median's run) and what the module keeps in RAM.  The tables are const, so they are in flash.
+ */
+#include <string.h>
+#include "../src/Ladybug_Sensors.c"
+#include "host.h"
+
+#define ITERATIONS	200000
+#define SPIKE_MV	400
+
+/**
+ * \brief The stubbed ADC.  Each AIN reads its level with +/-3mV of noise.  Every 8th sample has a spike when m_spikes is set.
+ */
+static int32_t	m_level_mV[8];
+static bool	m_spikes;
+static uint32_t	m_adc_reads;
+static uint32_t	m_noise = 1;
+
+static int32_t stub_adc_read(uint8_t which_ain) {
+  m_noise = m_noise * 1103515245u + 12345u;
+  int32_t mV = m_level_mV[which_ain & 7] + (int32_t)((m_noise >> 16) % 7) - 3;
+  if (m_spikes && (++m_adc_reads & 7) == 0) {
+      mV += SPIKE_MV;
+  }
+  return mV;
+}
+ADC_interface adc = {
+    .read = stub_adc_read
+};
+
+static void set_levels(int32_t VGND_mV, int32_t AIN_mV) {
+  for (uint8_t i = 0; i < 8; i++) {
+      m_level_mV[i] = AIN_mV;
+  }
+  m_level_mV[pH_VGND] = VGND_mV;
+  m_level_mV[EC_VGND] = VGND_mV;
+  m_level_mV[battery_level_AIN] = 3000;
+}
+static void check_pipeline(void) {
+  sensorReading_t reading;
+  uint8_t pH = ladybug_sensors_find(sensorPH);
+  uint8_t EC = ladybug_sensors_find(sensorEC);
+  CHECK(pH != SENSOR_NOT_FOUND && EC != SENSOR_NOT_FOUND);
+  ladybug_sensors_init();
+  CHECK(g_app_errors == 0);
+  //a steady probe reads its level less VGND and is good.
+  set_levels(1500,1700);
+  m_spikes = false;
+  ladybug_sensor_acquire(pH,&reading);
+  CHECK(reading.mV[0] >= 200 - 6 && reading.mV[0] <= 200 + 6);
+  CHECK(reading.quality == 0);
+  //the EC AINs are discharged before each of their samples.
+  uint32_t gpio_sets = g_gpio_sets;
+  ladybug_sensor_acquire(EC,&reading);
+  CHECK(g_gpio_sets - gpio_sets == 2 * 4);
+  CHECK(reading.quality == 0);
+  //the default pipeline has no median, so a spike shows as noise.
+  m_spikes = true;
+  m_adc_reads = 0;
+  ladybug_sensor_acquire(pH,&reading);
+  CHECK(reading.quality & SENSOR_QUALITY_NOISY);
+  m_spikes = false;
+  //an AIN at the supply is railed, a VGND at ground is bad.
+  set_levels(1500,3590);
+  ladybug_sensor_acquire(pH,&reading);
+  CHECK(reading.quality & SENSOR_QUALITY_RAILED);
+  set_levels(0,1700);
+  ladybug_sensor_acquire(pH,&reading);
+  CHECK(reading.quality & SENSOR_QUALITY_VGND);
+  //an EC probe out of the water reads VIN with VOUT at VGND.
+  set_levels(1500,2000);
+  m_level_mV[EC_VOUT] = 1500;
+  ladybug_sensor_acquire(EC,&reading);
+  CHECK(reading.quality & SENSOR_QUALITY_OPEN);
+}
+static void check_stages(void) {
+  AIN_pipeline_t pipeline = {.AIN = pH_AIN};
+  set_levels(1500,1700);
+  m_spikes = true;
+  m_adc_reads = 0;
+  stage_acquire(&pipeline,PIPELINE_MAX_SAMPLES + 4);
+  CHECK(pipeline.num_samples == PIPELINE_MAX_SAMPLES);
+  stage_spread(&pipeline,0);
+  CHECK(pipeline.reading.spread_mV >= SPIKE_MV - 6);
+  //a median of 5 knocks out one spike in every 8 samples.
+  stage_median(&pipeline,5);
+  CHECK(pipeline.num_samples == PIPELINE_MAX_SAMPLES - 4);
+  stage_spread(&pipeline,0);
+  CHECK(pipeline.reading.spread_mV <= 6);
+  stage_mean(&pipeline,0);
+  CHECK(pipeline.reading.mV >= 1700 - 3 && pipeline.reading.mV <= 1700 + 3);
+  m_spikes = false;
+}
+static void time_stages(void) {
+  AIN_pipeline_t pipeline = {.AIN = pH_AIN};
+  AIN_pipeline_t acquired;
+  AIN_reading_t reading;
+  set_levels(1500,1700);
+  stage_acquire(&pipeline,PIPELINE_MAX_SAMPLES);
+  acquired = pipeline;
+  printf("per stage, %d samples (the copy is what each of the others starts with):\n",PIPELINE_MAX_SAMPLES);
+  HOST_TIME("acquire(16)",ITERATIONS,stage_acquire(&pipeline,PIPELINE_MAX_SAMPLES));
+  HOST_TIME("copy",ITERATIONS,(pipeline = acquired, m_sink += pipeline.samples[iteration & 15]));
+  HOST_TIME("copy + median(3)",ITERATIONS,(pipeline = acquired, stage_median(&pipeline,3), m_sink += pipeline.samples[0]));
+  HOST_TIME("copy + median(5)",ITERATIONS,(pipeline = acquired, stage_median(&pipeline,5), m_sink += pipeline.samples[0]));
+  HOST_TIME("copy + spread",ITERATIONS,(pipeline = acquired, stage_spread(&pipeline,0), m_sink += pipeline.reading.spread_mV));
+  HOST_TIME("copy + mean",ITERATIONS,(pipeline = acquired, stage_mean(&pipeline,0), m_sink += pipeline.reading.mV));
+  printf("read_AIN() through LADYBUG_AIN_PIPELINE:\n");
+  HOST_TIME("pH AIN",ITERATIONS,(read_AIN(pH_AIN,&reading), m_sink += reading.mV));
+  HOST_TIME("EC VIN (discharged per sample)",ITERATIONS,(read_AIN(EC_VIN,&reading), m_sink += reading.mV));
+  printf("RAM:\n");
+  printf("  %-32s %8u bytes\n","read_AIN() pipeline (stack)",(unsigned)sizeof(AIN_pipeline_t));
+  printf("  %-32s %8u bytes\n","median's run (stack)",(unsigned)(sizeof(int16_t) * PIPELINE_MAX_SAMPLES));
+  printf("  %-32s %8u bytes\n","module statics",(unsigned)(sizeof(m_EC_VIN_FET) + sizeof(m_EC_VOUT_FET)));
+  printf("  %-32s %8u bytes\n","registry and schemas (flash)",(unsigned)(sizeof(m_sensors) + sizeof(m_schemas)));
+}
+int main(void) {
+  check_pipeline();
+  check_stages();
+  time_stages();
+  return host_result("bench_sensors");
+}
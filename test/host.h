@@ -0,0 +1,48 @@
+/**
+ * \file		host.h
+ * \brief	What the host tests and benchmarks share: a check that counts failures, and a clock to time a loop with.
+ * \details	The times are the host's, so they compare one way of doing something against another.  They are not the nRF51822's cycles -
+ * 		build with LADYBUG_BENCHMARK on the board for those.
+ */
+#ifndef TEST_HOST_H_
+#define TEST_HOST_H_
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+static int m_failures;
+
+#define CHECK(condition)							\
+  do {										\
+      if (!(condition)) {							\
+	  printf("FAILED %s:%d: %s\n",__FILE__,__LINE__,#condition);		\
+	  m_failures++;								\
+      }										\
+  } while (0)
+
+static inline uint64_t host_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+/**
+ * \brief keeps the compiler from throwing away a result that is only timed.
+ */
+static volatile int32_t m_sink;
+
+#define HOST_TIME(label, iterations, statement)					\
+  do {										\
+      uint64_t start_ns = host_now_ns();					\
+      for (uint32_t iteration = 0; iteration < (iterations); iteration++) {	\
+	  statement;								\
+      }										\
+      uint64_t elapsed_ns = host_now_ns() - start_ns;				\
+      printf("  %-32s %8.1f ns\n",(label),(double)elapsed_ns / (iterations));	\
+  } while (0)
+
+static inline int host_result(char const *p_name) {
+  printf("%s: %s\n",p_name,m_failures == 0 ? "PASSED" : "FAILED");
+  return m_failures == 0 ? 0 : 1;
+}
+
+#endif /* TEST_HOST_H_ */
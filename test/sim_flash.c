@@ -0,0 +1,158 @@
+/**
+ * \file		sim_flash.c
+ * \brief	The SoftDevice's flash calls on the host.
+ * \sa		sim_flash.h
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "sim_flash.h"
+#include "nrf.h"
+#include "nrf_soc.h"
+#include "pstorage.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE	MAP_FIXED
+#endif
+
+NRF_FICR_Type	g_nrf_ficr = {SIM_FLASH_PAGE_SIZE,SIM_FLASH_PAGES};
+NRF_UICR_Type	g_nrf_uicr = {0xFFFFFFFF};	///<no bootloader
+sim_flash_t	*g_sim_flash;
+/**
+ * \brief The operation the SoftDevice has taken and not done yet.
+ */
+typedef enum {
+  opNone,
+  opWrite,
+  opErase
+}sim_op_t;
+static sim_op_t		m_op = opNone;
+static uint32_t		*m_p_dst;
+static uint32_t const	*m_p_src;
+static uint32_t		m_size;		///<words to write, or the page to erase
+
+static bool in_flash(uint32_t address, uint32_t num_bytes) {
+  return address >= SIM_FLASH_BASE && address + num_bytes <= SIM_FLASH_BASE + SIM_FLASH_SIZE && address + num_bytes > address;
+}
+/**
+ * \brief Map the flash (erased) and the counts.  Call once, before any fork.
+ */
+void sim_flash_init(void) {
+  void *p_flash = mmap((void *)(uintptr_t)SIM_FLASH_BASE,SIM_FLASH_SIZE,PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE,-1,0);
+  void *p_state = mmap(NULL,sizeof(sim_flash_t),PROT_READ | PROT_WRITE,MAP_SHARED | MAP_ANONYMOUS,-1,0);
+  if (p_flash != (void *)(uintptr_t)SIM_FLASH_BASE || p_state == MAP_FAILED){
+      printf("sim_flash: can't map the flash at 0x%x\n",SIM_FLASH_BASE);
+      exit(2);
+  }
+  g_sim_flash = p_state;
+  sim_flash_erase_all();
+}
+void sim_flash_erase_all(void) {
+  memset((void *)(uintptr_t)SIM_FLASH_BASE,0xFF,SIM_FLASH_SIZE);
+  memset(g_sim_flash->word_writes,0,sizeof(g_sim_flash->word_writes));
+  sim_flash_clear_counts();
+}
+/**
+ * \brief Start the counts over and keep the power on.
+ */
+void sim_flash_clear_counts(void) {
+  memset(g_sim_flash,0,offsetof(sim_flash_t,word_writes));
+  g_sim_flash->cut_at = SIM_NO_CUT;
+  m_op = opNone;
+}
+/**
+ * \brief Have the power go out when an operation is reached.
+ * @param torn_words	SIM_NOT_TORN, SIM_TORN_HALF, or how many words of a write are programmed.  An erase that is torn at all erases
+ * 			the first half of its page.
+ */
+void sim_flash_cut(uint32_t operation, uint32_t torn_words) {
+  g_sim_flash->cut_at = operation;
+  g_sim_flash->torn_words = torn_words;
+}
+uint32_t sim_flash_page_erases(uint32_t address) {
+  return g_sim_flash->page_erases[address / SIM_FLASH_PAGE_SIZE - SIM_FLASH_FIRST_PAGE];
+}
+static void program(uint32_t *p_dst, uint32_t const *p_src, uint32_t num_words) {
+  for (uint32_t i = 0; i < num_words; i++) {
+      uint32_t word = ((uint32_t)(uintptr_t)(p_dst + i) - SIM_FLASH_BASE) / sizeof(uint32_t);
+      if (++g_sim_flash->word_writes[word] > SIM_FLASH_WRITES_MAX) {
+	  g_sim_flash->overprogrammed++;
+      }
+      p_dst[i] &= p_src[i];
+  }
+}
+uint32_t sd_flash_write(uint32_t * const p_dst, uint32_t const * const p_src, uint32_t size) {
+  if (m_op != opNone){
+      return NRF_ERROR_BUSY;
+  }
+  if (((uintptr_t)p_dst & 3) != 0 || ((uintptr_t)p_src & 3) != 0 || !in_flash((uint32_t)(uintptr_t)p_dst,size * sizeof(uint32_t))){
+      return NRF_ERROR_INVALID_ADDR;
+  }
+  if (size == 0 || size > SIM_FLASH_PAGE_SIZE / sizeof(uint32_t)){
+      return NRF_ERROR_INVALID_LENGTH;
+  }
+  m_op = opWrite;
+  m_p_dst = p_dst;
+  m_p_src = p_src;
+  m_size = size;
+  return NRF_SUCCESS;
+}
+uint32_t sd_flash_page_erase(uint32_t page_number) {
+  if (m_op != opNone){
+      return NRF_ERROR_BUSY;
+  }
+  if (page_number < SIM_FLASH_FIRST_PAGE || page_number >= SIM_FLASH_PAGES){
+      return NRF_ERROR_INVALID_ADDR;
+  }
+  m_op = opErase;
+  m_size = page_number;
+  return NRF_SUCCESS;
+}
+/**
+ * \brief Do the operation the SoftDevice has taken and let pstorage know it is done.
+ * @return false if there was none, or the power went out on it.
+ */
+bool sim_flash_step(void) {
+  if (m_op == opNone || g_sim_flash->cut){
+      return false;
+  }
+  sim_op_t op = m_op;
+  m_op = opNone;
+  if (g_sim_flash->operations == g_sim_flash->cut_at){
+      g_sim_flash->cut = true;
+      uint32_t torn_words = g_sim_flash->torn_words;
+      if (op == opWrite && torn_words != SIM_NOT_TORN){
+	  program(m_p_dst,m_p_src,torn_words == SIM_TORN_HALF ? m_size / 2 : (torn_words < m_size ? torn_words : m_size));
+      }else if (op == opErase && torn_words != SIM_NOT_TORN){
+	  memset((uint8_t *)(uintptr_t)(m_size * SIM_FLASH_PAGE_SIZE),0xFF,SIM_FLASH_PAGE_SIZE / 2);
+      }
+      return false;
+  }
+  if (g_sim_flash->operations < SIM_LOGGED_OPERATIONS){
+      g_sim_flash->op_words[g_sim_flash->operations] = op == opWrite ? m_size : 0;
+  }
+  g_sim_flash->operations++;
+  if (op == opWrite){
+      program(m_p_dst,m_p_src,m_size);
+      g_sim_flash->writes++;
+      g_sim_flash->words_written += m_size;
+  }else {
+      uint32_t offset = m_size * SIM_FLASH_PAGE_SIZE - SIM_FLASH_BASE;
+      memset((uint8_t *)(uintptr_t)SIM_FLASH_BASE + offset,0xFF,SIM_FLASH_PAGE_SIZE);
+      memset(g_sim_flash->word_writes + offset / sizeof(uint32_t),0,SIM_FLASH_PAGE_SIZE / sizeof(uint32_t));
+      g_sim_flash->page_erases[m_size - SIM_FLASH_FIRST_PAGE]++;
+      g_sim_flash->erases++;
+  }
+  pstorage_sys_event_handler(NRF_EVT_FLASH_OPERATION_SUCCESS);
+  return true;
+}
+/**
+ * \brief Do the operations until pstorage has none left (or the power goes out).
+ */
+void sim_flash_run(void) {
+  while (sim_flash_step()) { }
+}
@@ -0,0 +1,55 @@
+/**
+ * \file		sim_flash.h
+ * \brief	A host simulator of the nRF51822's flash as the SoftDevice drives it, so nRF51/pstorage.c and Ladybug_Flash.c run on it as
+ * 		they are.
+ * \details	- sd_flash_write() programs 1 -> 0 only (the bytes are ANDed in), and counts how often each word is programmed between
+ * 		  erases.  The nRF51822 allows 2.
+ * 		- sd_flash_page_erase() sets a page to 0xFF and counts the page's erases.
+ * 		- Each call is taken and done later, like the SoftDevice.  sim_flash_step() does the one waiting and calls
+ * 		  pstorage_sys_event_handler() with NRF_EVT_FLASH_OPERATION_SUCCESS, as the SoC event dispatch does on the board.
+ * 		- sim_flash_cut() has the power go out when an operation is reached: it isn't done (or, torn, a write only programs its
+ * 		  first words and an erase only erases the first half of the page) and no event comes.  The flash programs a word at a
+ * 		  time, so a write can be torn after any of its words.
+ * 		The flash and the counts are in shared memory at the flash's own addresses (pstorage works with 32 bit addresses), so a
+ * 		test can fork a process to play a boot and see the flash it left.
+ */
+#ifndef TEST_SIM_FLASH_H_
+#define TEST_SIM_FLASH_H_
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SIM_FLASH_PAGE_SIZE	1024
+#define SIM_FLASH_PAGES		256		///<256KB, the MDB40T's nRF51822
+#define SIM_FLASH_FIRST_PAGE	192		///<only the top of the flash is simulated.  pstorage's pages are there.
+#define SIM_FLASH_BASE		(SIM_FLASH_FIRST_PAGE * SIM_FLASH_PAGE_SIZE)
+#define SIM_FLASH_SIZE		((SIM_FLASH_PAGES - SIM_FLASH_FIRST_PAGE) * SIM_FLASH_PAGE_SIZE)
+#define SIM_FLASH_WRITES_MAX	2		///<times a word can be programmed between erases
+#define SIM_NO_CUT		0xFFFFFFFF
+#define SIM_NOT_TORN		0		///<the operation the power goes out on isn't done at all
+#define SIM_TORN_HALF		0xFFFFFFFF	///<a write programs the first half of its words
+#define SIM_LOGGED_OPERATIONS	4096		///<how many operations op_words is kept for
+
+typedef struct {
+  uint32_t	operations;	///<sd_flash_write() and sd_flash_page_erase() calls done
+  uint32_t	writes;
+  uint32_t	words_written;
+  uint32_t	erases;
+  uint32_t	page_erases[SIM_FLASH_PAGES - SIM_FLASH_FIRST_PAGE];
+  uint32_t	overprogrammed;	///<words programmed more than SIM_FLASH_WRITES_MAX times between erases
+  uint32_t	cut_at;		///<the operation the power goes out on.  SIM_NO_CUT to keep it on.
+  uint32_t	torn_words;	///<the words a write the power goes out on programs: SIM_NOT_TORN, SIM_TORN_HALF, or how many
+  uint8_t	op_words[SIM_LOGGED_OPERATIONS];	///<the words each write programmed (0 for an erase), so a test can tear it after each of them
+  bool		cut;		///<the power has gone out
+  uint8_t	word_writes[SIM_FLASH_SIZE / sizeof(uint32_t)];
+}sim_flash_t;
+extern sim_flash_t	*g_sim_flash;
+
+void sim_flash_init(void);
+void sim_flash_erase_all(void);
+void sim_flash_clear_counts(void);
+void sim_flash_cut(uint32_t operation, uint32_t torn_words);
+bool sim_flash_step(void);
+void sim_flash_run(void);
+uint32_t sim_flash_page_erases(uint32_t address);
+
+#endif /* TEST_SIM_FLASH_H_ */
@@ -0,0 +1,5 @@
+/**
+ * \file		Ladybug_Error.h
+ * \brief	The sources include Ladybug_Error.h, which is include/Ladybug_error.h on a file system that ignores case.
+ */
+#include "Ladybug_error.h"
@@ -0,0 +1,5 @@
+/**
+ * \file		Ladybug_Flash.h
+ * \brief	The sources include Ladybug_Flash.h, which is include/Ladybug_flash.h on a file system that ignores case.
+ */
+#include "Ladybug_flash.h"
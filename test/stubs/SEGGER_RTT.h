@@ -0,0 +1,11 @@
+/**
+ * \file		SEGGER_RTT.h
+ * \brief	The RTT trace goes to stdout when LADYBUG_TEST_VERBOSE is set in the environment.
+ */
+#ifndef TEST_STUBS_SEGGER_RTT_H_
+#define TEST_STUBS_SEGGER_RTT_H_
+
+unsigned SEGGER_RTT_WriteString(unsigned BufferIndex, const char *s);
+int SEGGER_RTT_printf(unsigned BufferIndex, const char *sFormat, ...);
+
+#endif /* TEST_STUBS_SEGGER_RTT_H_ */
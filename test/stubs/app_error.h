@@ -0,0 +1,30 @@
+/**
+ * \file		app_error.h
+ * \brief	The SDK's error macros.  app_error_handler() counts the errors and keeps the last one so a test can check for it.
+ */
+#ifndef TEST_STUBS_APP_ERROR_H_
+#define TEST_STUBS_APP_ERROR_H_
+#include <stdint.h>
+#include "nrf_error.h"
+
+extern uint32_t	g_app_errors;
+extern uint32_t	g_app_last_error;
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name);
+
+#define APP_ERROR_HANDLER(ERR_CODE)	app_error_handler((ERR_CODE), __LINE__, (uint8_t *)__FILE__)
+#define APP_ERROR_CHECK(ERR_CODE)			\
+  do {							\
+      const uint32_t LOCAL_ERR_CODE = (ERR_CODE);	\
+      if (LOCAL_ERR_CODE != 0) {			\
+	  APP_ERROR_HANDLER(LOCAL_ERR_CODE);		\
+      }							\
+  } while (0)
+#define APP_ERROR_CHECK_BOOL(BOOLEAN_VALUE)		\
+  do {							\
+      if (!(BOOLEAN_VALUE)) {				\
+	  APP_ERROR_HANDLER(0);				\
+      }							\
+  } while (0)
+
+#endif /* TEST_STUBS_APP_ERROR_H_ */
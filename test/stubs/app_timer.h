@@ -0,0 +1,30 @@
+/**
+ * \file		app_timer.h
+ * \brief	The SDK's app_timer.  A timer never goes off by itself on the host.  g_app_timer_ticks is the RTC1 counter, and a test
+ * 		calls what the timer would have.
+ */
+#ifndef TEST_STUBS_APP_TIMER_H_
+#define TEST_STUBS_APP_TIMER_H_
+#include <stdint.h>
+#include "app_util.h"
+
+#define APP_TIMER_CLOCK_FREQ		32768
+#define APP_TIMER_MIN_TIMEOUT_TICKS	5
+#define APP_TIMER_TICKS(MS, PRESCALER)	((uint32_t)ROUNDED_DIV((MS) * (uint64_t)APP_TIMER_CLOCK_FREQ, ((PRESCALER) + 1) * 1000))
+
+typedef uint32_t app_timer_id_t;
+typedef void (*app_timer_timeout_handler_t)(void *p_context);
+typedef enum {
+  APP_TIMER_MODE_SINGLE_SHOT,
+  APP_TIMER_MODE_REPEATED
+}app_timer_mode_t;
+
+extern uint32_t	g_app_timer_ticks;
+
+uint32_t app_timer_create(app_timer_id_t *p_timer_id, app_timer_mode_t mode, app_timer_timeout_handler_t timeout_handler);
+uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void *p_context);
+uint32_t app_timer_stop(app_timer_id_t timer_id);
+uint32_t app_timer_cnt_get(uint32_t *p_ticks);
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from, uint32_t *p_ticks_diff);
+
+#endif /* TEST_STUBS_APP_TIMER_H_ */
@@ -0,0 +1,17 @@
+/**
+ * \file		app_util.h
+ * \brief	The SDK's utility macros the sources use.
+ */
+#ifndef TEST_STUBS_APP_UTIL_H_
+#define TEST_STUBS_APP_UTIL_H_
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ROUNDED_DIV(A, B)	(((A) + ((B) / 2)) / (B))
+#define CEIL_DIV(A, B)		(((A) - 1) / (B) + 1)
+
+static inline bool is_word_aligned(void const *p) {
+  return ((uintptr_t)p & 0x03) == 0;
+}
+
+#endif /* TEST_STUBS_APP_UTIL_H_ */
@@ -0,0 +1,11 @@
+/**
+ * \file		app_util_platform.h
+ * \brief	The host has no interrupts, so a critical region is only a block.
+ */
+#ifndef TEST_STUBS_APP_UTIL_PLATFORM_H_
+#define TEST_STUBS_APP_UTIL_PLATFORM_H_
+
+#define CRITICAL_REGION_ENTER()	{
+#define CRITICAL_REGION_EXIT()	}
+
+#endif /* TEST_STUBS_APP_UTIL_PLATFORM_H_ */
@@ -0,0 +1,12 @@
+/**
+ * \file		ble_advdata.h
+ * \brief	What Ladybug_Hydro.h takes from the SDK's advertising data and the S110's GAP headers.
+ */
+#ifndef TEST_STUBS_BLE_ADVDATA_H_
+#define TEST_STUBS_BLE_ADVDATA_H_
+#include <stdint.h>
+
+#define BLE_GAP_DEVNAME_MAX_LEN	31
+typedef uint8_t uint16_le_t[2];
+
+#endif /* TEST_STUBS_BLE_ADVDATA_H_ */
@@ -0,0 +1,9 @@
+/**
+ * \file		ble_advertising.h
+ * \brief	Ladybug_Hydro.c includes the SDK's advertising module but doesn't call it.
+ */
+#ifndef TEST_STUBS_BLE_ADVERTISING_H_
+#define TEST_STUBS_BLE_ADVERTISING_H_
+#include "ble_advdata.h"
+
+#endif /* TEST_STUBS_BLE_ADVERTISING_H_ */
@@ -0,0 +1,72 @@
+/**
+ * \file		host_stubs.c
+ * \brief	What the SDK stand-ins in test/stubs need to link on the host.  A timer is checked when it is started but never goes off.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "SEGGER_RTT.h"
+#include "app_error.h"
+#include "nrf_gpio.h"
+#include "app_timer.h"
+#include "nrf_error.h"
+
+uint32_t	g_app_errors;
+uint32_t	g_app_last_error;
+uint32_t	g_gpio_sets;
+uint32_t	g_app_timer_ticks;
+static uint32_t	m_num_timers;
+
+static int verbose(void) {
+  static int m_verbose = -1;
+  if (m_verbose < 0) {
+      m_verbose = getenv("LADYBUG_TEST_VERBOSE") != NULL;
+  }
+  return m_verbose;
+}
+unsigned SEGGER_RTT_WriteString(unsigned BufferIndex, const char *s) {
+  (void)BufferIndex;
+  if (verbose()) {
+      fputs(s,stdout);
+  }
+  return 0;
+}
+int SEGGER_RTT_printf(unsigned BufferIndex, const char *sFormat, ...) {
+  (void)BufferIndex;
+  if (!verbose()) {
+      return 0;
+  }
+  va_list args;
+  va_start(args,sFormat);
+  int n = vprintf(sFormat,args);
+  va_end(args);
+  return n;
+}
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name) {
+  g_app_errors++;
+  g_app_last_error = error_code;
+  if (verbose()) {
+      printf("app_error_handler: %u at %s:%u\n",(unsigned)error_code,(const char *)p_file_name,(unsigned)line_num);
+  }
+}
+uint32_t app_timer_create(app_timer_id_t *p_timer_id, app_timer_mode_t mode, app_timer_timeout_handler_t timeout_handler) {
+  (void)mode;
+  (void)timeout_handler;
+  *p_timer_id = m_num_timers++;
+  return NRF_SUCCESS;
+}
+uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void *p_context) {
+  (void)p_context;
+  return timer_id < m_num_timers && timeout_ticks >= APP_TIMER_MIN_TIMEOUT_TICKS ? NRF_SUCCESS : NRF_ERROR_INVALID_PARAM;
+}
+uint32_t app_timer_stop(app_timer_id_t timer_id) {
+  return timer_id < m_num_timers ? NRF_SUCCESS : NRF_ERROR_INVALID_PARAM;
+}
+uint32_t app_timer_cnt_get(uint32_t *p_ticks) {
+  *p_ticks = g_app_timer_ticks;
+  return NRF_SUCCESS;
+}
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from, uint32_t *p_ticks_diff) {
+  *p_ticks_diff = (ticks_to - ticks_from) & 0x00FFFFFF;
+  return NRF_SUCCESS;
+}
@@ -0,0 +1,13 @@
+/**
+ * \file		nordic_common.h
+ * \brief	The SDK's common macros.
+ */
+#ifndef TEST_STUBS_NORDIC_COMMON_H_
+#define TEST_STUBS_NORDIC_COMMON_H_
+
+#define UNUSED_VARIABLE(X)	((void)(X))
+#define UNUSED_PARAMETER(X)	UNUSED_VARIABLE(X)
+#define MIN(a, b)		((a) < (b) ? (a) : (b))
+#define MAX(a, b)		((a) < (b) ? (b) : (a))
+
+#endif /* TEST_STUBS_NORDIC_COMMON_H_ */
@@ -0,0 +1,35 @@
+/**
+ * \file		nrf.h
+ * \brief	The registers the sources read.  FICR says how big the flash is and UICR that there is no bootloader, so
+ * 		pstorage_platform.h puts pstorage's pages at the top of the flash as it does on the board.  test/sim_flash.c sets them.
+ */
+#ifndef TEST_STUBS_NRF_H_
+#define TEST_STUBS_NRF_H_
+#include <stdint.h>
+#include <stdbool.h>
+
+#define __INLINE	inline
+
+typedef struct {
+  uint32_t	CODEPAGESIZE;	///<bytes in a flash page
+  uint32_t	CODESIZE;	///<flash pages
+}NRF_FICR_Type;
+typedef struct {
+  uint32_t	BOOTLOADERADDR;
+}NRF_UICR_Type;
+extern NRF_FICR_Type	g_nrf_ficr;
+extern NRF_UICR_Type	g_nrf_uicr;
+#define NRF_FICR	(&g_nrf_ficr)
+#define NRF_UICR	(&g_nrf_uicr)
+
+/**
+ * \brief The host is always in thread mode.
+ */
+static inline uint32_t __get_IPSR(void) {
+  return 0;
+}
+static inline void __DMB(void) {
+  __sync_synchronize();
+}
+
+#endif /* TEST_STUBS_NRF_H_ */
@@ -0,0 +1,11 @@
+/**
+ * \file		nrf_assert.h
+ * \brief	The SDK's ASSERT is the host's assert.
+ */
+#ifndef TEST_STUBS_NRF_ASSERT_H_
+#define TEST_STUBS_NRF_ASSERT_H_
+#include <assert.h>
+
+#define ASSERT(expr)	assert(expr)
+
+#endif /* TEST_STUBS_NRF_ASSERT_H_ */
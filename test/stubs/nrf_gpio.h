@@ -0,0 +1,22 @@
+/**
+ * \file		nrf_gpio.h
+ * \brief	The pins the sources drive.  Each set is counted so a test can see the EC caps were discharged.
+ */
+#ifndef TEST_STUBS_NRF_GPIO_H_
+#define TEST_STUBS_NRF_GPIO_H_
+#include <stdint.h>
+
+extern uint32_t	g_gpio_sets;
+
+static inline void nrf_gpio_cfg_output(uint32_t pin_number) {
+  (void)pin_number;
+}
+static inline void nrf_gpio_pin_set(uint32_t pin_number) {
+  (void)pin_number;
+  g_gpio_sets++;
+}
+static inline void nrf_gpio_pin_clear(uint32_t pin_number) {
+  (void)pin_number;
+}
+
+#endif /* TEST_STUBS_NRF_GPIO_H_ */
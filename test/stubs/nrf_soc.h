@@ -0,0 +1,26 @@
+/**
+ * \file		nrf_soc.h
+ * \brief	The SoftDevice's flash calls.  test/sim_flash.c does them on the host.
+ */
+#ifndef TEST_STUBS_NRF_SOC_H_
+#define TEST_STUBS_NRF_SOC_H_
+#include <stdint.h>
+#include "nrf_error.h"
+
+enum NRF_SOC_EVTS {
+  NRF_EVT_HFCLKSTARTED,
+  NRF_EVT_POWER_FAILURE_WARNING,
+  NRF_EVT_FLASH_OPERATION_SUCCESS,
+  NRF_EVT_FLASH_OPERATION_ERROR,
+  NRF_EVT_RADIO_BLOCKED,
+  NRF_EVT_RADIO_CANCELED,
+  NRF_EVT_RADIO_SIGNAL_CALLBACK_INVALID_RETURN,
+  NRF_EVT_RADIO_SESSION_IDLE,
+  NRF_EVT_RADIO_SESSION_CLOSED,
+  NRF_EVT_NUMBER_OF_EVTS
+};
+
+uint32_t sd_flash_write(uint32_t * const p_dst, uint32_t const * const p_src, uint32_t size);
+uint32_t sd_flash_page_erase(uint32_t page_number);
+
+#endif /* TEST_STUBS_NRF_SOC_H_ */
@@ -0,0 +1,30 @@
+/**
+ * \file		pstorage.h
+ * \brief	The SDK's pstorage API, so nRF51/pstorage.c builds on the host as it is.  The platform part is include/pstorage_platform.h.
+ */
+#ifndef TEST_STUBS_PSTORAGE_H_
+#define TEST_STUBS_PSTORAGE_H_
+#include "pstorage_platform.h"
+
+#define PSTORAGE_STORE_OP_CODE	0x01	///<Store operation type.
+#define PSTORAGE_LOAD_OP_CODE	0x02	///<Load operation type.
+#define PSTORAGE_CLEAR_OP_CODE	0x03	///<Clear operation type.
+#define PSTORAGE_UPDATE_OP_CODE	0x04	///<Update operation type.
+
+typedef void (*pstorage_ntf_cb_t)(pstorage_handle_t *p_handle, uint8_t op_code, uint32_t result, uint8_t *p_data, uint32_t data_len);
+typedef struct {
+  pstorage_ntf_cb_t	cb;
+  pstorage_size_t	block_size;
+  pstorage_size_t	block_count;
+}pstorage_module_param_t;
+
+uint32_t pstorage_init(void);
+uint32_t pstorage_register(pstorage_module_param_t *p_module_param, pstorage_handle_t *p_block_id);
+uint32_t pstorage_block_identifier_get(pstorage_handle_t *p_base_id, pstorage_size_t block_num, pstorage_handle_t *p_block_id);
+uint32_t pstorage_store(pstorage_handle_t *p_dest, uint8_t *p_src, pstorage_size_t size, pstorage_size_t offset);
+uint32_t pstorage_update(pstorage_handle_t *p_dest, uint8_t *p_src, pstorage_size_t size, pstorage_size_t offset);
+uint32_t pstorage_load(uint8_t *p_dest, pstorage_handle_t *p_src, pstorage_size_t size, pstorage_size_t offset);
+uint32_t pstorage_clear(pstorage_handle_t *p_base_id, pstorage_size_t size);
+uint32_t pstorage_access_status_get(uint32_t *p_count);
+
+#endif /* TEST_STUBS_PSTORAGE_H_ */
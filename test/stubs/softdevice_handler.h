@@ -0,0 +1,10 @@
+/**
+ * \file		softdevice_handler.h
+ * \brief	Ladybug_Hydro.c takes the SDK's common macros and the core's barriers through this header.
+ */
+#ifndef TEST_STUBS_SOFTDEVICE_HANDLER_H_
+#define TEST_STUBS_SOFTDEVICE_HANDLER_H_
+#include "nordic_common.h"
+#include "nrf.h"
+
+#endif /* TEST_STUBS_SOFTDEVICE_HANDLER_H_ */
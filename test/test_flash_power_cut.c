@@ -0,0 +1,324 @@
+/**
+ * \file		test_flash_power_cut.c
+ * \brief	The flash log on the simulated flash (sim_flash.c), through nRF51/pstorage.c and src/Ladybug_Flash.c as they are built for the
+ * 		board.
+ * \details	A workload of flushes changes the records: appends, changes that only clear bits (programmed in place), records marked
+ * 		without a change, and enough of them to compact the log several times.  The power is cut at every flash operation of it, and
+ * 		the boot after the cut has to find each record as it was before the flush the power went out on or after it.  That boot then
+ * 		writes more rounds (compacting again, with one record left uncached so the compaction copies it from the log) and the power
+ * 		is cut a second time in some of them.  A torn write programs only its first words: half of them, and then each number of
+ * 		them for every write of the workload.  A record programmed over only changes in one word, so a torn write can't leave it
+ * 		older than it was before the flush either.
+ * 		Each boot is a forked process, so Ladybug_Flash.c's and pstorage.c's statics start over like they do on the board.  The flash
+ * 		is shared.
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "host.h"
+#include "sim_flash.h"
+#include "app_error.h"
+#include "Ladybug_Error.h"
+#include "Ladybug_Flash.h"
+#include "Ladybug_Hydro.h"
+
+#define NUM_TEST_RECORDS	9
+#define RECORD_BYTES_MAX	224
+#define ROUNDS			150	///<the workload's flushes.  Enough to erase each log page more than once.
+#define RECOVERY_ROUNDS		20	///<the flushes the boot after a cut writes
+#define UNCACHED_RECORD		(NUM_TEST_RECORDS - 1)	///<not cached after a cut, so a compaction copies it from the log
+#define SECOND_CUT_STRIDE	4	///<the second cut is tried at every this many operations of the recovery ...
+#define FIRST_CUT_STRIDE	11	///<... after every this many of the first cuts
+#define LEGACY_ADDRESS		((SIM_FLASH_PAGES - 2) * SIM_FLASH_PAGE_SIZE)	///<the page below pstorage's swap page
+#define LOG_ADDRESS		(LEGACY_ADDRESS - FLASH_LOG_PAGES * FLASH_PAGE_SIZE)
+/**
+ * \brief The records, their sizes, and the blocks they were kept in before the log.
+ */
+static const struct {
+  flash_rw_t	record;
+  uint16_t	num_bytes;
+  uint8_t	first_block;
+}m_records[NUM_TEST_RECORDS] = {
+    {calibrationValues,32,0},
+    {plantInfo,32,1},
+    {deviceName,30,2},
+    {samplingConfig,16,3},
+    {ECcalibrationTable,60,4},
+    {calibrationHistory,200,6},
+    {probeHealthTrend,40,13},
+    {alarmConfig,20,15},
+    {sensorCalibrations,sizeof(storeSensorCalibrations_t),16},	///<sized from the sensor registry
+};
+typedef uint8_t records_t[NUM_TEST_RECORDS][RECORD_BYTES_MAX];
+/**
+ * \brief What the boots pass to each other.
+ */
+typedef struct {
+  uint32_t	round;		///<the round the last boot was on when the power went out.  ROUNDS (or RECOVERY_ROUNDS) if it wasn't.
+  records_t	found;		///<the records the boot after the cut found
+}shared_t;
+static shared_t		*m_shared;
+static records_t	m_ram;	///<the RAM copies the cache writes
+static uint32_t		m_torn_words;
+static uint32_t		m_first_cut;
+/**
+ * \brief The records before the log: the first three were written, the rest are erased.
+ */
+static void write_initial_flash(void) {
+  sim_flash_erase_all();
+  for (uint8_t i = 0; i < 3; i++) {
+      uint8_t *p_block = (uint8_t *)(uintptr_t)(LEGACY_ADDRESS + m_records[i].first_block * BLOCK_SIZE);
+      for (uint16_t b = 0; b < m_records[i].num_bytes; b++) {
+	  p_block[b] = (uint8_t)(0xA0 + i * 16 + b);
+      }
+  }
+}
+static void initial_state(records_t state) {
+  memset(state,0xFF,sizeof(records_t));
+  for (uint8_t i = 0; i < NUM_TEST_RECORDS; i++) {
+      memcpy(state[i],(uint8_t const *)(uintptr_t)(LEGACY_ADDRESS + m_records[i].first_block * BLOCK_SIZE),m_records[i].num_bytes);
+  }
+}
+/**
+ * \brief One round of the workload.  Every third round only clears a bit of its record, so it is programmed in place.
+ * @return the records marked dirty
+ */
+static uint16_t workload_round(records_t state, uint32_t round) {
+  uint8_t i = round % NUM_TEST_RECORDS;
+  uint16_t num_bytes = m_records[i].num_bytes;
+  uint16_t marked = 1 << i;
+  if (round % 3 == 0) {
+      for (uint16_t b = 0; b < num_bytes; b++) {
+	  uint8_t *p_byte = &state[i][(round + b) % num_bytes];
+	  if (*p_byte != 0) {
+	      *p_byte &= *p_byte - 1;
+	      break;
+	  }
+      }
+  }else {
+      for (uint8_t k = 0; k < 4; k++) {
+	  state[i][(round * 7 + k * 5) % num_bytes] ^= (uint8_t)(round * 31 + k) | 1;
+      }
+  }
+  if (round % 4 == 1) {
+      //marked without a change
+      marked |= 1 << ((i + 4) % NUM_TEST_RECORDS);
+  }
+  if (round % 5 == 2) {
+      uint8_t j = (i + 2) % NUM_TEST_RECORDS;
+      state[j][round % m_records[j].num_bytes] ^= 0x5A;
+      marked |= 1 << j;
+  }
+  return marked;
+}
+static void workload_state(records_t state, uint32_t rounds) {
+  initial_state(state);
+  for (uint32_t round = 0; round < rounds; round++) {
+      workload_round(state,round);
+  }
+}
+/**
+ * \brief A round after the cut rewrites a third of the cached records.
+ */
+static uint16_t recovery_round(records_t state, uint32_t round) {
+  uint16_t marked = 0;
+  for (uint8_t i = 0; i < NUM_TEST_RECORDS; i++) {
+      if (i != UNCACHED_RECORD && (round + i) % 3 == 0) {
+	  for (uint16_t b = 0; b < m_records[i].num_bytes; b++) {
+	      state[i][b] = (uint8_t)(i * 37 + round * 11 + b * 3);
+	  }
+	  marked |= 1 << i;
+      }
+  }
+  return marked;
+}
+static void recovery_state(records_t state, uint32_t rounds) {
+  memcpy(state,m_shared->found,sizeof(records_t));
+  for (uint32_t round = 0; round < rounds; round++) {
+      recovery_round(state,round);
+  }
+}
+/**
+ * \brief Boot: mount the log and read each record into RAM.
+ */
+static void boot(uint16_t cached) {
+  ladybug_flash_init();
+  for (uint8_t i = 0; i < NUM_TEST_RECORDS; i++) {
+      uint8_t const *p_bytes;
+      pstorage_size_t num_bytes;
+      uint8_t version;
+      uint32_t err_code = ladybug_flash_map(m_records[i].record,&p_bytes,&num_bytes,&version);
+      CHECK(err_code == NRF_SUCCESS || err_code == LADYBUG_ERROR_FLASH_LEGACY_RECORD);
+      memset(m_ram[i],0xFF,RECORD_BYTES_MAX);
+      memcpy(m_ram[i],p_bytes,num_bytes < m_records[i].num_bytes ? num_bytes : m_records[i].num_bytes);
+      if (cached & (1 << i)) {
+	  ladybug_flash_cache_record(m_records[i].record,m_ram[i],m_records[i].num_bytes);
+      }
+  }
+}
+/**
+ * \brief Mark the records and write them.
+ * @return false if the power went out.
+ */
+static bool flush(uint16_t marked) {
+  for (uint8_t i = 0; i < NUM_TEST_RECORDS; i++) {
+      if (marked & (1 << i)) {
+	  ladybug_flash_mark_dirty(m_records[i].record);
+      }
+  }
+  ladybug_flash_cache_flush();
+  sim_flash_run();
+  return !g_sim_flash->cut;
+}
+/**
+ * \brief Each record in RAM has to be what it was before the round the power went out on, or after it - torn or not.
+ * @param p_state	the records after a number of rounds
+ * @param last_round	the round the boot stops at if the power stays on
+ */
+static void check_records(char const *p_boot, uint32_t round, void (*p_state)(records_t state, uint32_t rounds), uint32_t last_round) {
+  static records_t before, after;
+  p_state(before,round);
+  p_state(after,round < last_round ? round + 1 : round);
+  for (uint8_t i = 0; i < NUM_TEST_RECORDS; i++) {
+      uint16_t num_bytes = m_records[i].num_bytes;
+      if (memcmp(m_ram[i],before[i],num_bytes) != 0 && memcmp(m_ram[i],after[i],num_bytes) != 0) {
+	  printf("FAILED %s after the cut at operation %u (%u words torn): record %u is neither before nor after round %u\n",
+		 p_boot,(unsigned)m_first_cut,(unsigned)m_torn_words,(unsigned)m_records[i].record,(unsigned)round);
+	  m_failures++;
+      }
+  }
+}
+static void run_workload(void) {
+  boot(0xFFFF);
+  for (uint32_t round = 0; round < ROUNDS; round++) {
+      m_shared->round = round;
+      if (!flush(workload_round(m_ram,round))) {
+	  return;
+      }
+  }
+  m_shared->round = ROUNDS;
+}
+/**
+ * \brief The boot after the cut.  The records are checked, and then it keeps on writing.
+ */
+static void run_recovery(void) {
+  uint32_t round = m_shared->round;
+  boot(0xFFFF & ~(1 << UNCACHED_RECORD));
+  check_records("boot",round,workload_state,ROUNDS);
+  memcpy(m_shared->found,m_ram,sizeof(records_t));
+  for (round = 0; round < RECOVERY_ROUNDS; round++) {
+      m_shared->round = round;
+      if (!flush(recovery_round(m_ram,round))) {
+	  return;
+      }
+  }
+  m_shared->round = RECOVERY_ROUNDS;
+}
+static void check_recovery(void) {
+  boot(0);
+  check_records("second boot",m_shared->round,recovery_state,RECOVERY_ROUNDS);
+}
+/**
+ * \brief Play a boot in a process of its own.
+ * @return the failures it had
+ */
+static int run_boot(void (*p_boot)(void)) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+      m_failures = 0;
+      p_boot();
+      fflush(stdout);
+      _exit(m_failures != 0 || g_app_errors != 0 || g_sim_flash->overprogrammed != 0);
+  }
+  int status;
+  waitpid(pid,&status,0);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+/**
+ * \brief Cut the power at an operation of the workload, and (unless second_cut is SIM_NO_CUT) at an operation of the boot after it.
+ * @param torn_words	see sim_flash_cut()
+ * @return false if the power wasn't cut at the last of them (the boot has fewer operations)
+ */
+static bool power_cut(uint32_t first_cut, uint32_t second_cut, uint32_t torn_words) {
+  m_first_cut = first_cut;
+  m_torn_words = torn_words;
+  write_initial_flash();
+  sim_flash_cut(first_cut,torn_words);
+  int failures = run_boot(run_workload);
+  if (!g_sim_flash->cut) {
+      return false;
+  }
+  sim_flash_clear_counts();
+  sim_flash_cut(second_cut,torn_words);
+  failures += run_boot(run_recovery);
+  bool cut = second_cut == SIM_NO_CUT || g_sim_flash->cut;
+  sim_flash_clear_counts();
+  failures += run_boot(check_recovery);
+  if (failures != 0) {
+      printf("FAILED the cut at operation %u, then %u (%u words torn)\n",(unsigned)first_cut,(unsigned)second_cut,(unsigned)torn_words);
+      m_failures++;
+  }
+  return cut;
+}
+/**
+ * \brief The workload without a cut.  Each log page's erases are counted by the log and by the flash, and are even.
+ */
+static void run_whole_workload(void) {
+  run_workload();
+  flashCacheStats_t stats;
+  ladybug_flash_cache_stats(&stats);
+  uint16_t fewest = 0xFFFF, most = 0;
+  printf("  %u flash operations: %u writes, %u erases.  Erases of each log page:",(unsigned)g_sim_flash->operations,
+	 (unsigned)g_sim_flash->writes,(unsigned)g_sim_flash->erases);
+  for (uint8_t page = 0; page < FLASH_LOG_PAGES; page++) {
+      uint32_t erases = sim_flash_page_erases(LOG_ADDRESS + page * FLASH_PAGE_SIZE);
+      printf(" %u",(unsigned)erases);
+      CHECK(erases == stats.log_page_erases[page]);
+      fewest = erases < fewest ? erases : fewest;
+      most = erases > most ? erases : most;
+  }
+  printf("\n");
+  CHECK(most - fewest <= 1);
+  CHECK(stats.erases == g_sim_flash->erases);
+  CHECK(stats.in_place > 0 && stats.unchanged > 0);
+  //the records' old page and the swap page are never erased.
+  CHECK(sim_flash_page_erases(LEGACY_ADDRESS) == 0 && sim_flash_page_erases(LEGACY_ADDRESS + SIM_FLASH_PAGE_SIZE) == 0);
+}
+int main(void) {
+  sim_flash_init();
+  m_shared = mmap(NULL,sizeof(shared_t),PROT_READ | PROT_WRITE,MAP_SHARED | MAP_ANONYMOUS,-1,0);
+  CHECK(m_shared != MAP_FAILED);
+  write_initial_flash();
+  m_first_cut = SIM_NO_CUT;
+  m_failures += run_boot(run_whole_workload);
+  CHECK(m_shared->round == ROUNDS && g_sim_flash->erases > FLASH_LOG_PAGES);
+  uint32_t operations = g_sim_flash->operations;
+  static uint8_t op_words[SIM_LOGGED_OPERATIONS];
+  CHECK(operations <= SIM_LOGGED_OPERATIONS);
+  memcpy(op_words,g_sim_flash->op_words,sizeof(op_words));
+  //the boot after the whole workload finds it all.
+  sim_flash_clear_counts();
+  m_failures += run_boot(run_recovery);
+  uint32_t cuts = 0;
+  for (uint32_t first_cut = 0; first_cut < operations; first_cut++) {
+      cuts += power_cut(first_cut,SIM_NO_CUT,SIM_NOT_TORN);
+      cuts += power_cut(first_cut,SIM_NO_CUT,SIM_TORN_HALF);
+      //the flash programs a word at a time, so a write can be torn after any of its words.
+      for (uint32_t torn_words = 1; first_cut < SIM_LOGGED_OPERATIONS && torn_words < op_words[first_cut]; torn_words++) {
+	  if (torn_words != op_words[first_cut] / 2) {
+	      cuts += power_cut(first_cut,SIM_NO_CUT,torn_words);
+	  }
+      }
+  }
+  for (uint32_t first_cut = 0; first_cut < operations; first_cut += FIRST_CUT_STRIDE) {
+      for (uint32_t second_cut = 0; power_cut(first_cut,second_cut,second_cut % 2 == 1 ? SIM_TORN_HALF : SIM_NOT_TORN); second_cut += SECOND_CUT_STRIDE) {
+	  cuts++;
+      }
+  }
+  printf("  %u power cuts\n",(unsigned)cuts);
+  return host_result("test_flash_power_cut");
+}
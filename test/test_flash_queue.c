@@ -0,0 +1,117 @@
+/**
+ * \file		test_flash_queue.c
+ * \brief	The queued reads and writes (ladybug_flash_read(), ladybug_flash_write(), ladybug_flash_wait()) on the simulated flash
+ * 		(sim_flash.c), through nRF51/pstorage.c and src/Ladybug_Flash.c as they are built for the board.
+ * \details	Each request gets its own id, its callback comes back with that id once pstorage is done with it, and the requests finish in
+ * 		the order they were made.  pstorage_load() copies right away, so a read only waits behind a write.  A write of the same bytes
+ * 		that hasn't started yet is folded into the one waiting.  A bad request, or one more than the queue holds, isn't queued.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "host.h"
+#include "sim_flash.h"
+#include "app_error.h"
+#include "Ladybug_Error.h"
+#include "Ladybug_Flash.h"
+
+#define RECORD_BYTES		32
+#define MAX_CALLBACKS		(FLASH_QUEUE_DEPTH * 2)
+
+static struct {
+  flash_request_id_t	id;
+  uint32_t		err_code;
+}m_callbacks[MAX_CALLBACKS];
+static uint8_t		m_num_callbacks;
+static uint32_t		m_written[RECORD_BYTES / sizeof(uint32_t)];	///<word aligned, as pstorage_store() wants it
+static uint8_t		m_read[FLASH_QUEUE_DEPTH][RECORD_BYTES];
+
+static void did_flash_action(flash_request_id_t request, uint32_t err_code) {
+  CHECK(m_num_callbacks < MAX_CALLBACKS);
+  if (m_num_callbacks < MAX_CALLBACKS) {
+      m_callbacks[m_num_callbacks].id = request;
+      m_callbacks[m_num_callbacks].err_code = err_code;
+      m_num_callbacks++;
+  }
+}
+/**
+ * \brief A write and then a read of the same record.  The read is queued behind the write, so it gets what was written.
+ */
+static void check_write_then_read(void) {
+  memset(m_written,0x5A,sizeof(m_written));
+  m_num_callbacks = 0;
+  flash_request_id_t write_id = ladybug_flash_write(plantInfo,(uint8_t *)m_written,RECORD_BYTES,did_flash_action);
+  flash_request_id_t read_id = ladybug_flash_read(plantInfo,m_read[0],RECORD_BYTES,did_flash_action);
+  CHECK(write_id != FLASH_NO_REQUEST && read_id != FLASH_NO_REQUEST && write_id != read_id);
+  CHECK(m_num_callbacks == 0);
+  sim_flash_run();
+  CHECK(m_num_callbacks == 2);
+  CHECK(m_callbacks[0].id == write_id && m_callbacks[0].err_code == NRF_SUCCESS);
+  CHECK(m_callbacks[1].id == read_id && m_callbacks[1].err_code == NRF_SUCCESS);
+  CHECK(memcmp(m_read[0],m_written,RECORD_BYTES) == 0);
+  CHECK(ladybug_flash_wait(write_id) == NRF_SUCCESS && ladybug_flash_wait(read_id) == NRF_SUCCESS);
+  uint8_t const *p_bytes;
+  pstorage_size_t num_bytes;
+  uint8_t version;
+  CHECK(ladybug_flash_map(plantInfo,&p_bytes,&num_bytes,&version) == NRF_SUCCESS);
+  CHECK(num_bytes == RECORD_BYTES && memcmp(p_bytes,m_written,RECORD_BYTES) == 0);
+}
+/**
+ * \brief Writes of the same bytes made while another write is in flight are folded into one, which stores the bytes as they are when
+ * it gets to them.
+ */
+static void check_write_folding(void) {
+  static uint32_t other[RECORD_BYTES / sizeof(uint32_t)];
+  m_num_callbacks = 0;
+  memset(other,0x77,sizeof(other));
+  flash_request_id_t in_flight = ladybug_flash_write(deviceName,(uint8_t *)other,RECORD_BYTES,did_flash_action);
+  memset(m_written,0x11,sizeof(m_written));
+  flash_request_id_t first_write = ladybug_flash_write(plantInfo,(uint8_t *)m_written,RECORD_BYTES,did_flash_action);
+  memset(m_written,0x22,sizeof(m_written));
+  flash_request_id_t second_write = ladybug_flash_write(plantInfo,(uint8_t *)m_written,RECORD_BYTES,did_flash_action);
+  CHECK(in_flight != FLASH_NO_REQUEST && first_write != FLASH_NO_REQUEST && first_write == second_write);
+  sim_flash_run();
+  CHECK(m_num_callbacks == 2 && m_callbacks[0].id == in_flight && m_callbacks[1].id == first_write);
+  CHECK(ladybug_flash_read(plantInfo,m_read[1],RECORD_BYTES,NULL) != FLASH_NO_REQUEST);
+  sim_flash_run();
+  CHECK(memcmp(m_read[1],m_written,RECORD_BYTES) == 0);
+}
+/**
+ * \brief A bad request isn't queued, and neither is one more than FLASH_QUEUE_DEPTH.  The ones that were queued all finish, the reads
+ * after the write they waited behind.
+ */
+static void check_rejected(void) {
+  CHECK(ladybug_flash_read(plantInfo,NULL,RECORD_BYTES,did_flash_action) == FLASH_NO_REQUEST);
+  CHECK(g_app_last_error == LADYBUG_ERROR_NULL_POINTER);
+  CHECK(ladybug_flash_write(plantInfo,(uint8_t *)m_written,0,did_flash_action) == FLASH_NO_REQUEST);
+  CHECK(g_app_last_error == LADYBUG_ERROR_NUM_BYTES_TO_WRITE);
+  CHECK(ladybug_flash_wait(FLASH_NO_REQUEST) == LADYBUG_ERROR_INVALID_COMMAND);
+  m_num_callbacks = 0;
+  flash_request_id_t ids[FLASH_QUEUE_DEPTH];
+  //an unchanged record isn't written, so the write would finish right away.
+  memset(m_written,0x33,sizeof(m_written));
+  ids[0] = ladybug_flash_write(plantInfo,(uint8_t *)m_written,RECORD_BYTES,did_flash_action);
+  CHECK(ids[0] != FLASH_NO_REQUEST);
+  for (uint8_t i = 1; i < FLASH_QUEUE_DEPTH; i++) {
+      ids[i] = ladybug_flash_read(plantInfo,m_read[i],RECORD_BYTES,did_flash_action);
+      CHECK(ids[i] != FLASH_NO_REQUEST);
+  }
+  CHECK(ladybug_flash_read(plantInfo,m_read[0],RECORD_BYTES,did_flash_action) == FLASH_NO_REQUEST);
+  CHECK(g_app_last_error == LADYBUG_ERROR_FLASH_QUEUE_FULL);
+  sim_flash_run();
+  CHECK(m_num_callbacks == FLASH_QUEUE_DEPTH);
+  for (uint8_t i = 0; i < FLASH_QUEUE_DEPTH && i < m_num_callbacks; i++) {
+      CHECK(m_callbacks[i].id == ids[i] && m_callbacks[i].err_code == NRF_SUCCESS);
+      CHECK(i == 0 || memcmp(m_read[i],m_written,RECORD_BYTES) == 0);
+  }
+  g_app_errors = 0;
+}
+int main(void) {
+  sim_flash_init();
+  sim_flash_erase_all();
+  ladybug_flash_init();
+  check_write_then_read();
+  check_write_folding();
+  check_rejected();
+  CHECK(g_app_errors == 0 && g_sim_flash->overprogrammed == 0);
+  return host_result("test_flash_queue");
+}
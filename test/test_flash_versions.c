@@ -0,0 +1,152 @@
+/**
+ * \file		test_flash_versions.c
+ * \brief	The versions of the records' layouts, on the simulated flash (sim_flash.c): the version a record is written with comes back
+ * 		from ladybug_flash_map() after a boot, and Ladybug_Hydro.c migrates a record written in an older layout when it loads it.
+ * \details	Ladybug_Hydro.c is included so its static load_record(), migrate_record() and fit_pH_calibration() can be called.  Each boot
+ * 		is a forked process, so Ladybug_Flash.c's and pstorage.c's statics start over like they do on the board.  The flash is
+ * 		shared.
+ */
+#include <sys/wait.h>
+#include <unistd.h>
+#include "host.h"
+#include "sim_flash.h"
+#include "../src/Ladybug_Hydro.c"
+
+#define LEGACY_ADDRESS		((SIM_FLASH_PAGES - 2) * SIM_FLASH_PAGE_SIZE)	///<the page below pstorage's swap page.  calibrationValues is its first block.
+#define PH4_MV			178
+#define PH7_MV			0
+
+ADC_interface adc;	///<the sensors aren't read
+uint32_t ladybug_time_now(void) {
+  return 0;
+}
+/**
+ * \brief Calibration values as the firmware wrote them before the pH10 point (version 0): the pHFit bytes are erased.
+ */
+static void write_version_0_calibration(void) {
+  storeCalibrationValues_t store;
+  sim_flash_erase_all();
+  memset(&store,0xFF,sizeof(store));
+  store.write_check = WRITE_CHECK;
+  memset(&store.calValues,0,sizeof(store.calValues));
+  store.calValues.pH4_mV = PH4_MV;
+  store.calValues.pH7_mV = PH7_MV;
+  memcpy((void *)(uintptr_t)LEGACY_ADDRESS,&store,sizeof(store));
+}
+static uint16_t marks(void) {
+  flashCacheStats_t stats;
+  ladybug_flash_cache_stats(&stats);
+  return stats.marks;
+}
+static bool load_calibration(void) {
+  return load_record(calibrationValues,&m_persistent.storeCalibrationValues,sizeof(storeCalibrationValues_t),
+		     &m_persistent.storeCalibrationValues.write_check);
+}
+/**
+ * \brief Check a record's bytes and version in the log.
+ */
+static void check_mapped(flash_rw_t record, void const *p_store, pstorage_size_t num_bytes, uint8_t version) {
+  uint8_t const *p_bytes;
+  pstorage_size_t num_bytes_in_flash;
+  uint8_t version_in_flash;
+  CHECK(ladybug_flash_map(record,&p_bytes,&num_bytes_in_flash,&version_in_flash) == NRF_SUCCESS);
+  CHECK(version_in_flash == version);
+  CHECK(num_bytes_in_flash == num_bytes && memcmp(p_bytes,p_store,num_bytes) == 0);
+}
+/**
+ * \brief The first boot after the update: the version 0 calibration values are migrated and written with the new version.  plantInfo is
+ * still in its first layout and is written with version 0.
+ */
+static void run_migration(void) {
+  ladybug_flash_init();
+  CHECK(load_calibration());
+  pHFit_t const *p_fit = &m_persistent.storeCalibrationValues.pHFit;
+  CHECK(p_fit->num_points == 2 && p_fit->pH10_mV == 0 && p_fit->slope_x10_mV_per_pH == 0 && p_fit->residual_x10_mV == 0);
+  CHECK(m_persistent.storeCalibrationValues.calValues.pH4_mV == PH4_MV);
+  CHECK(marks() == 1);
+  memset(&m_persistent.storePlantInfo,0x3C,sizeof(storePlantInfo_t));
+  m_persistent.storePlantInfo.write_check = WRITE_CHECK;
+  ladybug_flash_cache_record(plantInfo,(uint8_t *)&m_persistent.storePlantInfo,sizeof(storePlantInfo_t));
+  ladybug_flash_mark_dirty(plantInfo);
+  ladybug_flash_cache_flush();
+  sim_flash_run();
+  check_mapped(calibrationValues,&m_persistent.storeCalibrationValues,sizeof(storeCalibrationValues_t),CALIBRATION_VALUES_VERSION);
+  check_mapped(plantInfo,&m_persistent.storePlantInfo,sizeof(storePlantInfo_t),PLANT_INFO_VERSION);
+}
+/**
+ * \brief The boot after that finds the versions in the log, and the migrated record isn't migrated (or written) again.
+ */
+static void run_migrated(void) {
+  ladybug_flash_init();
+  storeCalibrationValues_t migrated;
+  uint8_t version;
+  CHECK(copy_record(calibrationValues,&migrated,sizeof(migrated),&version) == NRF_SUCCESS);
+  CHECK(version == CALIBRATION_VALUES_VERSION);
+  CHECK(load_calibration());
+  CHECK(marks() == 0);
+  CHECK(memcmp(&m_persistent.storeCalibrationValues,&migrated,sizeof(migrated)) == 0);
+  check_mapped(calibrationValues,&migrated,sizeof(migrated),CALIBRATION_VALUES_VERSION);
+  storePlantInfo_t plant_info;
+  memset(&plant_info,0x3C,sizeof(plant_info));
+  plant_info.write_check = WRITE_CHECK;
+  check_mapped(plantInfo,&plant_info,sizeof(plant_info),PLANT_INFO_VERSION);
+}
+/**
+ * \brief Play a boot in a process of its own.
+ */
+static void run_boot(void (*p_boot)(void)) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+      m_failures = 0;
+      p_boot();
+      fflush(stdout);
+      _exit(m_failures != 0 || g_app_errors != 0 || g_sim_flash->overprogrammed != 0);
+  }
+  int status;
+  waitpid(pid,&status,0);
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+/**
+ * \brief A version 0 fit that already has its points, and a fit in the current layout, are left as they are.
+ */
+static void check_migrate_record(void) {
+  storeCalibrationValues_t store, before;
+  memset(&store,0,sizeof(store));
+  store.pHFit.num_points = 3;
+  store.pHFit.pH10_mV = -178;
+  before = store;
+  CHECK(!migrate_record(calibrationValues,0,&store) && memcmp(&store,&before,sizeof(store)) == 0);
+  memset(&store,0xFF,sizeof(store));
+  before = store;
+  CHECK(!migrate_record(calibrationValues,CALIBRATION_VALUES_VERSION,&store) && memcmp(&store,&before,sizeof(store)) == 0);
+  CHECK(!migrate_record(plantInfo,0,&store) && memcmp(&store,&before,sizeof(store)) == 0);
+}
+/**
+ * \brief A fit with a num_points other than 2 or 3 is fitted through pH4 and pH7.
+ */
+static void check_fit_num_points(void) {
+  static const uint8_t num_points[] = {0,1,4,0xFF};
+  m_persistent.storeCalibrationValues.calValues.pH4_mV = PH4_MV;
+  m_persistent.storeCalibrationValues.calValues.pH7_mV = PH7_MV;
+  m_persistent.storeCalibrationValues.pHFit.num_points = 2;
+  fit_pH_calibration();
+  int16_t slope = m_persistent.storeCalibrationValues.pHFit.slope_x10_mV_per_pH;
+  CHECK(m_pH_line.num_points == 2 && slope == (PH4_MV - PH7_MV) * 10 / 3);
+  for (uint8_t i = 0; i < sizeof(num_points); i++) {
+      m_persistent.storeCalibrationValues.pHFit.num_points = num_points[i];
+      m_persistent.storeCalibrationValues.pHFit.slope_x10_mV_per_pH = 0;
+      fit_pH_calibration();
+      CHECK(m_pH_line.num_points == 2 && m_persistent.storeCalibrationValues.pHFit.slope_x10_mV_per_pH == slope);
+  }
+}
+int main(void) {
+  sim_flash_init();
+  write_version_0_calibration();
+  run_boot(run_migration);
+  sim_flash_clear_counts();
+  run_boot(run_migrated);
+  check_migrate_record();
+  check_fit_num_points();
+  return host_result("test_flash_versions");
+}
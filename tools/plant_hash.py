@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Generate the plant target table and its perfect hash for src/Ladybug_Plants.c.
+
+The plants and their targets are listed in PLANTS below.  Running the script prints m_plant_targets, PLANT_HASH_MULTIPLIER and
+m_plant_slots to paste into Ladybug_Plants.c.  The key of a plant is the FNV-1a hash of its lower case type, a 0 byte, and its lower
+case stage (the same as ladybug_plants_find_target()).  The multiplier already in Ladybug_Plants.c is kept if it still gives every
+plant its own slot.  Otherwise odd multipliers are tried until one does.
+
+    tools/plant_hash.py                  print the tables
+    tools/plant_hash.py --check FILE     exit 1 if the tables in FILE aren't the ones generated from PLANTS
+"""
+import os
+import random
+import re
+import sys
+
+PLANTS_C = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src", "Ladybug_Plants.c")
+
+PLANT_HASH_BITS = 6
+FNV_OFFSET_BASIS = 2166136261
+FNV_PRIME = 16777619
+
+# type, stage, pH min * 100, pH max * 100, EC min (µS/cm), EC max (µS/cm)
+PLANTS = [
+    ("lettuce", "seedling", 550, 650, 400, 800),
+    ("lettuce", "youth", 550, 650, 800, 1200),
+    ("lettuce", "mature", 550, 650, 1000, 1400),
+    ("tomato", "seedling", 550, 650, 800, 1200),
+    ("tomato", "youth", 550, 650, 1500, 2500),
+    ("tomato", "mature", 550, 650, 2000, 3500),
+    ("cucumber", "seedling", 550, 600, 800, 1200),
+    ("cucumber", "youth", 550, 600, 1500, 2000),
+    ("cucumber", "mature", 550, 600, 1700, 2500),
+    ("basil", "seedling", 550, 650, 500, 800),
+    ("basil", "youth", 550, 650, 1000, 1400),
+    ("basil", "mature", 550, 650, 1000, 1600),
+    ("strawberry", "seedling", 550, 620, 600, 1000),
+    ("strawberry", "youth", 550, 620, 1000, 1400),
+    ("strawberry", "mature", 550, 620, 1400, 1800),
+    ("pepper", "seedling", 580, 630, 800, 1200),
+    ("pepper", "youth", 580, 630, 1400, 2000),
+    ("pepper", "mature", 580, 630, 1800, 2800),
+    ("spinach", "seedling", 600, 700, 600, 1000),
+    ("spinach", "youth", 600, 700, 1400, 1800),
+    ("spinach", "mature", 600, 700, 1800, 2300),
+    ("kale", "seedling", 550, 650, 600, 1000),
+    ("kale", "youth", 550, 650, 1200, 1600),
+    ("kale", "mature", 550, 650, 1250, 1500),
+]
+
+
+def fnv1a(hash_, data):
+    for byte in data:
+        hash_ = ((hash_ ^ byte) * FNV_PRIME) & 0xFFFFFFFF
+    return hash_
+
+
+def key_of(plant_type, stage):
+    return fnv1a(FNV_OFFSET_BASIS, plant_type.lower().encode() + b"\0" + stage.lower().encode())
+
+
+def slot_of(key, multiplier):
+    return ((key * multiplier) & 0xFFFFFFFF) >> (32 - PLANT_HASH_BITS)
+
+
+def slots_of(keys, multiplier):
+    slots = [slot_of(key, multiplier) for key in keys]
+    return slots if len(set(slots)) == len(slots) else None
+
+
+def find_multiplier(keys, first_try):
+    if first_try is not None and slots_of(keys, first_try):
+        return first_try
+    rng = random.Random(0)
+    while True:
+        multiplier = rng.getrandbits(32) | 1
+        if slots_of(keys, multiplier):
+            return multiplier
+
+
+def generate(first_try=None):
+    keys = [key_of(p[0], p[1]) for p in PLANTS]
+    multiplier = find_multiplier(keys, first_try)
+    slots = slots_of(keys, multiplier)
+    lines = ["#define PLANT_HASH_MULTIPLIER\t0x%08x" % multiplier, "static plantTargetEntry_t const m_plant_targets[] = {"]
+    for key, (plant_type, stage, pH_min, pH_max, EC_min, EC_max) in zip(keys, PLANTS):
+        lines.append("    {0x%08x,{%d,%d,%4d,%4d}}, ///<%s %s" % (key, pH_min, pH_max, EC_min, EC_max, plant_type, stage))
+    lines.append("};")
+    lines.append("static uint8_t const m_plant_slots[PLANT_HASH_SLOTS] = {")
+    for index, slot in enumerate(slots):
+        lines.append("    [%d] = %d," % (slot, index + 1))
+    lines.append("};")
+    return multiplier, keys, slots, "\n".join(lines)
+
+
+def multiplier_in(source):
+    match = re.search(r"#define PLANT_HASH_MULTIPLIER\s+(0x[0-9a-fA-F]+)", source)
+    return int(match.group(1), 16) if match else None
+
+
+def check(path):
+    source = open(path).read()
+    multiplier = multiplier_in(source)
+    entries = re.findall(r"\{(0x[0-9a-fA-F]+),\{\s*(\d+),\s*(\d+),\s*(\d+),\s*(\d+)\}\}", source)
+    slots = {int(slot): int(entry) for slot, entry in re.findall(r"\[(\d+)\] = (\d+),", source)}
+    _, keys, expected_slots, _ = generate(multiplier)
+    expected_entries = [("0x%08x" % key,) + tuple(str(v) for v in plant[2:]) for key, plant in zip(keys, PLANTS)]
+    found_entries = [(e[0].lower(),) + e[1:] for e in entries]
+    if found_entries != expected_entries:
+        print("%s: m_plant_targets doesn't match PLANTS" % path)
+        return 1
+    if slots != {slot: index + 1 for index, slot in enumerate(expected_slots)} or slots_of(keys, multiplier) is None:
+        print("%s: m_plant_slots doesn't match PLANT_HASH_MULTIPLIER 0x%08x" % (path, multiplier))
+        return 1
+    print("%s: %d plants, each in its own slot" % (path, len(PLANTS)))
+    return 0
+
+
+if __name__ == "__main__":
+    if len(sys.argv) == 3 and sys.argv[1] == "--check":
+        sys.exit(check(sys.argv[2]))
+    print(generate(multiplier_in(open(PLANTS_C).read()) if os.path.exists(PLANTS_C) else None)[3])